@@ -2,9 +2,34 @@
 
 #include <common.h>
 
+// 音声のリサンプリング品質
+typedef enum {
+    APU_QUALITY_LOW,    // サンプル周期毎の点サンプリング（既定）
+    APU_QUALITY_HIGH    // サンプル周期内のチャンネル出力を平均する（--audio-quality high）
+} apu_quality;
+
 // APU初期化
 void apu_init();
 
+// 精度モード。実行中に切り替えて良い
+void apu_set_quality(apu_quality quality);
+apu_quality apu_get_quality();
+
+// trueの場合、T-cycle毎ではなくサンプル周期毎にまとめてチャンネルを進める
+// フレームシーケンサー(長さ/スイープ/エンベロープ)の反映が最大1サンプル周期遅れる
+void apu_set_batch(bool batch);
+
+// バッチモードで溜まっているT-cycleを処理する
+void apu_flush();
+
+// スナップショット用(mem.h)。精度モードとオーディオバッファは戻さない
+u32 apu_state_size();
+void apu_save_state(void *dst);
+void apu_load_state(const void *src);
+
+// 各チャンネルの現在の出力(0-15)
+void apu_get_channel_outputs(u8 out[4]);
+
 // T-cycle単位でAPUを進める
 void apu_tick();
 
@@ -15,3 +40,6 @@ void apu_write(u16 address, u8 value);
 // SDL2オーディオ初期化（ui_initから呼び出し）
 void apu_audio_init();
 void apu_audio_shutdown();
+
+// SDLのキューに溜まっている音声の長さ(ms)
+u32 apu_audio_queued_ms();
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <common.h>
+#include <tile_cache.h>
+
+//BGマップ(0x9800/0x9C00)を256×256のカラー番号に展開したキャッシュ
+//マスごとに描画したタイル番号とタイルのversionを覚えておき、参照されたときに
+//マップかタイルデータが変わっていたマスだけ描き直す
+typedef struct {
+    u8 pixels[256][256];
+    u16 cell_tile[32][32];      //描画したタイル番号(0-383)。0xFFFFは未描画
+    u32 cell_version[32][32];
+    bool data_8000;             //描画したときのタイルデータ領域(LCDC.4)
+} bg_layer;
+
+void bg_layer_init(bg_layer *layer);
+
+//yの行のマスをcell_xから右にcount個(32で折り返す)検証して、その行の256ピクセルを返す
+//map_offsetはVRAM先頭からのマップのオフセット(0x1800/0x1C00)
+const u8 *bg_layer_row(bg_layer *layer, tile_cache *tc, const u8 *vram, u16 map_offset,
+    bool data_8000, u8 y, u8 cell_x, int count);
+
+//マップ全体を検証する。マップビューアーやスクリーンショット用
+void bg_layer_update_all(bg_layer *layer, tile_cache *tc, const u8 *vram, u16 map_offset, bool data_8000);
+
+//行をxから折り返しながらcountピクセルコピー
+void bg_layer_copy_row(const u8 *row, u8 x, u8 *out, int count);
+
+//0: 0x9800, 1: 0x9C00
+bg_layer *bg_layer_get(int map);
@@ -2,8 +2,22 @@
 
 #include <common.h>
 
+typedef u8 (*bus_read_fn)(u16 address);
+typedef void (*bus_write_fn)(u16 address, u8 value);
+
+//ページ(256バイト)単位で差し込むスローパスの種類
+typedef enum {
+    BUS_HOOK_WATCH = (1 << 0),
+    BUS_HOOK_CHEAT = (1 << 1),
+} bus_hook;
+
 u8 bus_read(u16 address);
+
+//ウォッチポイントやチートを通さずにデバイスから直接読む。デバッガ用
+u8 bus_read_raw(u16 address);
 void bus_write(u16 address, u8 value);
 
 u16 bus_read16(u16 address);
-void bus_write16(u16 address, u16 value);
\ No newline at end of file
+void bus_write16(u16 address, u16 value);
+
+void bus_set_page_hook(u8 page, bus_hook hook, bool on);
@@ -18,11 +18,36 @@ typedef struct {
     u16 global_checksum;
 } rom_header;
 
-bool cart_load(char *cart);
+typedef enum {
+    MAPPER_NONE,
+    MAPPER_MBC1,
+    MAPPER_MBC2,
+    MAPPER_MMM01,
+    MAPPER_MBC3,
+    MAPPER_MBC5,
+    MAPPER_MBC6,
+    MAPPER_MBC7,
+    MAPPER_OTHER
+} cart_mapper;
+
+bool cart_load(char *cart, char *patch);
+
+const char *cart_type_str(u8 type);
+cart_mapper cart_mapper_of(u8 type);
+const char *cart_mapper_name(cart_mapper mapper);
+
+//0x0134-0x014Cのヘッダチェックサムと、0x014E-0x014Fを除く全バイトの合計
+u8 cart_header_checksum(const u8 *rom);
+u16 cart_global_checksum(const u8 *rom, u32 size);
 
 u8 cart_read(u16 address);
 void cart_write(u16 address, u8 value);
 
 bool cart_need_save();
+
+//スナップショット用(mem.h)。バンクの選択状態だけで、RAMの中身はmem_arenaにある
+u32 cart_state_size();
+void cart_save_state(void *dst);
+void cart_load_state(const void *src);
 void cart_battery_load();
 void cart_battery_save();
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <common.h>
+
+typedef enum {
+    CHEAT_GAME_GENIE,   //ROMパッチ (ABC-DEF[-GHI])
+    CHEAT_GAMESHARK     //RAM書き込み (TTVVAAAA)
+} cheat_type;
+
+typedef struct {
+    cheat_type type;
+    bool enabled;
+    u16 address;
+    u8 value;
+    bool has_compare;
+    u8 compare;
+    char code[16];
+} cheat;
+
+#define MAX_CHEATS 64
+
+bool cheat_parse(const char *code, cheat *out);
+
+int cheat_add(const char *code);
+bool cheat_load_file(const char *path);
+void cheat_clear();
+
+void cheat_set_enabled(int id, bool on);
+//UIスレッドから呼ぶ。次のcheat_apply_frame()でCPUスレッドが切り替える
+void cheat_toggle_all();
+
+//VBLANK開始時にON/OFFの要求を反映してGameSharkコードを書き込む
+void cheat_apply_frame();
+
+//Game Genieコードが設定されたページの読み込みだけがここを通る
+u8 cheat_filter_read(u16 address, u8 value);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <common.h>
+
+//zlib互換のCRC32。crc32_update(0, ...)から始めて連続したデータに続けて適用できる
+u32 crc32_update(u32 crc, const u8 *data, u32 len);
+u32 crc32(const u8 *data, u32 len);
+
+void sha1(const u8 *data, u32 len, u8 digest[20]);
@@ -9,6 +9,7 @@ typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
+typedef int64_t i64;
 
 #define BIT(a, n) ((a & (1 << n)) ? 1 : 0)
 
@@ -16,6 +17,14 @@ typedef uint64_t u64;
 
 #define BETWEEN(a, b, c) ((a >= b) && (a <= c))
 
+#define CACHE_LINE_SIZE 64
+
+#if defined(_MSC_VER)
+#define CACHE_ALIGNED __declspec(align(CACHE_LINE_SIZE))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+
 u32 get_ticks();
 void delay(u32 ms);
 
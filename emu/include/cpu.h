@@ -17,27 +17,37 @@ typedef struct {
 } cpu_registers;
 
 typedef struct {
+    //命令毎に参照するフィールドを先頭のキャッシュラインにまとめる
     cpu_registers regs;
+    u8 int_flags;
+    u8 ie_register;
+    bool int_master_enabled;
+    bool enabling_ime;
+    bool halted;
+
+    u8 cur_opcode;
+    bool dest_is_mem;
     u16 fetched_data;
     u16 mem_dest;
-    bool dest_is_mem;
-    u8 cur_opcode;
     instruction *cur_inst;
 
-    bool halted;
     bool stepping;
-    
-    bool int_master_enabled;
-    bool enabling_ime;
-    u8 ie_register;
-    u8 int_flags;
-} cpu_context;
+    u64 instructions;   //実行した命令の数
+} CACHE_ALIGNED cpu_context;
 
 cpu_registers *cpu_get_regs();
 
 void cpu_init();
 bool cpu_step();
 
+//起動してから実行した命令の数
+u64 cpu_instruction_count();
+
+//スナップショット用(mem.h)。実行した命令の数とステップ実行の設定は戻さない
+u32 cpu_state_size();
+void cpu_save_state(void *dst);
+void cpu_load_state(const void *src);
+
 typedef void (*IN_PROC) (cpu_context *);
 
 IN_PROC inst_get_processor(in_type type);
@@ -5,4 +5,9 @@
 void dma_start(u8 start);
 void dma_tick();
 
-bool dma_transferring();
\ No newline at end of file
+bool dma_transferring();
+
+//スナップショット用(mem.h)
+u32 dma_state_size();
+void dma_save_state(void *dst);
+void dma_load_state(const void *src);
\ No newline at end of file
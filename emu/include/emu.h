@@ -13,4 +13,10 @@ int emu_run(int argc, char **argv);
 
 emu_context *emu_get_context();
 
+//一時停止/再開。再開した場合は止まっているCPUスレッドを起こす
+void emu_set_paused(bool paused);
+
+//一時停止中のCPUスレッドを起こし、頼まれている処理(デバッグ表示のコピーなど)をさせる
+void emu_wake_paused();
+
 void emu_cycles(int cpu_cycles);
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <common.h>
+
+//PPUスレッドとUIスレッドの間のトリプルバッファ
+//PPUはバックバッファに描画してVBLANKでframebuf_publish()し、UIはframebuf_acquire()で
+//最新の完成したフレームを受け取る。バッファの受け渡しはアトミック変数1つの交換だけで行う
+#define FRAMEBUF_SIZE (160 * 144)
+#define FRAMEBUF_LINES 144
+
+//ライン毎の変更ビットマップ(1ビット1ライン)
+typedef struct {
+    u64 bits[(FRAMEBUF_LINES + 63) / 64];
+} framebuf_dirty;
+
+#define FRAMEBUF_LINE_DIRTY(d, y) (((d)->bits[(y) / 64] >> ((y) % 64)) & 1)
+
+//PPUが描画中のバッファ
+u8 *framebuf_back();
+
+//バックバッファを完成したフレームとして公開し、次に描画するバッファを返す
+u8 *framebuf_publish();
+
+//最新の完成したフレームを返す。新しいフレームが無ければ前回と同じバッファ
+//frameには公開された通し番号が入る(NULL可)
+const u8 *framebuf_acquire(u32 *frame);
+
+//公開されたフレームの数
+u32 framebuf_frame_count();
+
+//フレームを公開した直後に公開したスレッドで呼ぶ関数(NULLで解除)
+void framebuf_set_notify(void (*notify)());
+
+//最後にacquireしたフレームのライン毎のハッシュをseen(FRAMEBUF_LINES個)と比べ、
+//内容が変わったラインをdirtyに立ててseenを更新する。変わったラインの数を返す
+int framebuf_dirty_lines(u64 *seen, framebuf_dirty *dirty);
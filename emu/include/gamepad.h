@@ -19,4 +19,9 @@ bool gamepad_dir_sel();
 void gamepad_set_sel(u8 value);
 
 gamepad_state *gamepad_get_state();
-u8 gamepad_get_output();
\ No newline at end of file
+u8 gamepad_get_output();
+
+//スナップショット用(mem.h)。P1の選択ビットだけで、押されているボタンは戻さない
+u32 gamepad_state_size();
+void gamepad_save_state(void *dst);
+void gamepad_load_state(const void *src);
\ No newline at end of file
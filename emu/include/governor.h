@@ -0,0 +1,31 @@
+#pragma once
+
+#include <common.h>
+
+//1フレームの処理時間がホストの時間に間に合わないときに精度を下げる(--governor)
+//処理時間の移動平均が予算を超え続けたら1段階下げ、十分に余裕がある状態が続いたら1段階戻す。
+//下げる閾値と戻す閾値、続ける時間を変えて行ったり来たりしないようにする
+typedef enum {
+    GOVERNOR_FULL,          //設定どおり
+    GOVERNOR_SCANLINE,      //FIFOの代わりにスキャンラインレンダラー
+    GOVERNOR_SKIP,          //さらに1フレームおきに描画
+    GOVERNOR_AUDIO,         //さらに音声を点サンプリングにしてAPUをまとめて進める
+    GOVERNOR_LEVELS
+} governor_level;
+
+//処理時間/予算の移動平均がこれを超えたら下げる
+#define GOVERNOR_DEGRADE_LOAD 0.90
+#define GOVERNOR_DEGRADE_FRAMES 30
+
+//これを下回ったら戻す
+#define GOVERNOR_RESTORE_LOAD 0.60
+#define GOVERNOR_RESTORE_FRAMES 180
+
+void governor_enable(bool enable);
+bool governor_enabled();
+
+//1フレーム毎に呼ぶ。busy_msはエミュレーションにかかった時間、budget_msは1フレームの時間
+void governor_frame(double busy_ms, double budget_ms);
+
+governor_level governor_get_level();
+const char *governor_level_name(governor_level level);
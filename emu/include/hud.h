@@ -0,0 +1,24 @@
+#pragma once
+
+#include <common.h>
+#include <pacer.h>
+
+//画面に重ねる性能表示(F1で表示/非表示)
+//文字は起動時にNotoSansMono-Medium.ttfから作ったグリフのテクスチャアトラスから
+//1文字1回のSDL_RenderCopyで描くので、毎フレームTTFでラスタライズしない
+struct SDL_Renderer;
+
+//グリフアトラスを作る。フォントが見つからなければfalseでHUDは表示されない
+bool hud_init(struct SDL_Renderer *renderer);
+
+void hud_toggle();
+bool hud_visible();
+
+//CPUスレッドから1秒毎に呼ぶ。instructionsはその1秒間に実行した命令の数
+void hud_set_stats(const pacer_stats *stats, u64 instructions);
+
+//前回描いてから表示内容が変わったか(表示中のみ)
+bool hud_changed();
+
+//表示中ならウィンドウの左上に描く。SDL_RenderPresentの前に呼ぶ
+void hud_draw(struct SDL_Renderer *renderer);
@@ -2,4 +2,9 @@
 #include <common.h>
 
 u8 io_read(u16 address);
-void io_write(u16 address, u8 value);
\ No newline at end of file
+void io_write(u16 address, u8 value);
+
+//スナップショット用(mem.h)。シリアルのSB/SC
+u32 io_state_size();
+void io_save_state(void *dst);
+void io_load_state(const void *src);
\ No newline at end of file
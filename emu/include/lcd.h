@@ -15,9 +15,10 @@ typedef struct {
     u8 win_y;
     u8 win_x;
 
-    u32 bg_colors[4];
-    u32 sp1_colors[4];
-    u32 sp2_colors[4];
+    //カラー番号からフレームバッファのピクセル(シェード+パレット、video.h)への変換
+    u8 bg_colors[4];
+    u8 sp1_colors[4];
+    u8 sp2_colors[4];
 } lcd_context;
 
 typedef enum {
@@ -29,6 +30,11 @@ typedef enum {
 
 lcd_context *lcd_get_context();
 
+//スナップショット用(mem.h)。bg_colors等の変換表も含む
+u32 lcd_state_size();
+void lcd_save_state(void *dst);
+void lcd_load_state(const void *src);
+
 #define LCDC_BGW_ENABLE (BIT(lcd_get_context()->lcdc, 0))
 #define LCDC_OBJ_ENABLE (BIT(lcd_get_context()->lcdc, 1))
 #define LCDC_OBJ_HEIGHT (BIT(lcd_get_context()->lcdc, 2) ? 16 : 8)
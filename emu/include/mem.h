@@ -0,0 +1,35 @@
+#pragma once
+
+#include <common.h>
+
+//ゲストから見えるメモリを1つのアラインされた領域にまとめたもの
+//
+//オフセット  サイズ    内容
+//0x00000    0x2000    VRAM (0x8000-0x9FFF)
+//0x02000    0x2000    WRAM (0xC000-0xDFFF)
+//0x04000    0x00A0    OAM  (0xFE00-0xFE9F) 残りはキャッシュライン境界までパディング
+//0x04100    0x0080    HRAM (0xFF80-0xFFFE)
+//0x04180    0x0080    パディング
+//0x04200    0x20000   カートリッジRAM (8KB x 16バンク)
+//
+//各領域はキャッシュライン境界から始まるので、スナップショットは領域全体の
+//memcpy 1回で済む
+typedef struct {
+    u8 vram[0x2000];
+    u8 wram[0x2000];
+    u8 oam[0x100];
+    u8 hram[0x80];
+    u8 pad[0x80];
+    u8 cart_ram[16][0x2000];
+} CACHE_ALIGNED mem_arena;
+
+extern mem_arena gb_arena;
+
+mem_arena *mem_get_arena();
+
+//マシン全体のスナップショット。mem_arenaの後に各モジュールの状態
+//(CPU、タイマー、LCD、DMA、カートリッジのバンク、シリアル、P1、PPU、APU)が続く
+//ホスト側の設定(描画方式、音声の精度、実行した命令の数等)は含まない
+u32 mem_snapshot_size();
+void mem_snapshot(void *dst);
+void mem_restore(const void *src);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <common.h>
+
+//ホストの時間に合わせてエミュレーションの速度を調整する
+//DMGの1フレームは70224クロック / 4194304Hz = 約16.743ms。
+//期限は開始時刻からのフレーム数で計算するので、sleepの誤差は次のフレームに持ち越さない。
+//期限の少し前までclock_nanosleepで眠り、残りはスピンする
+#define PACER_CLOCK_HZ 4194304
+#define PACER_FRAME_CLOCKS 70224
+
+//統計を集計して表示する間隔(ns)
+#define PACER_REPORT_NS 1000000000LL
+
+//パーセンタイルの計算に使う1集計期間の処理時間の数。超えた分は捨てる
+#define PACER_MAX_SAMPLES 512
+
+typedef struct {
+    u32 frames;         //集計期間のフレーム数
+    u32 late;           //期限に間に合わなかったフレーム数
+    double avg_ms;      //フレーム間隔の平均
+    double max_ms;      //フレーム間隔の最大
+    double jitter_ms;   //フレーム間隔と1フレームの時間の差(絶対値)の平均
+    double busy_min_ms; //待つ前までの処理時間(pacer_busy_ms)の最小/平均/99パーセンタイル
+    double busy_avg_ms;
+    double busy_p99_ms;
+    double speed;       //実機に対する速度(%)
+} pacer_stats;
+
+//期限を今から数え直し、統計を捨てる
+void pacer_reset();
+
+//エミュレーションが1フレーム進んだら呼ぶ。次のフレームの期限まで待つ
+//集計期間が終わった場合はstatsに結果を入れてtrueを返す(statsはNULL可)
+bool pacer_frame(pacer_stats *stats);
+
+//1フレームの時間(ns)
+double pacer_frame_ns();
+
+//直前のフレームで待ち始めるまでにかかった時間(ms)。エミュレーションの処理時間
+double pacer_busy_ms();
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <common.h>
+
+//IPS/BPS/UPSパッチをROMイメージに適用する。
+//sourceは元のROM(読み取り専用)、*targetは同じ内容の書き込み可能なイメージ。
+//値が変わるバイトだけに書き込むので、*targetがMAP_PRIVATEのマッピングなら
+//変更されたページだけがコピーされる。
+//出力サイズが*target_sizeを超える場合は*targetをmalloc()で確保し直す。
+//その場合も元の*targetは解放しないので、*targetが変わったら呼び出し側で解放する。
+bool patch_apply(const char *path, const u8 *source, u32 source_size,
+    u8 **target, u32 *target_size);
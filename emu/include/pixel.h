@@ -0,0 +1,34 @@
+#pragma once
+
+#include <common.h>
+
+//2BPPのビットプレーン展開とパレット変換のカーネル
+//CPUに合わせてpixel_init()でscalar/SSE2/AVX2/BMI2の実装を選ぶ。どの実装も出力は同じ
+//SSSE3はスケーラーのための判定で、ピクセルのカーネルはSSE2と同じものを使う
+typedef enum {
+    PIXEL_ISA_SCALAR,
+    PIXEL_ISA_SSE2,
+    PIXEL_ISA_SSSE3,
+    PIXEL_ISA_AVX2,
+    PIXEL_ISA_BMI2
+} pixel_isa;
+
+//lo/hiの2バイトを8ピクセル分のカラー番号(0-3)に展開。左端のピクセルが先頭
+extern void (*pixel_decode_row)(u8 lo, u8 hi, u8 *out);
+
+//lo/hiの2バイトを4色のパレットで8ピクセル分の32bitカラーに変換
+extern void (*pixel_decode_row_argb)(u8 lo, u8 hi, const u32 *palette, u32 *out);
+
+//カラー番号(0-3)の列を4エントリのパレットで1バイトのピクセルに変換
+extern void (*pixel_map_row)(const u8 *index, const u8 *palette, u8 *out, int count);
+
+void pixel_init();
+
+//CPUがその命令セットに対応しているか
+bool pixel_isa_supported(pixel_isa isa);
+
+//指定した実装に切り替える。CPUが対応していない場合はfalse
+bool pixel_use_isa(pixel_isa isa);
+
+pixel_isa pixel_get_isa();
+const char *pixel_isa_name(pixel_isa isa);
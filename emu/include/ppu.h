@@ -1,6 +1,8 @@
 #pragma once
 
 #include <common.h>
+#include <tile_cache.h>
+#include <bg_layer.h>
 
 static const int LINES_PER_FRAME = 154;
 static const int TICKS_PER_LINE = 456;
@@ -15,25 +17,32 @@ typedef enum {
     FS_PUSH
 } fetch_state;
 
-typedef struct _fifo_entry {
-    struct _fifo_entry *next;
-    u32 value;
-} fifo_entry;
+//Pixel FIFOのエントリは1バイト
+//bit0-1: カラー番号, bit4: パレット(0=OBP0, 1=OBP1), bit7: BG優先フラグ
+#define FIFO_COLOR(e) ((e) & 0b11)
+#define FIFO_PALETTE(e) (((e) >> 4) & 1)
+#define FIFO_BG_PRIORITY(e) (((e) >> 7) & 1)
+#define FIFO_ENTRY(color, palette, bgp) ((color) | ((palette) << 4) | ((bgp) << 7))
+
+//固定長のリングバッファ。フェッチャーはサイズが8以下のときだけ8ピクセル積むので16で足りる
+#define FIFO_SIZE 16
 
 typedef struct {
-    fifo_entry *head;
-    fifo_entry *tail;
-    u32 size;
+    u8 data[FIFO_SIZE];
+    u8 head;
+    u8 size;
 } fifo;
 
 typedef struct {
     fetch_state cur_fetch_state;
-    fifo pixel_fifo;
+    fifo bg_fifo;
+    fifo obj_fifo;
     u8 line_x;
     u8 pushed_x;
     u8 fetch_x;
     u8 bgw_fetch_data[3];
     u8 fetch_entry_data[6]; //OAM data
+    u8 fetch_entry_row[3][8];   //fetch_entry_dataを展開したカラー番号。左右反転済み
     u8 map_y;
     u8 map_x;
     u8 tile_y;
@@ -53,43 +62,113 @@ typedef struct {
     u8 f_bgp : 1;    
 } oam_entry;
 
-typedef struct _oam_line_entry {
-    oam_entry entry;
-    struct _oam_line_entry *next;
-} oam_line_entry;
+//スキャンライン毎に掛かっているスプライトのビットマスク(bit n = OAMのn番目)
+//OAMのY座標への書き込みで差分更新する。スプライトの高さが変わった場合とDMAの後は作り直す
+#define SPRITE_INDEX_LINES 144
 
 typedef struct {
-    oam_entry oam_ram[40];
-    u8 vram[0x2000];
+    u64 lines[SPRITE_INDEX_LINES];
+    u8 height;
+    bool dirty;
+} sprite_index;
 
-    pixel_fifo_context pfc;
+//描画方式
+typedef enum {
+    PPU_RENDER_FIFO,        //ドット単位のPixel FIFO
+    PPU_RENDER_SCANLINE,    //モード3開始時に1ライン分まとめて描画。途中で書き込みがあればFIFOに切り替える
+    PPU_RENDER_THREAD       //PPUスレッドでスキャンラインレンダラーを使って描画(ppu_thread.h)
+} ppu_renderer;
 
-    u8 line_sprite_count;
-    oam_line_entry *line_sprites;
-    oam_line_entry line_entry_array[10];
+//スキャンラインレンダラーが1ラインを描画するのに必要な状態
+typedef struct {
+    const u8 *vram;
+    tile_cache *tiles;
+    bg_layer *layers;       //[0]: 0x9800, [1]: 0x9C00
+    u8 lcdc;
+    u8 ly;
+    u8 scroll_y;
+    u8 scroll_x;
+    u8 win_y;
+    u8 win_x;
+    u8 window_line;
+    u8 stale_tile;          //LCDC.0が0のときにフェッチャーが使い回す前回のタイルID
+    u8 sprite_count;
+    oam_entry sprites[10];  //x座標が小さい順
+    u8 bg_colors[4];
+    u8 sp1_colors[4];
+    u8 sp2_colors[4];
+} ppu_line_state;
+
+typedef struct {
+    //ドット毎に参照するフィールドを先頭のキャッシュラインにまとめる
+    pixel_fifo_context pfc;
+    u32 line_ticks;
+    u8 *video_buffer;       //描画中のバックバッファ(framebuf.h)。1ピクセル1バイト(video.h)
 
     u8 fetched_entry_count;
-    oam_entry fetched_entries[3];
+    u8 line_sprite_count;
     u8 window_line;
+    bool line_fast;         //現在のラインはスキャンラインレンダラーで描画済み
+    bool frame_skip;        //現在のフレームは描画せずにタイミングだけ進める
+    oam_entry fetched_entries[3];
+    oam_entry line_sprites[10];     //現在のラインのスプライト。x座標が小さい順
+
+    //OAM/VRAMの実体はmem_arenaにある
+    oam_entry *oam_ram;
+    u8 *vram;
 
     u32 current_frame;
-    u32 line_ticks;
-    u32 *video_buffer;
-} ppu_context;
+    ppu_renderer renderer;
+    bool skip_request;      //次のフレームの開始時にframe_skipに反映する
+    u8 skip_interval;       //このフレーム数に1回だけ描画する(0と1は全て描画)
+    sprite_index sprites;
+} CACHE_ALIGNED ppu_context;
 
 void ppu_init();
 void ppu_tick();
 
+//LCDC bit7の切り替え。lcd_write()から呼ばれる
+void ppu_lcd_power(bool on);
+
 void ppu_oam_write(u16 address, u8 value);
+void ppu_oam_dma_write(u8 offset, u8 value);
+void ppu_oam_dma_done();
 u8 ppu_oam_read(u16 address);
 
+void ppu_sprite_index_invalidate();
+
+//スナップショット用(mem.h)。ライン内の位置とPixel FIFOの状態で、描画方式等の設定は戻さない
+u32 ppu_state_size();
+void ppu_save_state(void *dst);
+void ppu_load_state(const void *src);
+u64 ppu_sprite_index_line(u8 ly, u8 height);
+
 void ppu_vram_write(u16 address, u8 value);
 u8 ppu_vram_read(u16 address);
 
 ppu_context *ppu_get_context();
 
+void ppu_set_renderer(ppu_renderer renderer);
+
+//次のフレームを描画しない。モード/LY/STAT/割り込みのタイミングはそのまま進み、
+//フレームはframebufに公開されない。フレーム毎に指定する
+void ppu_skip_frame(bool skip);
+
+//intervalフレームに1回だけ描画し、それ以外はppu_skip_frame(true)と同じように扱う
+//0と1は全て描画する。実行中に変更して良い
+void ppu_set_skip_interval(u8 interval);
+
 void pipeline_process();
 
 void pipeline_fifo_reset();
 
-bool window_visible();
\ No newline at end of file
+bool window_visible();
+
+void pipeline_timing_process();
+
+//スキャンラインレンダラー
+u8 ppu_line_tile(const ppu_line_state *st, int fetch_x);
+void ppu_render_line(const ppu_line_state *st, u8 *line);
+void ppu_scanline_begin();
+void ppu_scanline_end();
+void ppu_scanline_fallback();
@@ -5,4 +5,5 @@
 void ppu_mode_oam();
 void ppu_mode_xfer();
 void ppu_mode_vblank();
-void ppu_mode_hblank();
\ No newline at end of file
+void ppu_mode_hblank();
+void ppu_mode_lcd_off();
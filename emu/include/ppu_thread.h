@@ -0,0 +1,51 @@
+#pragma once
+
+#include <common.h>
+
+//PPUスレッド(--renderer thread)
+//CPUスレッドはLY/STAT/割り込みのタイミングだけを計算し、LCDレジスタ/VRAM/OAMへの書き込みと
+//ラインの開始/終了、フレームの終了をロックフリーのログに積む。PPUスレッドはログを順に読んで
+//自分のVRAM/OAM/レジスタのコピーに反映しながらスキャンラインレンダラーで描画する。
+//描画は最大1フレーム遅れる。モード3の途中の書き込みは次のラインから反映される
+//
+//描画スレッドが2以上の場合はVBLANKまでのログを溜めておき、144ラインをチャンクに分けてワーカーで描画する。
+//PPUスレッドはログを受け取りながら状態を進め、チャンクの境目でチェックポイントを取る。
+//各ワーカーはチェックポイントから自分のチャンクの範囲のログだけを反映して描画する
+
+typedef enum {
+    PPU_LOG_WRITE,      //address: 0x8000-0x9FFF, 0xFE00-0xFE9F, 0xFF40-0xFF4B
+    PPU_LOG_COLOR,      //address: bg_colors/sp1_colors/sp2_colors の通し番号(0-11)
+    PPU_LOG_LINE,       //モード3の開始。address: LY, value: window_line
+    PPU_LOG_LINE_END,   //モード3の終了。value: フェッチャーのfetch_x
+    PPU_LOG_FRAME       //VBLANKの開始。描画したフレームを公開する
+} ppu_log_type;
+
+//ログのエントリ。ラインのマーカーとの前後関係が書き込みのタイムスタンプになる
+typedef struct {
+    u16 address;
+    u8 value;
+    u8 type;
+} ppu_log_entry;
+
+#define PPU_LOG_SIZE (1 << 16)
+#define PPU_MAX_RENDER_THREADS 16
+
+//フレームを分割して描画するスレッドの数(PPUスレッドを含む)。ppu_init()より前に呼ぶ
+void ppu_thread_set_render_threads(int count);
+
+//PPUスレッドを起動して現在のVRAM/OAM/レジスタを送る。起動済みの場合は作り直す
+bool ppu_thread_start();
+
+//ログを全て処理してからPPUスレッドを止める
+void ppu_thread_stop();
+
+bool ppu_thread_running();
+
+//VRAM/OAM/レジスタを全てログに積み直す(ステートのロード後など)
+void ppu_thread_sync();
+
+//CPUスレッド側から呼ぶ
+void ppu_thread_write(u16 address, u8 value);
+void ppu_thread_line(u8 ly, u8 window_line);
+void ppu_thread_line_end(u8 fetch_x);
+void ppu_thread_frame();
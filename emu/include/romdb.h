@@ -0,0 +1,37 @@
+#pragma once
+
+#include <common.h>
+
+//ROMライブラリのインデックス。<dir>/.gbemu_index に保存する
+#define ROMDB_FILE ".gbemu_index"
+
+typedef struct {
+    char *name;             //ディレクトリからの相対パス
+    u64 mtime;
+    u64 size;
+
+    char title[17];
+    u8 type;
+    u8 mapper;
+    u8 rom_size;
+    u8 ram_size;
+    u8 cgb_flag;
+    u8 version;
+    bool header_ok;
+    bool global_ok;
+
+    u32 crc32;
+    u8 sha1[20];
+} romdb_entry;
+
+typedef struct {
+    romdb_entry *entries;
+    u32 count;
+} romdb;
+
+bool romdb_load(const char *dir, romdb *db);
+bool romdb_save(const char *dir, const romdb *db);
+void romdb_free(romdb *db);
+
+//dirをスキャンしてインデックスを更新する。mtime/sizeが変わっていないROMは再計算しない
+bool romdb_index(const char *dir, int threads);
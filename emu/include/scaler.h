@@ -0,0 +1,40 @@
+#pragma once
+
+#include <common.h>
+
+//フレームバッファ(1ピクセル1バイト、video.h)をCPUで拡大する
+//出力も1ピクセル1バイトなので、表示や保存の前にvideo_convert()で色に変換する。
+//どのカーネルにもスカラーの参照実装(_ref)があり、SIMD版と出力は同じ
+typedef enum {
+    SCALER_NONE,
+    SCALER_NEAREST,     //整数倍の最近傍
+    SCALER_SCALE2X,     //Scale2x (AdvMAME2x)
+    SCALER_SCALE3X,     //Scale3x (AdvMAME3x)
+    SCALER_XBR          //xBRの2倍。補間せずに近い方の隣のピクセルを選ぶ
+} scaler_type;
+
+//入力の最大サイズ
+#define SCALER_MAX_W 256
+#define SCALER_MAX_H 256
+
+//"nearestN"(N=2-8), "scale2x", "scale3x", "xbr", "none"
+//知らない名前の場合は使える名前を表示してfalse
+bool scaler_parse(const char *name, scaler_type *type, int *factor);
+const char *scaler_name(scaler_type type);
+
+//倍率。nearestの場合はfactorそのもの
+int scaler_factor(scaler_type type, int factor);
+
+//srcはw×hで詰まっている。dstは(w×倍率)×(h×倍率)でpitchは1ラインのバイト数
+void scaler_apply(scaler_type type, int factor, const u8 *src, int w, int h, u8 *dst, int pitch);
+
+void scaler_nearest(const u8 *src, int w, int h, u8 *dst, int pitch, int factor);
+void scaler_scale2x(const u8 *src, int w, int h, u8 *dst, int pitch);
+void scaler_scale3x(const u8 *src, int w, int h, u8 *dst, int pitch);
+void scaler_xbr(const u8 *src, int w, int h, u8 *dst, int pitch);
+
+//スカラーの参照実装
+void scaler_nearest_ref(const u8 *src, int w, int h, u8 *dst, int pitch, int factor);
+void scaler_scale2x_ref(const u8 *src, int w, int h, u8 *dst, int pitch);
+void scaler_scale3x_ref(const u8 *src, int w, int h, u8 *dst, int pitch);
+void scaler_xbr_ref(const u8 *src, int w, int h, u8 *dst, int pitch);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <common.h>
+
+//VRAMのタイルデータ(0x8000-0x97FF、384タイル)をカラー番号(0-3)の行に展開したキャッシュ
+//ppu_vram_write()で該当タイルをdirtyにして、次に参照されたときに展開し直す
+#define TILE_COUNT 384
+
+typedef struct {
+    u8 rows[TILE_COUNT][8][8];      //タイル×行×ピクセル。左端のピクセルが先頭
+    u8 flipped[TILE_COUNT][8][8];   //左右反転したもの
+    bool dirty[TILE_COUNT];
+    u32 version[TILE_COUNT];        //書き込みがある度に増える。BGレイヤーキャッシュの検証に使う
+} tile_cache;
+
+void tile_cache_init(tile_cache *tc);
+void tile_cache_invalidate_all(tile_cache *tc);
+
+//VRAM上のアドレス(0x0000-0x17FF)に書き込みがあったタイルをdirtyにする
+static inline void tile_cache_invalidate(tile_cache *tc, u16 offset) {
+    if (offset < TILE_COUNT * 16) {
+        tc->dirty[offset >> 4] = true;
+        tc->version[offset >> 4]++;
+    }
+}
+
+void tile_cache_decode(tile_cache *tc, const u8 *vram, u16 tile);
+
+//tileはVRAM先頭からのタイル番号(0-383)、rowはタイル内の行(0-7)
+static inline const u8 *tile_cache_row(tile_cache *tc, const u8 *vram, u16 tile, u8 row, bool flip) {
+    if (tc->dirty[tile]) {
+        tile_cache_decode(tc, vram, tile);
+    }
+
+    return flip ? tc->flipped[tile][row] : tc->rows[tile][row];
+}
+
+tile_cache *tile_cache_get();
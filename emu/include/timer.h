@@ -15,4 +15,9 @@ void timer_tick();
 void timer_write(u16 address, u8 value);
 u8 timer_read(u16 address);
 
-timer_context *timer_get_context();
\ No newline at end of file
+timer_context *timer_get_context();
+
+//スナップショット用(mem.h)
+u32 timer_state_size();
+void timer_save_state(void *dst);
+void timer_load_state(const void *src);
\ No newline at end of file
@@ -1,10 +1,25 @@
 #pragma once
 
 #include <common.h>
+#include <scaler.h>
 
 static const int SCREEN_WIDTH = 640;
 static const int SCREEN_HEIGHT = 578;
 
+//ui_init()より前に呼ぶ
+void ui_set_scaler(scaler_type type, int factor);
+
+//F2のデバッグ表示(VRAM/BGマップ/OAM)を更新する頻度
+void ui_set_debug_rate(u32 hz);
+
 void ui_init();
 void ui_handle_events();
+
+//イベントが来るまで最大timeout_ms待ってから、溜まっているイベントを全て処理する
+//フレームが公開されるとPPU側からイベントが送られてくる
+void ui_wait_events(u32 timeout_ms);
+
+//ui_wait_events()に渡す待ち時間。デバッグ表示を開いている間は、フレームが公開されない
+//(一時停止中やLCDオフ)ときでも--debug-view-rateで更新できるように短くする
+u32 ui_wait_timeout();
 void ui_update();
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <common.h>
+
+//PPUのフレームバッファは1ピクセル1バイト
+//bit0-1: シェード(0=白 - 3=黒), bit2-3: パレット(0=BGP, 1=OBP0, 2=OBP1)
+#define VIDEO_PIXEL(shade, palette) ((shade) | ((palette) << 2))
+#define VIDEO_COLORS 16
+
+typedef enum {
+    VIDEO_ARGB8888,
+    VIDEO_RGB565,
+    VIDEO_GRAY8
+} video_format;
+
+//16エントリ(パレット×シェード)のARGBカラーを設定。NULLの場合は既定のグレー4階調
+void video_set_colors(const u32 *colors);
+
+//"RRGGBB,RRGGBB,..."形式。4色(全パレット共通)か12色(BGP/OBP0/OBP1の順)
+bool video_parse_colors(const char *spec);
+
+//フレームバッファの1ラインをfmtに変換
+void video_convert(const u8 *src, void *dst, int count, video_format fmt);
+
+//XRES×YRESのフレームを変換。pitchは出力1ラインのバイト数
+void video_convert_frame(const u8 *src, void *dst, int pitch, video_format fmt);
+
+int video_bytes_per_pixel(video_format fmt);
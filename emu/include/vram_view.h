@@ -0,0 +1,41 @@
+#pragma once
+
+#include <common.h>
+#include <lcd.h>
+
+//デバッグ表示(タイルデータ、BGマップ2枚、OAM)
+//UIスレッドがvram_view_request()で頼むと、CPUスレッドが次のVBLANKの開始時にVRAM/OAM/LCDレジスタを
+//スナップショットにコピーする。LCDオフ中はフレームの区切りで、一時停止中はすぐにコピーする。描画はUIスレッドがスナップショットから行うので、エミュレーションへの
+//影響は頼んだ回数だけのmemcpyで済む
+typedef struct {
+    u8 vram[0x2000];
+    u8 oam[0xA0];
+    lcd_context lcd;
+    u32 frame;
+} vram_snapshot;
+
+//表示の配置。左からタイルデータ(16×24タイル)、0x9800、0x9C00、OAM(8×5スプライト)
+#define VRAM_VIEW_GAP 8
+#define VRAM_VIEW_TILES_X 0
+#define VRAM_VIEW_TILES_W (16 * 8)
+#define VRAM_VIEW_MAP0_X (VRAM_VIEW_TILES_X + VRAM_VIEW_TILES_W + VRAM_VIEW_GAP)
+#define VRAM_VIEW_MAP1_X (VRAM_VIEW_MAP0_X + 256 + VRAM_VIEW_GAP)
+#define VRAM_VIEW_OAM_X (VRAM_VIEW_MAP1_X + 256 + VRAM_VIEW_GAP)
+#define VRAM_VIEW_OAM_CELL_W 12
+#define VRAM_VIEW_OAM_CELL_H 20
+#define VRAM_VIEW_W (VRAM_VIEW_OAM_X + (8 * VRAM_VIEW_OAM_CELL_W))
+#define VRAM_VIEW_H 256
+
+//次のVBLANKでスナップショットを取る。一時停止中なら止まっているCPUスレッドを起こして取る(UIスレッド)
+void vram_view_request();
+
+//VBLANKの開始時(LCDオフ中はフレームの区切り)と一時停止中に呼ぶ。頼まれていなければ何もしない(CPUスレッド)
+void vram_view_capture();
+
+//新しいスナップショットがあればoutにコピーしてtrue(UIスレッド)
+bool vram_view_take(vram_snapshot *out);
+
+//スナップショットをVRAM_VIEW_W×VRAM_VIEW_Hの1ピクセル1バイト(video.h)の画像にする
+//BGマップは前回から変わったマスだけ展開し直す(UIスレッド)
+//表示するときはvideo_convert()で色に変換する
+void vram_view_render(const vram_snapshot *snap, u8 *out);
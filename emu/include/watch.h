@@ -0,0 +1,34 @@
+#pragma once
+
+#include <common.h>
+
+typedef enum {
+    WATCH_READ = (1 << 0),
+    WATCH_WRITE = (1 << 1),
+    WATCH_EXEC = (1 << 2),
+} watch_type;
+
+typedef struct {
+    bool active;
+    u8 type;
+    u16 start;
+    u16 end;
+    bool has_value;
+    u8 value;
+} watchpoint;
+
+#define MAX_WATCHPOINTS 32
+
+//実行ブレークポイントが1つでも有効な場合のみtrue。cpu_step()はこれだけを見る
+extern bool watch_exec_armed;
+
+int watch_add(u8 type, u16 start, u16 end, bool has_value, u8 value);
+void watch_remove(int id);
+void watch_clear();
+
+//"[r|w|rw|x]:START[-END][=VALUE]" 形式(16進)の指定を解析して追加する
+bool watch_parse(const char *spec);
+
+void watch_on_read(u16 address, u8 value);
+void watch_on_write(u16 address, u8 value);
+bool watch_check_exec(u16 pc);
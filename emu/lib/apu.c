@@ -1,5 +1,6 @@
 #include <apu.h>
 #include <SDL2/SDL.h>
+#include <string.h>
 
 // ============================================================================
 // チャンネル共通構造体
@@ -101,8 +102,15 @@ typedef struct {
     u8 nr50;                    // マスターボリューム
     u8 nr51;                    // パンニング
     
+    // 精度モード (apu_set_quality / apu_set_batch)
+    apu_quality quality;
+    bool batch;
+    u32 pending;                // バッチモードでまだ進めていないT-cycle数
+    
     // オーディオ出力
     u32 sample_timer;           // ダウンサンプリング用
+    u32 level_sum[4];           // サンプル周期内の各チャンネル出力の合計(APU_QUALITY_HIGH)
+    u32 level_ticks;            // level_sumに足したT-cycle数
     int16_t *audio_buffer;
     u32 buffer_position;
     u32 buffer_size;
@@ -562,7 +570,74 @@ static void write_channel3(u16 address, u8 value) {
 // APU初期化
 // ============================================================================
 void apu_init() {
-    // TODO: 全レジスタをデフォルト値に初期化
+    // 全レジスタとチャンネルの状態をリセットする
+    // オーディオバッファと精度モードはそのまま残す
+    apu_context saved = ctx;
+    
+    memset(&ctx, 0, sizeof(ctx));
+    memset(registers, 0, sizeof(registers));
+    
+    ctx.quality = saved.quality;
+    ctx.batch = saved.batch;
+    ctx.audio_buffer = saved.audio_buffer;
+    ctx.buffer_size = saved.buffer_size;
+}
+
+// ============================================================================
+// スナップショット
+// 保存する前にバッチモードで溜まっているT-cycleを処理する
+// ============================================================================
+u32 apu_state_size() {
+    return sizeof(ctx) + sizeof(registers);
+}
+
+void apu_save_state(void *dst) {
+    apu_flush();
+    memcpy(dst, &ctx, sizeof(ctx));
+    memcpy((u8 *)dst + sizeof(ctx), registers, sizeof(registers));
+}
+
+void apu_load_state(const void *src) {
+    apu_context saved = ctx;
+    
+    memcpy(&ctx, src, sizeof(ctx));
+    memcpy(registers, (const u8 *)src + sizeof(ctx), sizeof(registers));
+    
+    ctx.quality = saved.quality;
+    ctx.batch = saved.batch;
+    ctx.pending = 0;
+    ctx.sample_timer = saved.sample_timer;
+    memcpy(ctx.level_sum, saved.level_sum, sizeof(ctx.level_sum));
+    ctx.level_ticks = saved.level_ticks;
+    ctx.audio_buffer = saved.audio_buffer;
+    ctx.buffer_position = saved.buffer_position;
+    ctx.buffer_size = saved.buffer_size;
+}
+
+// ============================================================================
+// 精度モードの切り替え
+// バッチモードを切り替える前に溜まっているT-cycleを処理する
+// ============================================================================
+void apu_set_quality(apu_quality quality) {
+    ctx.quality = quality;
+}
+
+apu_quality apu_get_quality() {
+    return ctx.quality;
+}
+
+void apu_set_batch(bool batch) {
+    apu_flush();
+    ctx.batch = batch;
+}
+
+void apu_get_channel_outputs(u8 out[4]) {
+    apu_flush();
+    
+    out[0] = ctx.ch1.common.output;
+    out[1] = ctx.ch2.common.output;
+    out[2] = ctx.ch3.common.output;
+    out[3] = ctx.ch4.common.output;
 }
 
 // ============================================================================
@@ -707,32 +782,44 @@ static void clock_sweep() {
     }
 }
 
+// ============================================================================
+// タイマーをnT-cycle進める
+// 1T-cycle毎に「0より大きければデクリメントし、0になったら周期をリロード」するのと同じ結果になる
+// 周期が終わった(リロードした)回数を返す
+// ============================================================================
+static u32 advance_timer(u16 *timer, u16 period, u32 n) {
+    u32 t = *timer ? *timer : 1;
+    
+    if (n < t) {
+        *timer = t - n;
+        return 0;
+    }
+    
+    // 周期が0の場合は毎T-cycleリロードする
+    u32 p = period ? period : 1;
+    n -= t;
+    *timer = p - (n % p);
+    
+    return 1 + (n / p);
+}
+
 // ============================================================================
 // チャンネル1のティック処理（サンプル生成）
 // タイマーをデクリメントし、0に達したらデューティ位置を進める
 // 出力はデューティテーブルとボリュームに基づいて計算
 // Requirements: 3.7
 // ============================================================================
-static void tick_channel1() {
+static void tick_channel1(u32 cycles) {
     // チャンネルが無効の場合は出力を0にして終了
     if (!ctx.ch1.common.enabled) {
         ctx.ch1.common.output = 0;
         return;
     }
     
-    // タイマーをデクリメント
-    if (ctx.ch1.common.timer > 0) {
-        ctx.ch1.common.timer--;
-    }
-    
-    // タイマーが0に達したら
-    if (ctx.ch1.common.timer == 0) {
-        // タイマーをリロード: (2048 - frequency) * 4
-        ctx.ch1.common.timer = (2048 - ctx.ch1.common.frequency) * 4;
-        
-        // デューティ位置を進める（0-7で循環）
-        ctx.ch1.duty_position = (ctx.ch1.duty_position + 1) & 0x07;
-    }
+    // タイマーを進め、0に達した回数だけデューティ位置を進める（0-7で循環）
+    // タイマーのリロード値: (2048 - frequency) * 4
+    u32 steps = advance_timer(&ctx.ch1.common.timer, (2048 - ctx.ch1.common.frequency) * 4, cycles);
+    ctx.ch1.duty_position = (ctx.ch1.duty_position + steps) & 0x07;
     
     // 出力を計算: デューティテーブル値 * ボリューム
     // デューティテーブルは0または1を返すので、ボリューム（0-15）を乗じる
@@ -745,26 +832,17 @@ static void tick_channel1() {
 // 出力はデューティテーブルとボリュームに基づいて計算
 // Requirements: 4.6
 // ============================================================================
-static void tick_channel2() {
+static void tick_channel2(u32 cycles) {
     // チャンネルが無効の場合は出力を0にして終了
     if (!ctx.ch2.common.enabled) {
         ctx.ch2.common.output = 0;
         return;
     }
     
-    // タイマーをデクリメント
-    if (ctx.ch2.common.timer > 0) {
-        ctx.ch2.common.timer--;
-    }
-    
-    // タイマーが0に達したら
-    if (ctx.ch2.common.timer == 0) {
-        // タイマーをリロード: (2048 - frequency) * 4
-        ctx.ch2.common.timer = (2048 - ctx.ch2.common.frequency) * 4;
-        
-        // デューティ位置を進める（0-7で循環）
-        ctx.ch2.duty_position = (ctx.ch2.duty_position + 1) & 0x07;
-    }
+    // タイマーを進め、0に達した回数だけデューティ位置を進める（0-7で循環）
+    // タイマーのリロード値: (2048 - frequency) * 4
+    u32 steps = advance_timer(&ctx.ch2.common.timer, (2048 - ctx.ch2.common.frequency) * 4, cycles);
+    ctx.ch2.duty_position = (ctx.ch2.duty_position + steps) & 0x07;
     
     // 出力を計算: デューティテーブル値 * ボリューム
     // デューティテーブルは0または1を返すので、ボリューム（0-15）を乗じる
@@ -777,27 +855,18 @@ static void tick_channel2() {
 // 出力はWave RAMサンプルとボリュームシフトに基づいて計算
 // Requirements: 5.7
 // ============================================================================
-static void tick_channel3() {
+static void tick_channel3(u32 cycles) {
     // チャンネルが無効の場合は出力を0にして終了
     if (!ctx.ch3.common.enabled) {
         ctx.ch3.common.output = 0;
         return;
     }
     
-    // タイマーをデクリメント
-    if (ctx.ch3.common.timer > 0) {
-        ctx.ch3.common.timer--;
-    }
-    
-    // タイマーが0に達したら
-    if (ctx.ch3.common.timer == 0) {
-        // タイマーをリロード: (2048 - frequency) * 2
-        // 注: 波形チャンネルは *2（チャンネル1,2は *4）
-        ctx.ch3.common.timer = (2048 - ctx.ch3.common.frequency) * 2;
-        
-        // 波形位置を進める（0-31で循環）
-        ctx.ch3.wave_position = (ctx.ch3.wave_position + 1) & 0x1F;
-    }
+    // タイマーを進め、0に達した回数だけ波形位置を進める（0-31で循環）
+    // タイマーのリロード値: (2048 - frequency) * 2
+    // 注: 波形チャンネルは *2（チャンネル1,2は *4）
+    u32 steps = advance_timer(&ctx.ch3.common.timer, (2048 - ctx.ch3.common.frequency) * 2, cycles);
+    ctx.ch3.wave_position = (ctx.ch3.wave_position + steps) & 0x1F;
     
     // Wave RAMからサンプルを読み取る
     // wave_ram[16]には32個の4ビットサンプルがパックされている
@@ -821,6 +890,7 @@ static void tick_channel3() {
 // ============================================================================
 // チャンネルミキシング処理
 // NR51に基づく左右パンニングとNR50に基づくマスターボリュームを適用
+// levelは各チャンネルの出力をticks T-cycle分足したもの（点サンプリングの場合はticks=1）
 // Requirements: 10.1, 10.2, 10.3, 10.4
 // 
 // NR50 (0xFF24) - マスターボリューム:
@@ -839,7 +909,7 @@ static void tick_channel3() {
 //   ビット1: CH2を右に出力
 //   ビット0: CH1を右に出力
 // ============================================================================
-static void mix_channels(int16_t *left, int16_t *right) {
+static void mix_channels(const u32 level[4], u32 ticks, int16_t *left, int16_t *right) {
     // 左右のアキュムレータを初期化
     int32_t left_acc = 0;
     int32_t right_acc = 0;
@@ -847,34 +917,34 @@ static void mix_channels(int16_t *left, int16_t *right) {
     // チャンネル1のミキシング
     // Requirements: 10.3
     if (ctx.nr51 & 0x10) {  // ビット4: CH1を左に
-        left_acc += ctx.ch1.common.output;
+        left_acc += level[0];
     }
     if (ctx.nr51 & 0x01) {  // ビット0: CH1を右に
-        right_acc += ctx.ch1.common.output;
+        right_acc += level[0];
     }
     
     // チャンネル2のミキシング
     if (ctx.nr51 & 0x20) {  // ビット5: CH2を左に
-        left_acc += ctx.ch2.common.output;
+        left_acc += level[1];
     }
     if (ctx.nr51 & 0x02) {  // ビット1: CH2を右に
-        right_acc += ctx.ch2.common.output;
+        right_acc += level[1];
     }
     
     // チャンネル3のミキシング
     if (ctx.nr51 & 0x40) {  // ビット6: CH3を左に
-        left_acc += ctx.ch3.common.output;
+        left_acc += level[2];
     }
     if (ctx.nr51 & 0x04) {  // ビット2: CH3を右に
-        right_acc += ctx.ch3.common.output;
+        right_acc += level[2];
     }
     
     // チャンネル4のミキシング
     if (ctx.nr51 & 0x80) {  // ビット7: CH4を左に
-        left_acc += ctx.ch4.common.output;
+        left_acc += level[3];
     }
     if (ctx.nr51 & 0x08) {  // ビット3: CH4を右に
-        right_acc += ctx.ch4.common.output;
+        right_acc += level[3];
     }
     
     // マスターボリュームを取得
@@ -895,8 +965,9 @@ static void mix_channels(int16_t *left, int16_t *right) {
     // 16ビット符号付きの範囲は -32768 to 32767
     // スケール係数: 32767 / 480 ≈ 68
     // 簡略化のため64（2^6）を使用
-    left_acc *= 64;
-    right_acc *= 64;
+    // levelはticks T-cycle分の合計なので平均に戻す
+    left_acc = left_acc * 64 / (int32_t)ticks;
+    right_acc = right_acc * 64 / (int32_t)ticks;
     
     // 出力を設定
     *left = (int16_t)left_acc;
@@ -909,24 +980,18 @@ static void mix_channels(int16_t *left, int16_t *right) {
 // 出力はLFSRビット0の反転値とボリュームに基づいて計算
 // Requirements: 6.6
 // ============================================================================
-static void tick_channel4() {
+static void tick_channel4(u32 cycles) {
     // チャンネルが無効の場合は出力を0にして終了
     if (!ctx.ch4.common.enabled) {
         ctx.ch4.common.output = 0;
         return;
     }
     
-    // タイマーをデクリメント
-    if (ctx.ch4.common.timer > 0) {
-        ctx.ch4.common.timer--;
-    }
+    // タイマーを進め、0に達した回数だけLFSRをクロック
+    // タイマーのリロード値: divisor_table[divisor_code] << clock_shift
+    u32 steps = advance_timer(&ctx.ch4.common.timer, divisor_table[ctx.ch4.divisor_code] << ctx.ch4.clock_shift, cycles);
     
-    // タイマーが0に達したら
-    if (ctx.ch4.common.timer == 0) {
-        // タイマーをリロード: divisor_table[divisor_code] << clock_shift
-        ctx.ch4.common.timer = divisor_table[ctx.ch4.divisor_code] << ctx.ch4.clock_shift;
-        
-        // LFSRをクロック
+    while (steps--) {
         clock_lfsr();
     }
     
@@ -941,14 +1006,14 @@ static void tick_channel4() {
 // ステップは0-7で循環する
 // Requirements: 2.1, 2.5
 // ============================================================================
-static void frame_sequencer_tick() {
-    // タイマーをインクリメント
-    ctx.frame_sequencer_timer++;
+static void frame_sequencer_tick(u32 cycles) {
+    // タイマーを進める（cyclesは8192より小さい）
+    ctx.frame_sequencer_timer += cycles;
     
     // 8192 T-cycleに達したらステップを進める
     if (ctx.frame_sequencer_timer >= 8192) {
-        // タイマーをリセット
-        ctx.frame_sequencer_timer = 0;
+        // タイマーをリセット（超えた分は次のステップに持ち越す）
+        ctx.frame_sequencer_timer -= 8192;
         
         // ステップを進める（0-7で循環）
         ctx.frame_sequencer_step = (ctx.frame_sequencer_step + 1) % 8;
@@ -973,8 +1038,107 @@ static void frame_sequencer_tick() {
     }
 }
 
+// ============================================================================
+// 各ユニットをcycles T-cycle進める
+// ============================================================================
+static void step_units(u32 cycles) {
+    // フレームシーケンサーを更新
+    frame_sequencer_tick(cycles);
+    
+    // チャンネル1-4のティック処理
+    tick_channel1(cycles);
+    tick_channel2(cycles);
+    tick_channel3(cycles);
+    tick_channel4(cycles);
+    
+    // APU_QUALITY_HIGHではサンプル周期内の出力を平均する（ボックスフィルタ）
+    if (ctx.quality == APU_QUALITY_HIGH) {
+        ctx.level_sum[0] += ctx.ch1.common.output * cycles;
+        ctx.level_sum[1] += ctx.ch2.common.output * cycles;
+        ctx.level_sum[2] += ctx.ch3.common.output * cycles;
+        ctx.level_sum[3] += ctx.ch4.common.output * cycles;
+        ctx.level_ticks += cycles;
+    }
+    
+    ctx.sample_timer += cycles;
+}
+
+// ============================================================================
+// サンプル生成とバッファリング
+// Requirements: 10.5, 10.6, 11.3
+// ダウンサンプリング: 4.194304 MHz → 44100 Hz
+// SAMPLE_PERIOD T-cycleごとにサンプルを生成
+// ============================================================================
+static void emit_sample() {
+    u32 level[4] = {
+        ctx.ch1.common.output, ctx.ch2.common.output,
+        ctx.ch3.common.output, ctx.ch4.common.output
+    };
+    u32 ticks = 1;
+    
+    if (ctx.quality == APU_QUALITY_HIGH && ctx.level_ticks) {
+        memcpy(level, ctx.level_sum, sizeof(level));
+        ticks = ctx.level_ticks;
+    }
+    
+    // タイマーと合計をリセット
+    ctx.sample_timer = 0;
+    memset(ctx.level_sum, 0, sizeof(ctx.level_sum));
+    ctx.level_ticks = 0;
+    
+    // オーディオバッファが確保されていない場合はスキップ
+    if (ctx.audio_buffer == NULL) {
+        return;
+    }
+    
+    // チャンネルをミキシングして左右サンプルを取得
+    int16_t left_sample, right_sample;
+    mix_channels(level, ticks, &left_sample, &right_sample);
+    
+    // サンプルをバッファに格納（インターリーブ形式: L, R, L, R, ...）
+    ctx.audio_buffer[ctx.buffer_position] = left_sample;
+    ctx.audio_buffer[ctx.buffer_position + 1] = right_sample;
+    ctx.buffer_position += 2;
+    
+    // バッファが満杯になったらSDL2に送信
+    // Requirements: 10.5, 11.3
+    if (ctx.buffer_position >= ctx.buffer_size * 2) {
+        // SDL_QueueAudioでバッファを送信
+        if (audio_device_id != 0) {
+            SDL_QueueAudio(
+                audio_device_id,
+                ctx.audio_buffer,
+                ctx.buffer_size * 2 * sizeof(int16_t)
+            );
+        }
+        
+        // バッファ位置をリセット
+        ctx.buffer_position = 0;
+    }
+}
+
+// ============================================================================
+// バッチモードで溜まっているT-cycleをまとめて処理する
+// レジスタアクセスの前に呼び、アクセスの順序を保つ
+// ============================================================================
+void apu_flush() {
+    u32 cycles = ctx.pending;
+    
+    if (!cycles) {
+        return;
+    }
+    
+    ctx.pending = 0;
+    step_units(cycles);
+    
+    if (ctx.sample_timer >= SAMPLE_PERIOD) {
+        emit_sample();
+    }
+}
+
 // ============================================================================
 // T-cycle単位でAPUを進める
+// バッチモードではサンプル周期分が溜まるまで数えるだけにして、まとめて進める
 // Requirements: 1.2, 1.3, 10.5, 10.6, 11.3
 // ============================================================================
 void apu_tick() {
@@ -983,65 +1147,19 @@ void apu_tick() {
         return;
     }
     
-    // フレームシーケンサーを更新
-    frame_sequencer_tick();
-    
-    // チャンネル1のティック処理
-    tick_channel1();
-    
-    // チャンネル2のティック処理
-    tick_channel2();
-    
-    // チャンネル3のティック処理
-    tick_channel3();
-    
-    // チャンネル4のティック処理
-    tick_channel4();
-    
-    // ============================================================================
-    // サンプル生成とバッファリング
-    // Requirements: 10.5, 10.6, 11.3
-    // ダウンサンプリング: 4.194304 MHz → 44100 Hz
-    // SAMPLE_PERIOD T-cycleごとにサンプルを生成
-    // ============================================================================
+    if (ctx.batch) {
+        if (++ctx.pending + ctx.sample_timer >= SAMPLE_PERIOD) {
+            apu_flush();
+        }
+        
+        return;
+    }
     
-    // サンプルタイマーをインクリメント
-    ctx.sample_timer++;
+    step_units(1);
     
     // サンプル生成タイミングに達したら
     if (ctx.sample_timer >= SAMPLE_PERIOD) {
-        // タイマーをリセット
-        ctx.sample_timer = 0;
-        
-        // オーディオバッファが確保されていない場合はスキップ
-        if (ctx.audio_buffer == NULL) {
-            return;
-        }
-        
-        // チャンネルをミキシングして左右サンプルを取得
-        int16_t left_sample, right_sample;
-        mix_channels(&left_sample, &right_sample);
-        
-        // サンプルをバッファに格納（インターリーブ形式: L, R, L, R, ...）
-        ctx.audio_buffer[ctx.buffer_position] = left_sample;
-        ctx.audio_buffer[ctx.buffer_position + 1] = right_sample;
-        ctx.buffer_position += 2;
-        
-        // バッファが満杯になったらSDL2に送信
-        // Requirements: 10.5, 11.3
-        if (ctx.buffer_position >= ctx.buffer_size * 2) {
-            // SDL_QueueAudioでバッファを送信
-            if (audio_device_id != 0) {
-                SDL_QueueAudio(
-                    audio_device_id,
-                    ctx.audio_buffer,
-                    ctx.buffer_size * 2 * sizeof(int16_t)
-                );
-            }
-            
-            // バッファ位置をリセット
-            ctx.buffer_position = 0;
-        }
+        emit_sample();
     }
 }
 
@@ -1049,6 +1167,8 @@ void apu_tick() {
 // レジスタ読み取り
 // ============================================================================
 u8 apu_read(u16 address) {
+    apu_flush();
+    
     // Wave RAM (0xFF30-0xFF3F)
     if (address >= 0xFF30 && address <= 0xFF3F) {
         return ctx.ch3.wave_ram[address - 0xFF30];
@@ -1097,6 +1217,8 @@ u8 apu_read(u16 address) {
 // レジスタ書き込み
 // ============================================================================
 void apu_write(u16 address, u8 value) {
+    apu_flush();
+    
     // Wave RAM (0xFF30-0xFF3F)
     if (address >= 0xFF30 && address <= 0xFF3F) {
         ctx.ch3.wave_ram[address - 0xFF30] = value;
@@ -1259,3 +1381,16 @@ void apu_audio_shutdown() {
     ctx.buffer_position = 0;
     ctx.buffer_size = 0;
 }
+
+// ============================================================================
+// キューの長さ(ms)
+// HUDの表示用。SDL_GetQueuedAudioSizeはどのスレッドから呼んでも良い
+// ============================================================================
+u32 apu_audio_queued_ms() {
+    if (audio_device_id == 0) {
+        return 0;
+    }
+    
+    // 16ビットステレオ: 1サンプル4バイト
+    return SDL_GetQueuedAudioSize(audio_device_id) / 4 * 1000 / APU_SAMPLE_RATE;
+}
@@ -0,0 +1,70 @@
+#include <bg_layer.h>
+#include <string.h>
+
+static bg_layer layers[2];
+
+bg_layer *bg_layer_get(int map) {
+    return &layers[map];
+}
+
+void bg_layer_init(bg_layer *layer) {
+    memset(layer->cell_tile, 0xFF, sizeof(layer->cell_tile));
+}
+
+static void update_cell(bg_layer *layer, tile_cache *tc, const u8 *vram, u16 map_offset, int cx, int cy) {
+    u8 id = vram[map_offset + (cy * 32) + cx];
+
+    //タイルデータ領域が0x8800の場合はタイルIDを符号付きとして扱う(0x9000が0番)
+    u16 tile = layer->data_8000 ? id : (u16)(128 + (u8)(id + 128));
+
+    if (layer->cell_tile[cy][cx] == tile && layer->cell_version[cy][cx] == tc->version[tile]) {
+        return;
+    }
+
+    for (int y=0; y<8; y++) {
+        memcpy(&layer->pixels[(cy * 8) + y][cx * 8], tile_cache_row(tc, vram, tile, y, false), 8);
+    }
+
+    layer->cell_tile[cy][cx] = tile;
+    layer->cell_version[cy][cx] = tc->version[tile];
+}
+
+static void check_data_area(bg_layer *layer, bool data_8000) {
+    if (layer->data_8000 != data_8000) {
+        layer->data_8000 = data_8000;
+        bg_layer_init(layer);
+    }
+}
+
+const u8 *bg_layer_row(bg_layer *layer, tile_cache *tc, const u8 *vram, u16 map_offset,
+        bool data_8000, u8 y, u8 cell_x, int count) {
+    check_data_area(layer, data_8000);
+
+    for (int i=0; i<count; i++) {
+        update_cell(layer, tc, vram, map_offset, (cell_x + i) & 31, y / 8);
+    }
+
+    return layer->pixels[y];
+}
+
+void bg_layer_update_all(bg_layer *layer, tile_cache *tc, const u8 *vram, u16 map_offset, bool data_8000) {
+    check_data_area(layer, data_8000);
+
+    for (int cy=0; cy<32; cy++) {
+        for (int cx=0; cx<32; cx++) {
+            update_cell(layer, tc, vram, map_offset, cx, cy);
+        }
+    }
+}
+
+void bg_layer_copy_row(const u8 *row, u8 x, u8 *out, int count) {
+    int first = 256 - x;
+
+    if (count <= first) {
+        memcpy(out, row + x, count);
+        return;
+    }
+
+    memcpy(out, row + x, first);
+    memcpy(out + first, row, count - first);
+}
@@ -5,33 +5,45 @@
 #include <io.h>
 #include <ppu.h>
 #include <dma.h>
+#include <watch.h>
+#include <cheat.h>
 
-u8 bus_read(u16 address) {
-    if(address < 0x8000) {
-        //ROM Data
-        return cart_read(address);
-    } else if(address < 0xA000) {
-        //Char/Map Data
-        return ppu_vram_read(address);
-    } else if (address < 0xC000) {
-        //Cartridge RAM
-        return cart_read(address);
-    } else if (address < 0xE000) {
-        //WRAM
-        return wram_read(address);
-    } else if (address < 0xFE00) {
-        //Echo RAM
-        return 0;
-    } else if (address < 0xFEA0) {
+static u8 echo_read(u16 address) {
+    //Echo RAM
+    return 0;
+}
+
+static void echo_write(u16 address, u8 value) {
+    //Echo RAM
+}
+
+static u8 oam_page_read(u16 address) {
+    if (address < 0xFEA0) {
         //OAM 
         if (dma_transferring()) {
             return 0xFF;
         }
         return ppu_oam_read(address);
-    } else if (address < 0xFF00) {
-        //Unusable area
-        return 0;
-    } else if (address < 0xFF80) {
+    }
+
+    //Unusable area
+    return 0;
+}
+
+static void oam_page_write(u16 address, u8 value) {
+    if (address < 0xFEA0) {
+        //OAM
+        if(dma_transferring()){
+            return;
+        }
+        ppu_oam_write(address, value);
+    }
+
+    //Unusable area
+}
+
+static u8 high_page_read(u16 address) {
+    if (address < 0xFF80) {
         //IO Registers
         return io_read(address);       
     } else if (address == 0xFFFF) {
@@ -41,30 +53,8 @@ u8 bus_read(u16 address) {
     return hram_read(address);
 }
 
-void bus_write(u16 address, u8 value){
-    if(address < 0x8000) {
-        //ROM Data
-        cart_write(address, value);
-    } else if (address < 0xA000) {
-        //Char/Map Data
-        ppu_vram_write(address, value);
-    } else if (address < 0xC000) {
-        //Cartridge RAM
-        cart_write(address, value); 
-    } else if (address < 0xE000) {
-        //WRAM
-        wram_write(address, value);
-    } else if (address < 0xFE00) {
-        //Echo RAM
-    } else if (address < 0xFEA0) {
-        //OAM
-        if(dma_transferring()){
-            return;
-        }
-        ppu_oam_write(address, value);
-    } else if (address < 0xFF00) {
-        //Unusable area
-    } else if (address < 0xFF80) {
+static void high_page_write(u16 address, u8 value) {
+    if (address < 0xFF80) {
         //IO Registers
         io_write(address, value);
     } else if (address == 0xFFFF) {
@@ -75,6 +65,94 @@ void bus_write(u16 address, u8 value){
     }
 }
 
+//デフォルトのデバイスマップ
+#define DEFAULT_READ_MAP { \
+    [0x00 ... 0x7F] = cart_read,      /* ROM Data */ \
+    [0x80 ... 0x9F] = ppu_vram_read,  /* Char/Map Data */ \
+    [0xA0 ... 0xBF] = cart_read,      /* Cartridge RAM */ \
+    [0xC0 ... 0xDF] = wram_read,      /* WRAM */ \
+    [0xE0 ... 0xFD] = echo_read,      /* Echo RAM */ \
+    [0xFE] = oam_page_read,           /* OAM / Unusable area */ \
+    [0xFF] = high_page_read,          /* IO / HRAM / IE */ \
+}
+
+#define DEFAULT_WRITE_MAP { \
+    [0x00 ... 0x7F] = cart_write, \
+    [0x80 ... 0x9F] = ppu_vram_write, \
+    [0xA0 ... 0xBF] = cart_write, \
+    [0xC0 ... 0xDF] = wram_write, \
+    [0xE0 ... 0xFD] = echo_write, \
+    [0xFE] = oam_page_write, \
+    [0xFF] = high_page_write, \
+}
+
+static const bus_read_fn default_read_map[0x100] = DEFAULT_READ_MAP;
+static const bus_write_fn default_write_map[0x100] = DEFAULT_WRITE_MAP;
+
+//アドレス上位8bitで引くページテーブル。
+//通常はデバイスのハンドラを直接指し、ウォッチポイント等が設定されたページだけ
+//bus_read_hooked/bus_write_hookedに差し替える
+static bus_read_fn read_map[0x100] = DEFAULT_READ_MAP;
+static bus_write_fn write_map[0x100] = DEFAULT_WRITE_MAP;
+static u8 page_hooks[0x100];
+
+u8 bus_read_raw(u16 address) {
+    return default_read_map[address >> 8](address);
+}
+
+static u8 bus_read_hooked(u16 address) {
+    u8 page = address >> 8;
+    u8 value = default_read_map[page](address);
+
+    if (page_hooks[page] & BUS_HOOK_CHEAT) {
+        value = cheat_filter_read(address, value);
+    }
+
+    if (page_hooks[page] & BUS_HOOK_WATCH) {
+        watch_on_read(address, value);
+    }
+
+    return value;
+}
+
+static void bus_write_hooked(u16 address, u8 value) {
+    u8 page = address >> 8;
+
+    if (page_hooks[page] & BUS_HOOK_WATCH) {
+        watch_on_write(address, value);
+    }
+
+    default_write_map[page](address, value);
+}
+
+static void bus_update_page(u8 page) {
+    if (page_hooks[page]) {
+        read_map[page] = bus_read_hooked;
+        write_map[page] = bus_write_hooked;
+    } else {
+        read_map[page] = default_read_map[page];
+        write_map[page] = default_write_map[page];
+    }
+}
+
+void bus_set_page_hook(u8 page, bus_hook hook, bool on) {
+    if (on) {
+        page_hooks[page] |= hook;
+    } else {
+        page_hooks[page] &= ~hook;
+    }
+
+    bus_update_page(page);
+}
+
+u8 bus_read(u16 address) {
+    return read_map[address >> 8](address);
+}
+
+void bus_write(u16 address, u8 value) {
+    write_map[address >> 8](address, value);
+}
+
 u16 bus_read16(u16 address) {
     u16 lo = bus_read(address);
     u16 hi = bus_read(address + 1);
@@ -1,6 +1,15 @@
 #include <cart.h>
+#include <mem.h>
+#include <patch.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 typedef struct {
     char filename[1024];
     u32 rom_size;
@@ -25,6 +34,16 @@ typedef struct {
 
 static cart_context ctx;
 
+//スナップショットに入れるバンクの選択状態
+typedef struct {
+    bool ram_enabled;
+    bool ram_banking;
+    u8 banking_mode;
+    u8 rom_bank_value;
+    u8 ram_bank_value;
+    u8 ram_bank_index;      //ram_bankが指しているram_banksの番号。RAMが無ければ0xFF
+} cart_state;
+
 bool cart_need_save() {
     return ctx.need_save;
 }
@@ -146,13 +165,64 @@ const char *cart_lic_name() {
     return "UNKNOWN";
 }
 
-const char *cart_type_name() {
-    if(ctx.header->type <= 0x22) {
-        return ROM_TYPES[ctx.header->type];
+const char *cart_type_str(u8 type) {
+    if(type <= 0x22) {
+        return ROM_TYPES[type];
     }
     return "UNKNOWN";
 }
 
+const char *cart_type_name() {
+    return cart_type_str(ctx.header->type);
+}
+
+cart_mapper cart_mapper_of(u8 type) {
+    switch(type) {
+        case 0x00: case 0x08: case 0x09:
+            return MAPPER_NONE;
+        case 0x01: case 0x02: case 0x03:
+            return MAPPER_MBC1;
+        case 0x05: case 0x06:
+            return MAPPER_MBC2;
+        case 0x0B: case 0x0C: case 0x0D:
+            return MAPPER_MMM01;
+        case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13:
+            return MAPPER_MBC3;
+        case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+            return MAPPER_MBC5;
+        case 0x20:
+            return MAPPER_MBC6;
+        case 0x22:
+            return MAPPER_MBC7;
+    }
+    return MAPPER_OTHER;
+}
+
+const char *cart_mapper_name(cart_mapper mapper) {
+    static const char *names[] = {
+        "NONE", "MBC1", "MBC2", "MMM01", "MBC3", "MBC5", "MBC6", "MBC7", "OTHER"
+    };
+    return names[mapper];
+}
+
+u8 cart_header_checksum(const u8 *rom) {
+    u8 x = 0;
+    for (u16 i=0x0134; i<=0x014C; i++) {
+        x = x - rom[i] - 1;
+    }
+    return x;
+}
+
+u16 cart_global_checksum(const u8 *rom, u32 size) {
+    u16 sum = 0;
+    for (u32 i=0; i<size; i++) {
+        if (i != 0x014E && i != 0x014F) {
+            sum += rom[i];
+        }
+    }
+    return sum;
+}
+
 void cart_setup_banking() {
     for(int i=0; i<16; i++) {
         ctx.ram_banks[i] = 0;
@@ -161,7 +231,7 @@ void cart_setup_banking() {
             (ctx.header->ram_size == 3 && i < 4) || 
             (ctx.header->ram_size == 4 && i < 16) || 
             (ctx.header->ram_size == 5 && i < 8)) {
-            ctx.ram_banks[i] = malloc(0x2000);
+            ctx.ram_banks[i] = gb_arena.cart_ram[i];
             memset(ctx.ram_banks[i], 0, 0x2000);
         }
     }
@@ -169,34 +239,102 @@ void cart_setup_banking() {
     ctx.rom_bank_x = ctx.rom_data + 0x4000;
 }
 
-bool cart_load(char *cart) {
+//ROMファイルをMAP_PRIVATEでマッピングする。
+//書き込んだページだけがコピーされるので、パッチ適用後も未変更のページは
+//同じROMを開いている他のプロセスとページキャッシュを共有できる
+static u8 *cart_map_file(const char *path, u32 *size, bool writable) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, st.st_size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+
+    *size = st.st_size;
+    return p;
+#else
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    rewind(fp);
+
+    u8 *p = malloc(*size);
+    fread(p, *size, 1, fp);
+    fclose(fp);
+    return p;
+#endif
+}
+
+static void cart_unmap_file(u8 *p, u32 size) {
+#ifndef _WIN32
+    munmap(p, size);
+#else
+    (void)size;
+    free(p);
+#endif
+}
+
+bool cart_load(char *cart, char *patch) {
     snprintf(ctx.filename,sizeof(ctx.filename),"%s", cart);
 
-    FILE *fp = fopen(cart,"r");
+    ctx.rom_data = cart_map_file(cart, &ctx.rom_size, true);
 
-    if(!fp) {
+    if(!ctx.rom_data) {
         printf("Failed to open: %s\n", cart);
         return false;
     }
 
     printf("Opened: %s\n", ctx.filename);
 
-    fseek(fp,0,SEEK_END);
-    ctx.rom_size = ftell(fp);
+    if (patch) {
+        //パッチは元イメージ(読み取り専用)から書き込み可能なイメージへ適用する
+        u32 source_size;
+        u8 *source = cart_map_file(cart, &source_size, false);
+        u8 *mapped = ctx.rom_data;
+        u32 mapped_size = ctx.rom_size;
 
-    rewind(fp);
+        if (!source) {
+            return false;
+        }
 
-    ctx.rom_data = malloc(ctx.rom_size);
-    fread(ctx.rom_data, ctx.rom_size,1,fp);
-    fclose(fp);
+        bool ok = patch_apply(patch, source, source_size, &ctx.rom_data, &ctx.rom_size);
+        cart_unmap_file(source, source_size);
+
+        //サイズが伸びてヒープにコピーされた場合は元のマッピングはもう使わない
+        if (ctx.rom_data != mapped) {
+            cart_unmap_file(mapped, mapped_size);
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
 
     ctx.header = (rom_header *)(ctx.rom_data + 0x100);
-    ctx.header->title[15] = 0;
     ctx.battery = cart_battery();
     ctx.need_save = false;
 
     printf("Cartridge Loaded:\n");
-    printf("\t Title    : %s\n", ctx.header->title);
+    printf("\t Title    : %.15s\n", ctx.header->title);
     printf("\t Type     : %2.2X (%s)\n", ctx.header->type, cart_type_name());
     printf("\t ROM Size : %d KB\n", 32 << ctx.header->rom_size);
     printf("\t RAM Size : %2.2X\n", ctx.header->ram_size);
@@ -205,10 +343,7 @@ bool cart_load(char *cart) {
 
     cart_setup_banking();
 
-    u16 x = 0;
-    for (u16 i=0x0134; i<=0x014C; i++) {
-        x = x - ctx.rom_data[i] - 1;
-    }
+    u8 x = cart_header_checksum(ctx.rom_data);
 
     printf("\t Checksum : %2.2X (%s)\n", ctx.header->checksum, (x & 0xFF) ? "PASSED" : "FAILED");
 
@@ -363,4 +498,45 @@ void cart_write(u16 address, u8 value) {
             ctx.need_save = true;
         }
     }
-}
\ No newline at end of file
+}
+
+u32 cart_state_size() {
+    return sizeof(cart_state);
+}
+
+void cart_save_state(void *dst) {
+    cart_state s = {
+        .ram_enabled = ctx.ram_enabled,
+        .ram_banking = ctx.ram_banking,
+        .banking_mode = ctx.banking_mode,
+        .rom_bank_value = ctx.rom_bank_value,
+        .ram_bank_value = ctx.ram_bank_value,
+        .ram_bank_index = 0xFF
+    };
+
+    for (int i=0; i<16; i++) {
+        if (ctx.ram_bank && ctx.ram_bank == ctx.ram_banks[i]) {
+            s.ram_bank_index = i;
+            break;
+        }
+    }
+
+    memcpy(dst, &s, sizeof(s));
+}
+
+//バンクのポインタは選択状態から作り直す
+void cart_load_state(const void *src) {
+    cart_state s;
+    memcpy(&s, src, sizeof(s));
+
+    ctx.ram_enabled = s.ram_enabled;
+    ctx.ram_banking = s.ram_banking;
+    ctx.banking_mode = s.banking_mode;
+    ctx.rom_bank_value = s.rom_bank_value;
+    ctx.ram_bank_value = s.ram_bank_value;
+    ctx.ram_bank = s.ram_bank_index < 16 ? ctx.ram_banks[s.ram_bank_index] : NULL;
+
+    if (ctx.rom_data) {
+        ctx.rom_bank_x = ctx.rom_data + (0x4000 * (ctx.rom_bank_value ? ctx.rom_bank_value : 1));
+    }
+}
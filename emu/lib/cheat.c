@@ -0,0 +1,185 @@
+#include <cheat.h>
+#include <bus.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdatomic.h>
+
+//Game GenieはROMページのバスハンドラだけを差し替えて適用し、
+//GameSharkはフレーム毎に1回書き込むので、通常のcart_read/wram_readには手を入れない
+
+static cheat cheats[MAX_CHEATS];
+static int cheat_count = 0;
+static bool cheats_enabled = true;
+
+//UIスレッドからのON/OFFの要求。ページテーブルはCPUスレッドが読んでいるので、
+//切り替えはcheat_apply_frame()でCPUスレッドが行う
+static _Atomic u8 toggle_request = 0;
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool cheat_parse(const char *code, cheat *out) {
+    int d[9];
+    int n = 0;
+    bool dashes = false;
+
+    for (const char *p = code; *p && !isspace((unsigned char)*p); p++) {
+        if (*p == '-') {
+            dashes = true;
+            continue;
+        }
+
+        if (n >= 9 || (d[n] = hex_digit(*p)) < 0) {
+            return false;
+        }
+        n++;
+    }
+
+    memset(out, 0, sizeof(cheat));
+    out->enabled = true;
+    snprintf(out->code, sizeof(out->code), "%.*s", (int)strcspn(code, " \t\r\n"), code);
+
+    if (dashes && (n == 6 || n == 9)) {
+        //Game Genie: ABC-DEF-GHI
+        //AB = 新しい値, FCDE = アドレス(FはF xor), GI = 比較値(右に2bit回転してBA xor)
+        out->type = CHEAT_GAME_GENIE;
+        out->value = (d[0] << 4) | d[1];
+        out->address = ((d[5] ^ 0xF) << 12) | (d[2] << 8) | (d[3] << 4) | d[4];
+
+        if (n == 9) {
+            u8 gi = (d[6] << 4) | d[8];
+            out->has_compare = true;
+            out->compare = (u8)((gi >> 2) | (gi << 6)) ^ 0xBA;
+        }
+
+        return out->address < 0x8000;
+    }
+
+    if (!dashes && n == 8) {
+        //GameShark: TTVVAAAA (アドレスはリトルエンディアン)
+        out->type = CHEAT_GAMESHARK;
+        out->value = (d[2] << 4) | d[3];
+        out->address = (d[6] << 12) | (d[7] << 8) | (d[4] << 4) | d[5];
+        return true;
+    }
+
+    return false;
+}
+
+static void cheat_update_hooks() {
+    bool pages[0x80] = {0};
+
+    for (int i=0; i<cheat_count; i++) {
+        if (cheats_enabled && cheats[i].enabled && cheats[i].type == CHEAT_GAME_GENIE) {
+            pages[cheats[i].address >> 8] = true;
+        }
+    }
+
+    for (int page = 0; page < 0x80; page++) {
+        bus_set_page_hook(page, BUS_HOOK_CHEAT, pages[page]);
+    }
+}
+
+int cheat_add(const char *code) {
+    if (cheat_count >= MAX_CHEATS) {
+        fprintf(stderr, "CHEAT: too many codes (max %d)\n", MAX_CHEATS);
+        return -1;
+    }
+
+    if (!cheat_parse(code, &cheats[cheat_count])) {
+        fprintf(stderr, "CHEAT: invalid code '%s'\n", code);
+        return -1;
+    }
+
+    cheat_update_hooks();
+    return cheat_count++;
+}
+
+bool cheat_load_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        fprintf(stderr, "FAILED TO OPEN: %s\n", path);
+        return false;
+    }
+
+    char line[256];
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line;
+
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+
+        //空行と#以降のコメントは無視
+        if (!*p || *p == '#') {
+            continue;
+        }
+
+        if (cheat_add(p) >= 0) {
+            printf("Cheat: %s\n", cheats[cheat_count - 1].code);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+void cheat_clear() {
+    cheat_count = 0;
+    cheat_update_hooks();
+}
+
+void cheat_set_enabled(int id, bool on) {
+    if (id < 0 || id >= cheat_count) {
+        return;
+    }
+
+    cheats[id].enabled = on;
+    cheat_update_hooks();
+}
+
+//2回押された場合は要求が打ち消し合う
+void cheat_toggle_all() {
+    atomic_fetch_xor(&toggle_request, 1);
+}
+
+void cheat_apply_frame() {
+    if (atomic_exchange(&toggle_request, 0)) {
+        cheats_enabled = !cheats_enabled;
+        printf("Cheats %s\n", cheats_enabled ? "ON" : "OFF");
+        cheat_update_hooks();
+    }
+
+    if (!cheats_enabled) {
+        return;
+    }
+
+    for (int i=0; i<cheat_count; i++) {
+        if (cheats[i].enabled && cheats[i].type == CHEAT_GAMESHARK) {
+            bus_write(cheats[i].address, cheats[i].value);
+        }
+    }
+}
+
+u8 cheat_filter_read(u16 address, u8 value) {
+    for (int i=0; i<cheat_count; i++) {
+        cheat *c = &cheats[i];
+
+        if (c->type != CHEAT_GAME_GENIE || !c->enabled || c->address != address) {
+            continue;
+        }
+
+        //比較値がある場合は元の値が一致するバンクだけ置き換える
+        if (!c->has_compare || c->compare == value) {
+            return c->value;
+        }
+    }
+
+    return value;
+}
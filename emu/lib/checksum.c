@@ -0,0 +1,118 @@
+#include <checksum.h>
+#include <string.h>
+
+static u32 crc_table[256];
+static bool crc_table_ready = false;
+
+static void crc32_init_table() {
+    for (u32 i=0; i<256; i++) {
+        u32 c = i;
+
+        for (int k=0; k<8; k++) {
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        }
+
+        crc_table[i] = c;
+    }
+
+    crc_table_ready = true;
+}
+
+u32 crc32_update(u32 crc, const u8 *data, u32 len) {
+    if (!crc_table_ready) {
+        crc32_init_table();
+    }
+
+    crc = ~crc;
+
+    for (u32 i=0; i<len; i++) {
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+u32 crc32(const u8 *data, u32 len) {
+    return crc32_update(0, data, len);
+}
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block(u32 h[5], const u8 *block) {
+    u32 w[80];
+
+    for (int i=0; i<16; i++) {
+        w[i] = ((u32)block[i * 4] << 24) | ((u32)block[i * 4 + 1] << 16) |
+            ((u32)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+
+    for (int i=16; i<80; i++) {
+        w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    u32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (int i=0; i<80; i++) {
+        u32 f, k;
+
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        u32 t = ROL32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL32(b, 30);
+        b = a;
+        a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+void sha1(const u8 *data, u32 len, u8 digest[20]) {
+    u32 h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    u32 i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        sha1_block(h, data + i);
+    }
+
+    //残りのデータ + 0x80 + ゼロ埋め + ビット長(ビッグエンディアン64bit)
+    u8 tail[128] = {0};
+    u32 rest = len - i;
+    memcpy(tail, data + i, rest);
+    tail[rest] = 0x80;
+
+    u32 tail_len = (rest + 9 <= 64) ? 64 : 128;
+    u64 bits = (u64)len * 8;
+
+    for (int b=0; b<8; b++) {
+        tail[tail_len - 1 - b] = (bits >> (b * 8)) & 0xFF;
+    }
+
+    for (u32 t=0; t<tail_len; t += 64) {
+        sha1_block(h, tail + t);
+    }
+
+    for (int k=0; k<5; k++) {
+        digest[k * 4] = h[k] >> 24;
+        digest[k * 4 + 1] = h[k] >> 16;
+        digest[k * 4 + 2] = h[k] >> 8;
+        digest[k * 4 + 3] = h[k];
+    }
+}
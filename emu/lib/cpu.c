@@ -4,6 +4,8 @@
 #include <interrupts.h>
 #include <dbg.h>
 #include <timer.h>
+#include <watch.h>
+#include <string.h>
 
 cpu_context ctx = {0};
 
@@ -20,6 +22,7 @@ void cpu_init() {
     ctx.int_flags = 0;
     ctx.int_master_enabled = false;
     ctx.enabling_ime = false;
+    ctx.instructions = 0;
 
     timer_get_context()->div = 0xABCC;
 }
@@ -40,10 +43,36 @@ static void execute() {
     proc(&ctx);
 }
 
+u64 cpu_instruction_count() {
+    return ctx.instructions;
+}
+
+u32 cpu_state_size() {
+    return sizeof(cpu_context);
+}
+
+void cpu_save_state(void *dst) {
+    memcpy(dst, &ctx, sizeof(cpu_context));
+}
+
+void cpu_load_state(const void *src) {
+    u64 instructions = ctx.instructions;
+    bool stepping = ctx.stepping;
+
+    memcpy(&ctx, src, sizeof(cpu_context));
+
+    ctx.instructions = instructions;
+    ctx.stepping = stepping;
+}
+
 bool cpu_step() {
     if (!ctx.halted) {
         u16 pc = ctx.regs.pc;
 
+        if (watch_exec_armed && watch_check_exec(pc)) {
+            return true;
+        }
+
         fetch_instruction();
         emu_cycles(1);
         fetch_data();
@@ -76,6 +105,7 @@ bool cpu_step() {
         dbg_print();
 
         execute();
+        ctx.instructions++;
     } else {
         //halt
         emu_cycles(1);
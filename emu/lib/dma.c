@@ -2,6 +2,7 @@
 #include <ppu.h>
 #include <bus.h>
 #include <unistd.h>
+#include <string.h>
 
 typedef struct {
     bool active;
@@ -29,13 +30,29 @@ void dma_tick() {
         return;
     }
 
-    ppu_oam_write(ctx.byte, bus_read((ctx.value * 0x100) + ctx.byte));
+    ppu_oam_dma_write(ctx.byte, bus_read((ctx.value * 0x100) + ctx.byte));
 
     ctx.byte++;
 
     ctx.active = ctx.byte < 0xA0;
+
+    if (!ctx.active) {
+        ppu_oam_dma_done();
+    }
 }
 
 bool dma_transferring() {
     return ctx.active;
-}
\ No newline at end of file
+}
+
+u32 dma_state_size() {
+    return sizeof(ctx);
+}
+
+void dma_save_state(void *dst) {
+    memcpy(dst, &ctx, sizeof(ctx));
+}
+
+void dma_load_state(const void *src) {
+    memcpy(&ctx, src, sizeof(ctx));
+}
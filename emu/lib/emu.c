@@ -7,9 +7,20 @@
 #include <dma.h>
 #include <ppu.h>
 #include <apu.h>
+#include <watch.h>
+#include <cheat.h>
+#include <romdb.h>
+#include <video.h>
+#include <framebuf.h>
+#include <ppu_thread.h>
+#include <pacer.h>
+#include <governor.h>
+#include <hud.h>
+#include <vram_view.h>
 
 #include <pthread.h>
 #include <unistd.h>
+#include <string.h>
 
 static emu_context ctx;
 
@@ -17,6 +28,49 @@ emu_context *emu_get_context(){
     return &ctx;
 }
 
+//一時停止中のCPUスレッドはここで眠る
+static pthread_mutex_t pause_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pause_cond = PTHREAD_COND_INITIALIZER;
+
+void emu_set_paused(bool paused) {
+    pthread_mutex_lock(&pause_lock);
+    ctx.paused = paused;
+    pthread_cond_broadcast(&pause_cond);
+    pthread_mutex_unlock(&pause_lock);
+}
+
+void emu_wake_paused() {
+    pthread_mutex_lock(&pause_lock);
+    pthread_cond_broadcast(&pause_cond);
+    pthread_mutex_unlock(&pause_lock);
+}
+
+//フレーム毎の処理時間をガバナーに渡す。1秒毎にFPSとフレーム間隔を表示してHUDに渡し、バッテリーRAMを保存する
+static void frame_paced() {
+    static u64 prev_instructions = 0;
+    pacer_stats stats;
+    bool report = pacer_frame(&stats);
+
+    governor_frame(pacer_busy_ms(), pacer_frame_ns() / 1e6);
+
+    if (!report) {
+        return;
+    }
+
+    //集計期間の長さはフレーム数×平均のフレーム間隔
+    u64 instructions = cpu_instruction_count();
+    double period = stats.frames * stats.avg_ms / 1000;
+    hud_set_stats(&stats, period > 0 ? (u64)((instructions - prev_instructions) / period) : 0);
+    prev_instructions = instructions;
+
+    printf("FPS: %d (avg %.2f ms, max %.2f ms, jitter %.3f ms, late %d)\n",
+        stats.frames, stats.avg_ms, stats.max_ms, stats.jitter_ms, stats.late);
+
+    if(cart_need_save()) {
+        cart_battery_save();
+    }
+}
+
 void *cpu_run(void *p) {
     timer_init();
     cpu_init();
@@ -26,9 +80,29 @@ void *cpu_run(void *p) {
     ctx.paused = false;
     ctx.ticks = 0;
 
+    u32 frame = ppu_get_context()->current_frame;
+    pacer_reset();
+
     while(ctx.running) {
+        //PPUが1フレーム進んだらホストの時間に合わせる
+        if (ppu_get_context()->current_frame != frame) {
+            frame = ppu_get_context()->current_frame;
+            frame_paced();
+        }
+
         if (ctx.paused) {
-            delay(10);
+            pthread_mutex_lock(&pause_lock);
+
+            while (ctx.paused && ctx.running) {
+                //止まっている間もデバッグ表示が頼めばVRAM/OAMを写す
+                vram_view_capture();
+                pthread_cond_wait(&pause_cond, &pause_lock);
+            }
+
+            pthread_mutex_unlock(&pause_lock);
+
+            //止まっていた時間は取り戻さない
+            pacer_reset();
             continue;
         }
 
@@ -42,13 +116,90 @@ void *cpu_run(void *p) {
 }
 
 int emu_run(int argc, char **argv) {
-    if(argc < 2) {
-        printf("Usage: emu <rom_file>\n");
+    char *rom_file = NULL;
+    char *patch_file = NULL;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--index") && i + 1 < argc) {
+            return romdb_index(argv[i + 1], 0) ? 0 : -1;
+        } else if (!strcmp(argv[i], "--break") && i + 1 < argc) {
+            char spec[64];
+            snprintf(spec, sizeof(spec), "x:%s", argv[++i]);
+
+            if (!watch_parse(spec)) {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--watch") && i + 1 < argc) {
+            if (!watch_parse(argv[++i])) {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--patch") && i + 1 < argc) {
+            patch_file = argv[++i];
+        } else if (!strcmp(argv[i], "--cheats") && i + 1 < argc) {
+            if (!cheat_load_file(argv[++i])) {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--cheat") && i + 1 < argc) {
+            if (cheat_add(argv[++i]) < 0) {
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--renderer") && i + 1 < argc) {
+            i++;
+
+            if (!strcmp(argv[i], "scanline")) {
+                ppu_set_renderer(PPU_RENDER_SCANLINE);
+            } else if (!strcmp(argv[i], "fifo")) {
+                ppu_set_renderer(PPU_RENDER_FIFO);
+            } else if (!strcmp(argv[i], "thread")) {
+                ppu_set_renderer(PPU_RENDER_THREAD);
+            } else {
+                printf("Unknown renderer: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--render-threads") && i + 1 < argc) {
+            ppu_thread_set_render_threads(atoi(argv[++i]));
+            ppu_set_renderer(PPU_RENDER_THREAD);
+        } else if (!strcmp(argv[i], "--audio-quality") && i + 1 < argc) {
+            i++;
+
+            if (!strcmp(argv[i], "low")) {
+                apu_set_quality(APU_QUALITY_LOW);
+            } else if (!strcmp(argv[i], "high")) {
+                apu_set_quality(APU_QUALITY_HIGH);
+            } else {
+                printf("Unknown audio quality: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--governor")) {
+            governor_enable(true);
+        } else if (!strcmp(argv[i], "--scaler") && i + 1 < argc) {
+            scaler_type type;
+            int factor;
+
+            if (!scaler_parse(argv[++i], &type, &factor)) {
+                return -1;
+            }
+
+            ui_set_scaler(type, factor);
+        } else if (!strcmp(argv[i], "--debug-view-rate") && i + 1 < argc) {
+            ui_set_debug_rate(atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--palette") && i + 1 < argc) {
+            if (!video_parse_colors(argv[++i])) {
+                return -1;
+            }
+        } else {
+            rom_file = argv[i];
+        }
+    }
+
+    if(!rom_file) {
+        printf("Usage: emu --index <dir>\n");
+        printf("       emu [--break ADDR] [--watch r|w|rw:START[-END][=VALUE]] [--patch FILE.ips|bps|ups] [--cheats FILE] [--cheat CODE] [--renderer fifo|scanline|thread] [--render-threads N] [--audio-quality low|high] [--governor] [--scaler none|nearestN|scale2x|scale3x|xbr] [--debug-view-rate HZ] [--palette COLORS] <rom_file>\n");
         return -1;
     }
 
-    if(!cart_load(argv[1])) {
-        printf("Failed to load ROM file: %s\n", argv[1]);
+    if(!cart_load(rom_file, patch_file)) {
+        printf("Failed to load ROM file: %s\n", rom_file);
         return -2;
     }
 
@@ -63,17 +214,11 @@ int emu_run(int argc, char **argv) {
         return -1;        
     }
 
-    u32 prev_frame = 0;
-
     while(!ctx.die) {
-        usleep(1000);
-        ui_handle_events();
-        
-        if(prev_frame != ppu_get_context()->current_frame) {
-            ui_update();
-        }
-
-        prev_frame = ppu_get_context()->current_frame;
+        //フレームの公開(ユーザーイベント)か入力があるまで眠る。デバッグ表示中はその更新間隔まで
+        //ui_update()は前回から変わったラインが無ければ何もしない
+        ui_wait_events(ui_wait_timeout());
+        ui_update();
     }
 
     return 0;
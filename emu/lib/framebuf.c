@@ -0,0 +1,104 @@
+#include <framebuf.h>
+
+#include <stdatomic.h>
+#include <string.h>
+
+//stateの下位2ビットが受け渡し用(中間)バッファの番号、FRESHは未読のフレームがあることを示す
+#define FRAMEBUF_FRESH 4
+
+typedef struct {
+    u8 buffers[3][FRAMEBUF_SIZE];
+    _Atomic u32 state;
+    _Atomic u32 published;
+    u32 frame[3];       //各バッファに入っているフレームの通し番号
+    u64 hash[3][FRAMEBUF_LINES];    //各バッファのライン毎のハッシュ。公開するときに計算する
+    u8 back;            //PPUスレッドだけが触る
+    u8 front;           //UIスレッドだけが触る
+} CACHE_ALIGNED framebuf;
+
+static framebuf fb = {
+    .state = 1,
+    .back = 0,
+    .front = 2
+};
+
+static void (*_Atomic publish_notify)() = NULL;
+
+void framebuf_set_notify(void (*notify)()) {
+    atomic_store(&publish_notify, notify);
+}
+
+u8 *framebuf_back() {
+    return fb.buffers[fb.back];
+}
+
+//1ライン(160バイト)を8バイトずつ混ぜる
+static u64 line_hash(const u8 *line) {
+    u64 h = 0x9E3779B97F4A7C15ULL;
+
+    for (int i=0; i<FRAMEBUF_SIZE / FRAMEBUF_LINES; i += 8) {
+        u64 v;
+        memcpy(&v, line + i, 8);
+        h = (h ^ v) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+
+    return h;
+}
+
+u8 *framebuf_publish() {
+    u32 frame = atomic_load_explicit(&fb.published, memory_order_relaxed) + 1;
+    fb.frame[fb.back] = frame;
+
+    for (int y=0; y<FRAMEBUF_LINES; y++) {
+        fb.hash[fb.back][y] = line_hash(fb.buffers[fb.back] + (y * (FRAMEBUF_SIZE / FRAMEBUF_LINES)));
+    }
+
+    //releaseでバッファの中身を書き終えてから中間バッファと交換する
+    u32 old = atomic_exchange_explicit(&fb.state, fb.back | FRAMEBUF_FRESH, memory_order_acq_rel);
+    fb.back = old & 3;
+
+    atomic_store_explicit(&fb.published, frame, memory_order_release);
+
+    void (*notify)() = atomic_load(&publish_notify);
+
+    if (notify) {
+        notify();
+    }
+
+    return fb.buffers[fb.back];
+}
+
+const u8 *framebuf_acquire(u32 *frame) {
+    if (atomic_load_explicit(&fb.state, memory_order_acquire) & FRAMEBUF_FRESH) {
+        u32 old = atomic_exchange_explicit(&fb.state, fb.front, memory_order_acq_rel);
+        fb.front = old & 3;
+    }
+
+    if (frame) {
+        *frame = fb.frame[fb.front];
+    }
+
+    return fb.buffers[fb.front];
+}
+
+u32 framebuf_frame_count() {
+    return atomic_load_explicit(&fb.published, memory_order_acquire);
+}
+
+int framebuf_dirty_lines(u64 *seen, framebuf_dirty *dirty) {
+    const u64 *hash = fb.hash[fb.front];
+    int count = 0;
+
+    memset(dirty, 0, sizeof(*dirty));
+
+    for (int y=0; y<FRAMEBUF_LINES; y++) {
+        if (hash[y] != seen[y]) {
+            dirty->bits[y / 64] |= 1ULL << (y % 64);
+            seen[y] = hash[y];
+            count++;
+        }
+    }
+
+    return count;
+}
@@ -60,4 +60,20 @@ u8 gamepad_get_output() {
     }
 
     return output;
-}
\ No newline at end of file
+}
+
+u32 gamepad_state_size() {
+    return 2;
+}
+
+void gamepad_save_state(void *dst) {
+    u8 *p = dst;
+    p[0] = ctx.button_sel;
+    p[1] = ctx.dir_sel;
+}
+
+void gamepad_load_state(const void *src) {
+    const u8 *p = src;
+    ctx.button_sel = p[0];
+    ctx.dir_sel = p[1];
+}
@@ -0,0 +1,93 @@
+#include <governor.h>
+#include <ppu.h>
+#include <apu.h>
+
+//移動平均の重み(1/8)
+#define LOAD_WEIGHT 0.125
+
+typedef struct {
+    bool enabled;
+    bool started;
+    governor_level level;
+    ppu_renderer renderer;      //--rendererで選ばれたレンダラー
+    apu_quality quality;        //--audio-qualityで選ばれた音声の品質
+    double load;                //処理時間/予算の移動平均
+    u32 over;                   //GOVERNOR_DEGRADE_LOADを超え続けているフレーム数
+    u32 under;                  //GOVERNOR_RESTORE_LOADを下回り続けているフレーム数
+} governor_context;
+
+static governor_context ctx;
+
+static const char *level_names[GOVERNOR_LEVELS] = {
+    "full",
+    "scanline",
+    "skip",
+    "audio"
+};
+
+void governor_enable(bool enable) {
+    ctx.enabled = enable;
+    ctx.started = false;
+}
+
+bool governor_enabled() {
+    return ctx.enabled;
+}
+
+governor_level governor_get_level() {
+    return ctx.level;
+}
+
+const char *governor_level_name(governor_level level) {
+    return level < GOVERNOR_LEVELS ? level_names[level] : "?";
+}
+
+//段階に合わせてPPU/APUのモードを切り替える。フレームの境界(VBLANKの開始)で呼ばれる
+static void apply_level(governor_level level) {
+    //PPUスレッドで描画している場合はレンダラーを変えない
+    if (ctx.renderer == PPU_RENDER_FIFO) {
+        ppu_set_renderer(level >= GOVERNOR_SCANLINE ? PPU_RENDER_SCANLINE : PPU_RENDER_FIFO);
+    }
+
+    ppu_set_skip_interval(level >= GOVERNOR_SKIP ? 2 : 1);
+    //品質は下げるだけで、設定より上げることはない
+    apu_set_quality(level >= GOVERNOR_AUDIO ? APU_QUALITY_LOW : ctx.quality);
+    apu_set_batch(level >= GOVERNOR_AUDIO);
+}
+
+static void set_level(governor_level level, double busy_ms, double budget_ms) {
+    printf("GOVERNOR: %s -> %s (load %.0f%%, busy %.2f ms / budget %.2f ms)\n",
+        level_names[ctx.level], level_names[level], ctx.load * 100, busy_ms, budget_ms);
+
+    ctx.level = level;
+    ctx.over = 0;
+    ctx.under = 0;
+    apply_level(level);
+}
+
+void governor_frame(double busy_ms, double budget_ms) {
+    if (!ctx.enabled || budget_ms <= 0) {
+        return;
+    }
+
+    if (!ctx.started) {
+        ctx.started = true;
+        ctx.renderer = ppu_get_context()->renderer;
+        ctx.quality = apu_get_quality();
+        ctx.level = GOVERNOR_FULL;
+        ctx.load = busy_ms / budget_ms;
+        ctx.over = 0;
+        ctx.under = 0;
+    }
+
+    ctx.load += ((busy_ms / budget_ms) - ctx.load) * LOAD_WEIGHT;
+
+    ctx.over = ctx.load > GOVERNOR_DEGRADE_LOAD ? ctx.over + 1 : 0;
+    ctx.under = ctx.load < GOVERNOR_RESTORE_LOAD ? ctx.under + 1 : 0;
+
+    if (ctx.over >= GOVERNOR_DEGRADE_FRAMES && ctx.level + 1 < GOVERNOR_LEVELS) {
+        set_level(ctx.level + 1, busy_ms, budget_ms);
+    } else if (ctx.under >= GOVERNOR_RESTORE_FRAMES && ctx.level > GOVERNOR_FULL) {
+        set_level(ctx.level - 1, busy_ms, budget_ms);
+    }
+}
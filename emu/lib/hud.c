@@ -0,0 +1,197 @@
+#include <hud.h>
+#include <apu.h>
+#include <governor.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+#define HUD_FONT "NotoSansMono-Medium.ttf"
+#define HUD_FONT_SIZE 14
+
+//アトラスに入れる文字(ASCIIの表示可能な文字)
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
+#define GLYPH_COUNT (GLYPH_LAST - GLYPH_FIRST + 1)
+
+#define HUD_LINES 5
+#define HUD_LINE_LEN 48
+#define HUD_MARGIN 4
+
+typedef struct {
+    SDL_Texture *atlas;     //GLYPH_COUNT文字を横に並べたテクスチャ
+    int cell_w;             //等幅フォントなので全ての文字が同じ幅
+    int cell_h;
+    _Atomic bool visible;
+
+    //CPUスレッドが書いてUIスレッドが読む
+    pthread_mutex_t lock;
+    pacer_stats stats;
+    u64 instructions;
+    bool has_stats;
+    _Atomic bool changed;
+} hud_context;
+
+static hud_context ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+//実行ファイルと同じディレクトリ、なければカレントディレクトリのフォントを開く
+static TTF_Font *open_font() {
+    TTF_Font *font = NULL;
+    char *base = SDL_GetBasePath();
+
+    if (base) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s%s", base, HUD_FONT);
+        font = TTF_OpenFont(path, HUD_FONT_SIZE);
+        SDL_free(base);
+    }
+
+    if (!font) {
+        font = TTF_OpenFont(HUD_FONT, HUD_FONT_SIZE);
+    }
+
+    return font;
+}
+
+bool hud_init(struct SDL_Renderer *renderer) {
+    TTF_Font *font = open_font();
+
+    if (!font) {
+        printf("HUD: failed to open %s: %s\n", HUD_FONT, TTF_GetError());
+        return false;
+    }
+
+    ctx.cell_h = TTF_FontHeight(font);
+    TTF_GlyphMetrics(font, 'M', NULL, NULL, NULL, NULL, &ctx.cell_w);
+
+    SDL_Surface *atlas = SDL_CreateRGBSurfaceWithFormat(0, ctx.cell_w * GLYPH_COUNT, ctx.cell_h,
+                                                    32, SDL_PIXELFORMAT_ARGB8888);
+
+    if (!atlas) {
+        TTF_CloseFont(font);
+        return false;
+    }
+
+    SDL_FillRect(atlas, NULL, 0);
+
+    //グリフを1つずつラスタライズしてアトラスに並べる
+    SDL_Color white = {255, 255, 255, 255};
+
+    for (int c = GLYPH_FIRST; c <= GLYPH_LAST; c++) {
+        SDL_Surface *glyph = TTF_RenderGlyph_Blended(font, (Uint16)c, white);
+
+        if (!glyph) {
+            continue;
+        }
+
+        SDL_Rect dst = {(c - GLYPH_FIRST) * ctx.cell_w, 0, glyph->w, glyph->h};
+        SDL_SetSurfaceBlendMode(glyph, SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(glyph, NULL, atlas, &dst);
+        SDL_FreeSurface(glyph);
+    }
+
+    ctx.atlas = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_FreeSurface(atlas);
+    TTF_CloseFont(font);
+
+    if (!ctx.atlas) {
+        return false;
+    }
+
+    SDL_SetTextureBlendMode(ctx.atlas, SDL_BLENDMODE_BLEND);
+
+    return true;
+}
+
+void hud_toggle() {
+    ctx.visible = !ctx.visible;
+    atomic_store(&ctx.changed, true);
+}
+
+bool hud_visible() {
+    return ctx.visible && ctx.atlas;
+}
+
+void hud_set_stats(const pacer_stats *stats, u64 instructions) {
+    pthread_mutex_lock(&ctx.lock);
+    ctx.stats = *stats;
+    ctx.instructions = instructions;
+    ctx.has_stats = true;
+    pthread_mutex_unlock(&ctx.lock);
+
+    if (ctx.visible) {
+        atomic_store(&ctx.changed, true);
+    }
+}
+
+bool hud_changed() {
+    return atomic_exchange(&ctx.changed, false) && ctx.atlas;
+}
+
+static void draw_text(SDL_Renderer *renderer, int x, int y, const char *text) {
+    SDL_Rect src = {0, 0, ctx.cell_w, ctx.cell_h};
+    SDL_Rect dst = {x, y, ctx.cell_w, ctx.cell_h};
+
+    for (; *text; text++, dst.x += ctx.cell_w) {
+        int c = (u8)*text;
+
+        if (c <= GLYPH_FIRST || c > GLYPH_LAST) {
+            continue;
+        }
+
+        src.x = (c - GLYPH_FIRST) * ctx.cell_w;
+        SDL_RenderCopy(renderer, ctx.atlas, &src, &dst);
+    }
+}
+
+void hud_draw(struct SDL_Renderer *renderer) {
+    char lines[HUD_LINES][HUD_LINE_LEN];
+    int count = 0;
+    pacer_stats stats;
+    u64 instructions;
+
+    if (!hud_visible()) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    stats = ctx.stats;
+    instructions = ctx.instructions;
+    bool has_stats = ctx.has_stats;
+    pthread_mutex_unlock(&ctx.lock);
+
+    if (!has_stats) {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    snprintf(lines[count++], HUD_LINE_LEN, "FPS %3u  speed %3.0f%%", stats.frames, stats.speed);
+    snprintf(lines[count++], HUD_LINE_LEN, "host %.2f/%.2f/%.2f ms (min/avg/p99)", stats.busy_min_ms, stats.busy_avg_ms, stats.busy_p99_ms);
+    snprintf(lines[count++], HUD_LINE_LEN, "audio %u ms", apu_audio_queued_ms());
+    snprintf(lines[count++], HUD_LINE_LEN, "inst %.2f M/s", instructions / 1e6);
+
+    if (governor_enabled()) {
+        snprintf(lines[count++], HUD_LINE_LEN, "gov %s", governor_level_name(governor_get_level()));
+    }
+
+    //文字が読めるように背景を半透明の黒にする
+    int width = 0;
+
+    for (int i = 0; i < count; i++) {
+        int w = (int)strlen(lines[i]) * ctx.cell_w;
+        width = w > width ? w : width;
+    }
+
+    SDL_Rect bg = {0, 0, width + (HUD_MARGIN * 2), (count * ctx.cell_h) + (HUD_MARGIN * 2)};
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_RenderFillRect(renderer, &bg);
+
+    for (int i = 0; i < count; i++) {
+        draw_text(renderer, HUD_MARGIN, HUD_MARGIN + (i * ctx.cell_h), lines[i]);
+    }
+}
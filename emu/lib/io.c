@@ -5,6 +5,7 @@
 #include <lcd.h>
 #include <gamepad.h>
 #include <apu.h>
+#include <string.h>
 
 static char serial_data[2];
 
@@ -78,4 +79,16 @@ void io_write(u16 address, u8 value) {
     }
 
     printf("UNSUPPORTED bus_write(%04X)\n", address);
-}
\ No newline at end of file
+}
+
+u32 io_state_size() {
+    return sizeof(serial_data);
+}
+
+void io_save_state(void *dst) {
+    memcpy(dst, serial_data, sizeof(serial_data));
+}
+
+void io_load_state(const void *src) {
+    memcpy(serial_data, src, sizeof(serial_data));
+}
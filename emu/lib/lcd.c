@@ -1,10 +1,15 @@
 #include <lcd.h>
 #include <ppu.h>
 #include <dma.h>
+#include <video.h>
+#include <ppu_thread.h>
+#include <string.h>
 
 static lcd_context ctx;
 
-static unsigned long colors_default[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+//モード3中に書き換わると描画結果が変わるレジスタ(LCDC/SCY/SCX/LY/BGP/OBP0/OBP1/WY/WX)
+#define LCD_RENDER_REGS 0x0F9D
+
 
 void lcd_init() {
     ctx.lcdc = 0x91;
@@ -19,9 +24,9 @@ void lcd_init() {
     ctx.win_x = 0;
 
     for (int i=0; i<4; i++) {
-        ctx.bg_colors[i] = colors_default[i];
-        ctx.sp1_colors[i] = colors_default[i];
-        ctx.sp2_colors[i] = colors_default[i];
+        ctx.bg_colors[i] = VIDEO_PIXEL(i, 0);
+        ctx.sp1_colors[i] = VIDEO_PIXEL(i, 1);
+        ctx.sp2_colors[i] = VIDEO_PIXEL(i, 2);
     }
 }
 
@@ -29,6 +34,18 @@ lcd_context *lcd_get_context() {
     return &ctx;
 }
 
+u32 lcd_state_size() {
+    return sizeof(ctx);
+}
+
+void lcd_save_state(void *dst) {
+    memcpy(dst, &ctx, sizeof(ctx));
+}
+
+void lcd_load_state(const void *src) {
+    memcpy(&ctx, src, sizeof(ctx));
+}
+
 u8 lcd_read(u16 address) {
     u8 offset = (address - 0xFF40);
     u8 *p = (u8 *)&ctx;
@@ -37,7 +54,7 @@ u8 lcd_read(u16 address) {
 }
 
 void update_palette(u8 palette_data, u8 pal) {
-    u32 *p_colors = ctx.bg_colors;
+    u8 *p_colors = ctx.bg_colors;
 
     switch(pal) {
         case 1:
@@ -48,17 +65,29 @@ void update_palette(u8 palette_data, u8 pal) {
             break;
     }
 
-    p_colors[0] = colors_default[palette_data & 0b11];
-    p_colors[1] = colors_default[(palette_data >> 2) & 0b11];
-    p_colors[2] = colors_default[(palette_data >> 4) & 0b11];
-    p_colors[3] = colors_default[(palette_data >> 6) & 0b11];
+    //シェードへの変換だけ行い、実際の色はフレームを表示するときにvideo_convert()で決める
+    p_colors[0] = VIDEO_PIXEL(palette_data & 0b11, pal);
+    p_colors[1] = VIDEO_PIXEL((palette_data >> 2) & 0b11, pal);
+    p_colors[2] = VIDEO_PIXEL((palette_data >> 4) & 0b11, pal);
+    p_colors[3] = VIDEO_PIXEL((palette_data >> 6) & 0b11, pal);
 }
 
 void lcd_write(u16 address, u8 value) {
     u8 offset = (address - 0xFF40);
     u8 *p = (u8 *)&ctx;
+
+    if(ppu_get_context()->line_fast && (LCD_RENDER_REGS & (1 << offset)) && p[offset] != value) {
+        ppu_scanline_fallback();
+    }
+
+    bool power = offset == 0 && ((p[offset] ^ value) & 0x80);
+
     p[offset] = value;
 
+    if(power) {
+        ppu_lcd_power(LCDC_LCD_ENABLE);
+    }
+
     if(offset == 6) {
         dma_start(value);
     }
@@ -70,4 +99,8 @@ void lcd_write(u16 address, u8 value) {
     } else if (address == 0xFF49) {
         update_palette(value & 0b11111100, 2);
     }
-}
\ No newline at end of file
+
+    if(ppu_get_context()->renderer == PPU_RENDER_THREAD) {
+        ppu_thread_write(address, value);
+    }
+}
@@ -0,0 +1,88 @@
+#include <mem.h>
+#include <tile_cache.h>
+#include <ppu.h>
+#include <ppu_thread.h>
+#include <cpu.h>
+#include <timer.h>
+#include <lcd.h>
+#include <dma.h>
+#include <cart.h>
+#include <io.h>
+#include <gamepad.h>
+#include <apu.h>
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(offsetof(mem_arena, vram) == 0x0000, "VRAM offset");
+_Static_assert(offsetof(mem_arena, wram) == 0x2000, "WRAM offset");
+_Static_assert(offsetof(mem_arena, oam) == 0x4000, "OAM offset");
+_Static_assert(offsetof(mem_arena, hram) == 0x4100, "HRAM offset");
+_Static_assert(offsetof(mem_arena, cart_ram) == 0x4200, "Cart RAM offset");
+
+mem_arena gb_arena;
+
+mem_arena *mem_get_arena() {
+    return &gb_arena;
+}
+
+//mem_arenaの後に並べるモジュールの状態。この順番で保存する
+typedef struct {
+    u32 (*size)();
+    void (*save)(void *dst);
+    void (*load)(const void *src);
+} state_block;
+
+static const state_block blocks[] = {
+    {cpu_state_size, cpu_save_state, cpu_load_state},
+    {timer_state_size, timer_save_state, timer_load_state},
+    {lcd_state_size, lcd_save_state, lcd_load_state},
+    {dma_state_size, dma_save_state, dma_load_state},
+    {cart_state_size, cart_save_state, cart_load_state},
+    {io_state_size, io_save_state, io_load_state},
+    {gamepad_state_size, gamepad_save_state, gamepad_load_state},
+    {ppu_state_size, ppu_save_state, ppu_load_state},
+    {apu_state_size, apu_save_state, apu_load_state},
+};
+
+#define STATE_BLOCKS (sizeof(blocks) / sizeof(blocks[0]))
+
+u32 mem_snapshot_size() {
+    u32 size = sizeof(mem_arena);
+
+    for (u32 i=0; i<STATE_BLOCKS; i++) {
+        size += blocks[i].size();
+    }
+
+    return size;
+}
+
+void mem_snapshot(void *dst) {
+    u8 *p = dst;
+
+    memcpy(p, &gb_arena, sizeof(mem_arena));
+    p += sizeof(mem_arena);
+
+    for (u32 i=0; i<STATE_BLOCKS; i++) {
+        blocks[i].save(p);
+        p += blocks[i].size();
+    }
+}
+
+void mem_restore(const void *src) {
+    const u8 *p = src;
+
+    memcpy(&gb_arena, p, sizeof(mem_arena));
+    p += sizeof(mem_arena);
+
+    for (u32 i=0; i<STATE_BLOCKS; i++) {
+        blocks[i].load(p);
+        p += blocks[i].size();
+    }
+
+    tile_cache_invalidate_all(tile_cache_get());
+    ppu_sprite_index_invalidate();
+
+    if (ppu_thread_running()) {
+        ppu_thread_sync();
+    }
+}
@@ -0,0 +1,180 @@
+#include <pacer.h>
+
+#include <time.h>
+#include <errno.h>
+
+//期限の直前はsleepの精度が足りないのでスピンで待つ
+#define PACER_SPIN_NS 500000LL
+
+//これ以上遅れたら追いつこうとせずに期限を数え直す(一時停止やブレークの後など)
+#define PACER_MAX_LAG_NS 100000000LL
+
+#define NS_PER_SEC 1000000000LL
+
+typedef struct {
+    bool started;
+    i64 base;           //期限を数え始めた時刻
+    u64 frames;         //baseから進んだフレーム数
+    i64 prev;           //前のフレームで待ち終えた時刻
+    i64 busy;           //prevからpacer_frame()が呼ばれるまでの時間
+
+    //集計中の統計
+    i64 report_start;
+    u32 count;
+    u32 late;
+    double sum;
+    double sum_diff;    //1フレームの時間との差(絶対値)の和
+    double max;
+    float samples[PACER_MAX_SAMPLES];   //処理時間(ms)
+    u32 sample_count;
+} pacer_context;
+
+static pacer_context ctx;
+
+static i64 now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((i64)ts.tv_sec * NS_PER_SEC) + ts.tv_nsec;
+}
+
+double pacer_frame_ns() {
+    return (double)PACER_FRAME_CLOCKS * NS_PER_SEC / PACER_CLOCK_HZ;
+}
+
+//baseからframesフレーム後の時刻。掛け算が溢れないように秒と余りに分ける
+static i64 deadline(u64 frames) {
+    u64 clocks = frames * PACER_FRAME_CLOCKS;
+    u64 sec = clocks / PACER_CLOCK_HZ;
+    u64 rem = clocks % PACER_CLOCK_HZ;
+
+    return ctx.base + (i64)(sec * NS_PER_SEC) + (i64)((rem * NS_PER_SEC) / PACER_CLOCK_HZ);
+}
+
+static void wait_until(i64 target) {
+    i64 sleep_until = target - PACER_SPIN_NS;
+
+    if (now_ns() < sleep_until) {
+        struct timespec ts = {
+            .tv_sec = sleep_until / NS_PER_SEC,
+            .tv_nsec = sleep_until % NS_PER_SEC
+        };
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+
+    while (now_ns() < target) {
+    }
+}
+
+double pacer_busy_ms() {
+    return ctx.busy / 1e6;
+}
+
+static void reset_stats(i64 now) {
+    ctx.report_start = now;
+    ctx.count = 0;
+    ctx.late = 0;
+    ctx.sum = 0;
+    ctx.sum_diff = 0;
+    ctx.max = 0;
+    ctx.sample_count = 0;
+}
+
+static int compare_float(const void *a, const void *b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+//集計期間の処理時間の最小/平均/99パーセンタイル
+static void busy_stats(pacer_stats *stats) {
+    double sum = 0;
+
+    stats->busy_min_ms = 0;
+    stats->busy_avg_ms = 0;
+    stats->busy_p99_ms = 0;
+
+    if (!ctx.sample_count) {
+        return;
+    }
+
+    qsort(ctx.samples, ctx.sample_count, sizeof(float), compare_float);
+
+    for (u32 i=0; i<ctx.sample_count; i++) {
+        sum += ctx.samples[i];
+    }
+
+    stats->busy_min_ms = ctx.samples[0];
+    stats->busy_avg_ms = sum / ctx.sample_count;
+    stats->busy_p99_ms = ctx.samples[((ctx.sample_count - 1) * 99) / 100];
+}
+
+void pacer_reset() {
+    i64 now = now_ns();
+
+    ctx.started = true;
+    ctx.base = now;
+    ctx.frames = 0;
+    ctx.prev = now;
+    reset_stats(now);
+}
+
+bool pacer_frame(pacer_stats *stats) {
+    if (!ctx.started) {
+        pacer_reset();
+    }
+
+    ctx.frames++;
+
+    i64 target = deadline(ctx.frames);
+    i64 now = now_ns();
+
+    ctx.busy = now - ctx.prev;
+
+    if (ctx.sample_count < PACER_MAX_SAMPLES) {
+        ctx.samples[ctx.sample_count++] = ctx.busy / 1e6;
+    }
+
+    if (now - target > PACER_MAX_LAG_NS) {
+        //大きく遅れた。このフレームから数え直す
+        ctx.base = now;
+        ctx.frames = 0;
+        ctx.late++;
+    } else if (now > target) {
+        ctx.late++;
+    } else {
+        wait_until(target);
+        now = now_ns();
+    }
+
+    double frame_ms = (now - ctx.prev) / 1e6;
+    double diff = frame_ms - (pacer_frame_ns() / 1e6);
+
+    ctx.prev = now;
+    ctx.count++;
+    ctx.sum += frame_ms;
+    ctx.sum_diff += diff < 0 ? -diff : diff;
+
+    if (frame_ms > ctx.max) {
+        ctx.max = frame_ms;
+    }
+
+    if (now - ctx.report_start < PACER_REPORT_NS) {
+        return false;
+    }
+
+    if (stats) {
+        stats->frames = ctx.count;
+        stats->late = ctx.late;
+        stats->avg_ms = ctx.sum / ctx.count;
+        stats->max_ms = ctx.max;
+        stats->jitter_ms = ctx.sum_diff / ctx.count;
+        stats->speed = ctx.count * pacer_frame_ns() * 100 / (now - ctx.report_start);
+        busy_stats(stats);
+    }
+
+    reset_stats(now);
+
+    return true;
+}
@@ -0,0 +1,352 @@
+#include <patch.h>
+#include <checksum.h>
+#include <string.h>
+
+//パッチファイルは先頭から1回だけ読み進める
+typedef struct {
+    FILE *fp;
+    u32 size;
+    u32 pos;
+    u32 crc;    //末尾4バイト(パッチ自身のCRC)を除いたCRC32
+    bool error;
+} patch_reader;
+
+typedef struct {
+    const u8 *source;
+    u32 source_size;
+    u8 *target;
+    u32 target_size;
+    u32 capacity;
+    bool heap;      //targetをヒープに確保し直した(元のtargetは呼び出し側のもの)
+} patch_image;
+
+static u8 read_byte(patch_reader *r) {
+    int c = fgetc(r->fp);
+
+    if (c == EOF) {
+        r->error = true;
+        return 0;
+    }
+
+    u8 b = c;
+
+    if (r->pos + 4 < r->size) {
+        r->crc = crc32_update(r->crc, &b, 1);
+    }
+
+    r->pos++;
+    return b;
+}
+
+static u32 read_u32le(patch_reader *r) {
+    u32 v = read_byte(r);
+    v |= read_byte(r) << 8;
+    v |= read_byte(r) << 16;
+    v |= (u32)read_byte(r) << 24;
+    return v;
+}
+
+//BPS/UPSの可変長整数
+static u64 read_varint(patch_reader *r) {
+    u64 data = 0;
+    u64 shift = 1;
+
+    while (!r->error) {
+        u8 x = read_byte(r);
+        data += (x & 0x7F) * shift;
+
+        if (x & 0x80) {
+            break;
+        }
+
+        shift <<= 7;
+        data += shift;
+    }
+
+    return data;
+}
+
+//出力がマッピングより大きくなる場合だけヒープにコピーする
+//IPSはレコード毎に少しずつ伸びるので、容量は2倍ずつ増やす
+static bool image_reserve(patch_image *img, u64 size) {
+    if (size > 0x7FFFFFFF) {
+        return false;
+    }
+
+    if (size <= img->capacity) {
+        return true;
+    }
+
+    u64 capacity = (u64)img->capacity * 2;
+
+    if (capacity < size) {
+        capacity = size;
+    } else if (capacity > 0x7FFFFFFF) {
+        capacity = 0x7FFFFFFF;
+    }
+
+    u8 *p;
+
+    if (img->heap) {
+        p = realloc(img->target, capacity);
+    } else {
+        p = malloc(capacity);
+
+        if (p) {
+            memcpy(p, img->target, img->capacity);
+        }
+    }
+
+    if (!p) {
+        return false;
+    }
+
+    memset(p + img->capacity, 0, capacity - img->capacity);
+    img->target = p;
+    img->capacity = capacity;
+    img->heap = true;
+    return true;
+}
+
+//同じ値の書き込みはしない(コピーオンライトのページを増やさないため)
+static void image_put(patch_image *img, u32 offset, u8 value) {
+    if (img->target[offset] != value) {
+        img->target[offset] = value;
+    }
+}
+
+static u8 image_source(patch_image *img, u32 offset) {
+    return offset < img->source_size ? img->source[offset] : 0;
+}
+
+static bool apply_ips(patch_reader *r, patch_image *img) {
+    while (!r->error) {
+        u32 offset = read_byte(r) << 16;
+        offset |= read_byte(r) << 8;
+        offset |= read_byte(r);
+
+        //"EOF"
+        if (offset == 0x454F46) {
+            //拡張: 続く3バイトは切り詰め後のサイズ
+            if (r->pos + 3 <= r->size) {
+                u32 size = read_byte(r) << 16;
+                size |= read_byte(r) << 8;
+                size |= read_byte(r);
+
+                if (size < img->target_size) {
+                    img->target_size = size;
+                }
+            }
+            return !r->error;
+        }
+
+        u32 size = read_byte(r) << 8;
+        size |= read_byte(r);
+        bool rle = size == 0;
+        u8 value = 0;
+
+        if (rle) {
+            size = read_byte(r) << 8;
+            size |= read_byte(r);
+            value = read_byte(r);
+        }
+
+        if (r->error || !image_reserve(img, (u64)offset + size)) {
+            return false;
+        }
+
+        for (u32 i=0; i<size; i++) {
+            image_put(img, offset + i, rle ? value : read_byte(r));
+        }
+
+        if (offset + size > img->target_size) {
+            img->target_size = offset + size;
+        }
+    }
+
+    return false;
+}
+
+static bool check_crc(const char *what, u32 expected, u32 actual) {
+    if (expected != actual) {
+        fprintf(stderr, "PATCH: %s CRC32 mismatch (expected %08X, got %08X)\n", what, expected, actual);
+        return false;
+    }
+    return true;
+}
+
+static bool apply_bps(patch_reader *r, patch_image *img) {
+    u64 source_size = read_varint(r);
+    u64 target_size = read_varint(r);
+    u64 metadata_size = read_varint(r);
+
+    for (u64 i=0; i<metadata_size && !r->error; i++) {
+        read_byte(r);
+    }
+
+    if (source_size != img->source_size) {
+        fprintf(stderr, "PATCH: source size mismatch (patch %llu, ROM %u)\n",
+            (unsigned long long)source_size, img->source_size);
+        return false;
+    }
+
+    if (r->error || !image_reserve(img, target_size)) {
+        return false;
+    }
+
+    img->target_size = target_size;
+
+    u32 out = 0;
+    u32 source_rel = 0;
+    u32 target_rel = 0;
+
+    while (r->pos + 12 < r->size && !r->error) {
+        u64 data = read_varint(r);
+        u64 length = (data >> 2) + 1;
+
+        if (out + length > target_size) {
+            return false;
+        }
+
+        switch (data & 3) {
+            case 0: //SourceRead
+                for (u64 i=0; i<length; i++, out++) {
+                    image_put(img, out, image_source(img, out));
+                }
+                break;
+
+            case 1: //TargetRead
+                for (u64 i=0; i<length; i++) {
+                    image_put(img, out++, read_byte(r));
+                }
+                break;
+
+            case 2: { //SourceCopy
+                u64 d = read_varint(r);
+                source_rel += (d & 1) ? -(int64_t)(d >> 1) : (int64_t)(d >> 1);
+
+                for (u64 i=0; i<length; i++) {
+                    image_put(img, out++, image_source(img, source_rel++));
+                }
+            } break;
+
+            case 3: { //TargetCopy
+                u64 d = read_varint(r);
+                target_rel += (d & 1) ? -(int64_t)(d >> 1) : (int64_t)(d >> 1);
+
+                if (target_rel >= out) {
+                    return false;
+                }
+
+                for (u64 i=0; i<length; i++) {
+                    image_put(img, out++, img->target[target_rel++]);
+                }
+            } break;
+        }
+    }
+
+    u32 source_crc = read_u32le(r);
+    u32 target_crc = read_u32le(r);
+    u32 patch_crc = r->crc;
+    u32 expected_patch_crc = read_u32le(r);
+
+    return !r->error && out == target_size &&
+        check_crc("source", source_crc, crc32(img->source, img->source_size)) &&
+        check_crc("target", target_crc, crc32(img->target, img->target_size)) &&
+        check_crc("patch", expected_patch_crc, patch_crc);
+}
+
+static bool apply_ups(patch_reader *r, patch_image *img) {
+    u64 source_size = read_varint(r);
+    u64 target_size = read_varint(r);
+
+    if (source_size != img->source_size) {
+        fprintf(stderr, "PATCH: source size mismatch (patch %llu, ROM %u)\n",
+            (unsigned long long)source_size, img->source_size);
+        return false;
+    }
+
+    if (r->error || !image_reserve(img, target_size)) {
+        return false;
+    }
+
+    img->target_size = target_size;
+
+    u64 pos = 0;
+
+    while (r->pos + 12 < r->size && !r->error) {
+        pos += read_varint(r);
+
+        //XORデータは0で終端し、終端バイトの位置も1つ進める
+        while (!r->error) {
+            u8 x = read_byte(r);
+
+            if (pos < target_size) {
+                image_put(img, pos, x ^ image_source(img, pos));
+            }
+            pos++;
+
+            if (!x) {
+                break;
+            }
+        }
+    }
+
+    u32 source_crc = read_u32le(r);
+    u32 target_crc = read_u32le(r);
+    u32 patch_crc = r->crc;
+    u32 expected_patch_crc = read_u32le(r);
+
+    return !r->error &&
+        check_crc("source", source_crc, crc32(img->source, img->source_size)) &&
+        check_crc("target", target_crc, crc32(img->target, img->target_size)) &&
+        check_crc("patch", expected_patch_crc, patch_crc);
+}
+
+bool patch_apply(const char *path, const u8 *source, u32 source_size,
+    u8 **target, u32 *target_size) {
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        fprintf(stderr, "FAILED TO OPEN: %s\n", path);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    patch_reader r = {fp, ftell(fp), 0, 0, false};
+    rewind(fp);
+
+    patch_image img = {source, source_size, *target, *target_size, *target_size, false};
+
+    char magic[5] = {0};
+    for (int i=0; i<4; i++) {
+        magic[i] = read_byte(&r);
+    }
+
+    bool ok = false;
+    const char *format = "unknown";
+
+    if (!memcmp(magic, "PATC", 4) && read_byte(&r) == 'H') {
+        format = "IPS";
+        ok = apply_ips(&r, &img);
+    } else if (!memcmp(magic, "BPS1", 4)) {
+        format = "BPS";
+        ok = apply_bps(&r, &img);
+    } else if (!memcmp(magic, "UPS1", 4)) {
+        format = "UPS";
+        ok = apply_ups(&r, &img);
+    }
+
+    fclose(fp);
+
+    *target = img.target;
+    *target_size = img.target_size;
+
+    if (!ok) {
+        fprintf(stderr, "PATCH: failed to apply %s patch: %s\n", format, path);
+        return false;
+    }
+
+    printf("Patched: %s (%s, %u bytes)\n", path, format, img.target_size);
+    return true;
+}
@@ -0,0 +1,255 @@
+#include <pixel.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIXEL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static pixel_isa cur_isa = PIXEL_ISA_SCALAR;
+
+//spread[b]はbの各ビットを1バイトずつに広げたもの。MSBが先頭(最下位)のバイトになる
+//pixel_init()より前に呼ばれても使えるように定数で持つ
+#define SPREAD_BIT(b, i) ((u64)(((b) >> (7 - (i))) & 1) << ((i) * 8))
+#define SPREAD(b) (SPREAD_BIT(b, 0) | SPREAD_BIT(b, 1) | SPREAD_BIT(b, 2) | SPREAD_BIT(b, 3) | \
+                   SPREAD_BIT(b, 4) | SPREAD_BIT(b, 5) | SPREAD_BIT(b, 6) | SPREAD_BIT(b, 7))
+#define SPREAD4(b) SPREAD(b), SPREAD((b) + 1), SPREAD((b) + 2), SPREAD((b) + 3)
+#define SPREAD16(b) SPREAD4(b), SPREAD4((b) + 4), SPREAD4((b) + 8), SPREAD4((b) + 12)
+#define SPREAD64(b) SPREAD16(b), SPREAD16((b) + 16), SPREAD16((b) + 32), SPREAD16((b) + 48)
+
+static const u64 spread[256] = {
+    SPREAD64(0), SPREAD64(64), SPREAD64(128), SPREAD64(192)
+};
+
+//scalar
+static void decode_row_scalar(u8 lo, u8 hi, u8 *out) {
+    //各バイトは0か1なので1ビットシフトしても隣のバイトに溢れない
+    u64 v = spread[lo] | (spread[hi] << 1);
+    memcpy(out, &v, 8);
+}
+
+static void decode_row_argb_scalar(u8 lo, u8 hi, const u32 *palette, u32 *out) {
+    u8 index[8];
+    decode_row_scalar(lo, hi, index);
+
+    for (int i=0; i<8; i++) {
+        out[i] = palette[index[i]];
+    }
+}
+
+static void map_row_scalar(const u8 *index, const u8 *palette, u8 *out, int count) {
+    for (int i=0; i<count; i++) {
+        out[i] = palette[index[i]];
+    }
+}
+
+#ifdef PIXEL_SSE2
+//SSE2
+//各レーンに対応するビットをマスクして比較し、0/1と0/2を作ってORする
+static inline __m128i sse2_index8(u8 lo, u8 hi) {
+    const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, (char)128,
+                                      1, 2, 4, 8, 16, 32, 64, (char)128);
+    __m128i vlo = _mm_and_si128(_mm_set1_epi8((char)lo), bits);
+    __m128i vhi = _mm_and_si128(_mm_set1_epi8((char)hi), bits);
+    vlo = _mm_and_si128(_mm_cmpeq_epi8(vlo, bits), _mm_set1_epi8(1));
+    vhi = _mm_and_si128(_mm_cmpeq_epi8(vhi, bits), _mm_set1_epi8(2));
+    return _mm_or_si128(vlo, vhi);
+}
+
+static void decode_row_sse2(u8 lo, u8 hi, u8 *out) {
+    _mm_storel_epi64((__m128i *)out, sse2_index8(lo, hi));
+}
+
+//4ピクセル分のカラー番号(32bitレーン)をパレットの4色から選ぶ
+static inline __m128i sse2_select4(__m128i index, const u32 *palette) {
+    __m128i c = _mm_and_si128(_mm_cmpeq_epi32(index, _mm_setzero_si128()), _mm_set1_epi32(palette[0]));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(index, _mm_set1_epi32(1)), _mm_set1_epi32(palette[1])));
+    c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(index, _mm_set1_epi32(2)), _mm_set1_epi32(palette[2])));
+    return _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(index, _mm_set1_epi32(3)), _mm_set1_epi32(palette[3])));
+}
+
+static void decode_row_argb_sse2(u8 lo, u8 hi, const u32 *palette, u32 *out) {
+    __m128i index = _mm_unpacklo_epi8(sse2_index8(lo, hi), _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)out, sse2_select4(_mm_unpacklo_epi16(index, _mm_setzero_si128()), palette));
+    _mm_storeu_si128((__m128i *)(out + 4), sse2_select4(_mm_unpackhi_epi16(index, _mm_setzero_si128()), palette));
+}
+
+static void map_row_sse2(const u8 *index, const u8 *palette, u8 *out, int count) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(index + i));
+        __m128i c = _mm_and_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), _mm_set1_epi8((char)palette[0]));
+        c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(1)), _mm_set1_epi8((char)palette[1])));
+        c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(2)), _mm_set1_epi8((char)palette[2])));
+        c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(3)), _mm_set1_epi8((char)palette[3])));
+        _mm_storeu_si128((__m128i *)(out + i), c);
+    }
+
+    map_row_scalar(index + i, palette, out + i, count - i);
+}
+#endif
+
+#ifdef PIXEL_X86_DISPATCH
+//AVX2
+//8ピクセル分のカラー番号を32bitレーンに作ってvpermdでパレットを引く
+__attribute__((target("avx2")))
+static void decode_row_argb_avx2(u8 lo, u8 hi, const u32 *palette, u32 *out) {
+    const __m256i bits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i vlo = _mm256_and_si256(_mm256_set1_epi32(lo), bits);
+    __m256i vhi = _mm256_and_si256(_mm256_set1_epi32(hi), bits);
+    __m256i index = _mm256_or_si256(
+        _mm256_and_si256(_mm256_cmpeq_epi32(vlo, bits), _mm256_set1_epi32(1)),
+        _mm256_and_si256(_mm256_cmpeq_epi32(vhi, bits), _mm256_set1_epi32(2)));
+    __m256i pal = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)palette));
+
+    _mm256_storeu_si256((__m256i *)out, _mm256_permutevar8x32_epi32(pal, index));
+}
+
+//パレットの4バイトを両方のレーンに置いてvpshufbで引く
+__attribute__((target("avx2")))
+static void map_row_avx2(const u8 *index, const u8 *palette, u8 *out, int count) {
+    u32 p;
+    memcpy(&p, palette, 4);
+    __m256i pal = _mm256_set1_epi32(p);
+    int i = 0;
+
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(index + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(pal, v));
+    }
+
+    map_row_scalar(index + i, palette, out + i, count - i);
+}
+
+//BMI2
+//pdepで各ビットを1バイトずつに広げる。pdepはLSBが先頭のバイトになるのでbswapで反転する
+__attribute__((target("bmi2")))
+static void decode_row_bmi2(u8 lo, u8 hi, u8 *out) {
+#if defined(__x86_64__)
+    u64 v = _pdep_u64(lo, 0x0101010101010101ULL) | _pdep_u64(hi, 0x0202020202020202ULL);
+#else
+    u64 v = (_pdep_u32(lo & 0xF, 0x01010101) | _pdep_u32(hi & 0xF, 0x02020202)) |
+        ((u64)(_pdep_u32(lo >> 4, 0x01010101) | _pdep_u32(hi >> 4, 0x02020202)) << 32);
+#endif
+    v = __builtin_bswap64(v);
+    memcpy(out, &v, 8);
+}
+
+__attribute__((target("bmi2")))
+static void decode_row_argb_bmi2(u8 lo, u8 hi, const u32 *palette, u32 *out) {
+    u8 index[8];
+    decode_row_bmi2(lo, hi, index);
+
+    for (int i=0; i<8; i++) {
+        out[i] = palette[index[i]];
+    }
+}
+#endif
+
+void (*pixel_decode_row)(u8 lo, u8 hi, u8 *out) = decode_row_scalar;
+void (*pixel_decode_row_argb)(u8 lo, u8 hi, const u32 *palette, u32 *out) = decode_row_argb_scalar;
+void (*pixel_map_row)(const u8 *index, const u8 *palette, u8 *out, int count) = map_row_scalar;
+
+bool pixel_isa_supported(pixel_isa isa) {
+    switch(isa) {
+        case PIXEL_ISA_SCALAR:
+            return true;
+#ifdef PIXEL_SSE2
+        case PIXEL_ISA_SSE2:
+            return true;
+#endif
+#ifdef PIXEL_X86_DISPATCH
+        case PIXEL_ISA_SSSE3:
+            return __builtin_cpu_supports("ssse3");
+        case PIXEL_ISA_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case PIXEL_ISA_BMI2:
+            return __builtin_cpu_supports("bmi2");
+#endif
+        default:
+            return false;
+    }
+}
+
+bool pixel_use_isa(pixel_isa isa) {
+    if (!pixel_isa_supported(isa)) {
+        return false;
+    }
+
+    pixel_decode_row = decode_row_scalar;
+    pixel_decode_row_argb = decode_row_argb_scalar;
+    pixel_map_row = map_row_scalar;
+
+#ifdef PIXEL_SSE2
+    if (isa != PIXEL_ISA_SCALAR) {
+        pixel_decode_row = decode_row_sse2;
+        pixel_decode_row_argb = decode_row_argb_sse2;
+        pixel_map_row = map_row_sse2;
+    }
+#endif
+
+#ifdef PIXEL_X86_DISPATCH
+    if (isa == PIXEL_ISA_AVX2) {
+        pixel_decode_row_argb = decode_row_argb_avx2;
+        pixel_map_row = map_row_avx2;
+    } else if (isa == PIXEL_ISA_BMI2) {
+        //pdepを使うのはカラー番号の展開だけで、パレット変換はテーブル参照
+        pixel_decode_row = decode_row_bmi2;
+        pixel_decode_row_argb = decode_row_argb_bmi2;
+    }
+#endif
+
+    cur_isa = isa;
+    return true;
+}
+
+//pdepが速いCPUか。AMDのZen1/Zen2ではpdepがマイクロコードで非常に遅いのでIntelに限る
+static bool fast_pdep() {
+#ifdef PIXEL_X86_DISPATCH
+    return pixel_isa_supported(PIXEL_ISA_BMI2) && __builtin_cpu_is("intel");
+#else
+    return false;
+#endif
+}
+
+//AVX2 > SSE2 > scalarの順に選ぶ。
+//pdepが速いCPUではカラー番号の展開だけpdepを使う
+void pixel_init() {
+    static bool initialized = false;
+
+    if (initialized) {
+        return;
+    }
+
+    initialized = true;
+
+    if (pixel_use_isa(PIXEL_ISA_AVX2)) {
+#ifdef PIXEL_X86_DISPATCH
+        if (fast_pdep()) {
+            pixel_decode_row = decode_row_bmi2;
+        }
+#endif
+        return;
+    }
+
+    if ((fast_pdep() && pixel_use_isa(PIXEL_ISA_BMI2)) || pixel_use_isa(PIXEL_ISA_SSE2)) {
+        return;
+    }
+
+    pixel_use_isa(PIXEL_ISA_SCALAR);
+}
+
+pixel_isa pixel_get_isa() {
+    return cur_isa;
+}
+
+const char *pixel_isa_name(pixel_isa isa) {
+    static const char *names[] = {"scalar", "SSE2", "SSSE3", "AVX2", "BMI2"};
+    return names[isa];
+}
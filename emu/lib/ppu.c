@@ -3,36 +3,91 @@
 #include <lcd.h>
 #include <string.h>
 #include <ppu_sm.h>
+#include <mem.h>
+#include <tile_cache.h>
+#include <pixel.h>
+#include <framebuf.h>
+#include <video.h>
+#include <ppu_thread.h>
 
 static ppu_context ctx;
 
+//スナップショットに入れるppu_contextのフィールド
+typedef struct {
+    pixel_fifo_context pfc;
+    u32 line_ticks;
+    u8 fetched_entry_count;
+    u8 line_sprite_count;
+    u8 window_line;
+    bool line_fast;
+    bool frame_skip;
+    oam_entry fetched_entries[3];
+    oam_entry line_sprites[10];
+} ppu_state;
+
 ppu_context *ppu_get_context() {
     return &ctx;
 }
 
+//ppu_init()より前に呼んでも良い
+void ppu_set_renderer(ppu_renderer renderer) {
+    ctx.renderer = renderer;
+}
+
+void ppu_skip_frame(bool skip) {
+    ctx.skip_request = skip;
+}
+
+void ppu_set_skip_interval(u8 interval) {
+    ctx.skip_interval = interval;
+}
+
 void ppu_init() {
+    //PPUスレッドが描画中のバッファを触らないように先に止める
+    ppu_thread_stop();
+
     ctx.current_frame = 0;
     ctx.line_ticks = 0;
-    ctx.video_buffer = malloc(YRES * XRES * sizeof(u32));
+    ctx.video_buffer = framebuf_back();
+    ctx.oam_ram = (oam_entry *)gb_arena.oam;
+    ctx.vram = gb_arena.vram;
 
     ctx.pfc.line_x = 0;
     ctx.pfc.pushed_x = 0;
     ctx.pfc.fetch_x = 0;
-    ctx.pfc.pixel_fifo.size = 0;
-    ctx.pfc.pixel_fifo.head = ctx.pfc.pixel_fifo.tail = NULL;
+    pipeline_fifo_reset();
+    pixel_init();
+    tile_cache_init(tile_cache_get());
+    bg_layer_init(bg_layer_get(0));
+    bg_layer_init(bg_layer_get(1));
     ctx.pfc.cur_fetch_state = FS_TILE;    
 
-    ctx.line_sprites = 0;
+    ctx.line_sprite_count = 0;
     ctx.fetched_entry_count = 0;
+    ctx.line_fast = false;
+    ctx.frame_skip = false;
+    ctx.skip_request = false;
 
     lcd_init();
     LCDS_MODE_SET(MODE_OAM);
 
-    memset(ctx.oam_ram, 0, sizeof(ctx.oam_ram));
-    memset(ctx.video_buffer, 0, YRES * XRES * sizeof(u32));
+    memset(gb_arena.oam, 0, sizeof(gb_arena.oam));
+    ppu_sprite_index_invalidate();
+    memset(ctx.video_buffer, 0, YRES * XRES);
+
+    //スレッドを起動できなければログが消費されず止まるので、スキャンラインで描く
+    if (ctx.renderer == PPU_RENDER_THREAD && !ppu_thread_start()) {
+        ppu_set_renderer(PPU_RENDER_SCANLINE);
+    }
 }
 
 void ppu_tick() {
+    //LCDオフ中はステートマシンを回さない
+    if (!LCDC_LCD_ENABLE) {
+        ppu_mode_lcd_off();
+        return;
+    }
+
     ctx.line_ticks++;
 
     switch(LCDS_MODE) {
@@ -51,13 +106,116 @@ void ppu_tick() {
     }
 }
 
+//オフにするとLY=0, モード0で止まり、STAT/VBLANK割り込みも発生しない。画面は白になる
+//オンにするとライン0のOAMスキャンから新しいフレームを始める。このフレームは表示されない
+void ppu_lcd_power(bool on) {
+    ctx.line_ticks = 0;
+    ctx.window_line = 0;
+    ctx.line_fast = false;
+    ctx.pfc.line_x = 0;
+    ctx.pfc.pushed_x = 0;
+    ctx.pfc.fetch_x = 0;
+    ctx.pfc.cur_fetch_state = FS_TILE;
+    pipeline_fifo_reset();
+
+    lcd_get_context()->ly = 0;
+
+    if (!on) {
+        LCDS_MODE_SET(MODE_HBLANK);
+
+        //PPUスレッドはLCDCの書き込みを受け取って自分で白い画面を出す
+        if (ctx.renderer == PPU_RENDER_THREAD) {
+            return;
+        }
+
+        memset(ctx.video_buffer, VIDEO_PIXEL(0, 0), YRES * XRES);
+        ctx.video_buffer = framebuf_publish();
+        return;
+    }
+
+    LCDS_MODE_SET(MODE_OAM);
+    LCDS_LYC_SET(lcd_get_context()->ly_compare == 0);
+    ctx.frame_skip = true;
+}
+
+//スプライトnが掛かるライン[y-16, y-16+height)のビットを立てる/落とす
+static void sprite_index_update(int n, u8 y, bool on) {
+    int top = y - 16;
+
+    for (int line = top < 0 ? 0 : top; line < top + ctx.sprites.height && line < SPRITE_INDEX_LINES; line++) {
+        if (on) {
+            ctx.sprites.lines[line] |= (1ULL << n);
+        } else {
+            ctx.sprites.lines[line] &= ~(1ULL << n);
+        }
+    }
+}
+
+static void sprite_index_rebuild(u8 height) {
+    memset(ctx.sprites.lines, 0, sizeof(ctx.sprites.lines));
+    ctx.sprites.height = height;
+    ctx.sprites.dirty = false;
+
+    for (int n=0; n<40; n++) {
+        sprite_index_update(n, ctx.oam_ram[n].y, true);
+    }
+}
+
+void ppu_sprite_index_invalidate() {
+    ctx.sprites.dirty = true;
+}
+
+//lyに掛かるスプライトのビットマスクを返す
+u64 ppu_sprite_index_line(u8 ly, u8 height) {
+    if (ctx.sprites.dirty || ctx.sprites.height != height) {
+        sprite_index_rebuild(height);
+    }
+
+    return ly < SPRITE_INDEX_LINES ? ctx.sprites.lines[ly] : 0;
+}
+
 void ppu_oam_write(u16 address, u8 value) {
     if(address >= 0xFE00) {
         address -= 0xFE00;
     }
 
     u8 *p = (u8 *)ctx.oam_ram;
+
+    if (ctx.line_fast && p[address] != value) {
+        ppu_scanline_fallback();
+    }
+
+    //Y座標が変わったらスプライトインデックスを差分更新
+    if (address < 0xA0 && !(address & 3) && !ctx.sprites.dirty && p[address] != value) {
+        sprite_index_update(address / 4, p[address], false);
+        sprite_index_update(address / 4, value, true);
+    }
+
     p[address] = value;
+
+    if (ctx.renderer == PPU_RENDER_THREAD && address < 0xA0) {
+        ppu_thread_write(0xFE00 + address, value);
+    }
+}
+
+//DMAは160バイトまとめて書き換えるのでインデックスは転送完了後に作り直す
+void ppu_oam_dma_write(u8 offset, u8 value) {
+    u8 *p = (u8 *)ctx.oam_ram;
+
+    if (ctx.line_fast && p[offset] != value) {
+        ppu_scanline_fallback();
+    }
+
+    p[offset] = value;
+    ctx.sprites.dirty = true;
+
+    if (ctx.renderer == PPU_RENDER_THREAD) {
+        ppu_thread_write(0xFE00 + offset, value);
+    }
+}
+
+void ppu_oam_dma_done() {
+    sprite_index_rebuild(ctx.sprites.height);
 }
 
 u8 ppu_oam_read(u16 address) {
@@ -70,9 +228,54 @@ u8 ppu_oam_read(u16 address) {
 }
 
 void ppu_vram_write(u16 address, u8 value) {
+    if (ctx.line_fast && ctx.vram[address - 0x8000] != value) {
+        ppu_scanline_fallback();
+    }
+
     ctx.vram[address - 0x8000] = value;
+    tile_cache_invalidate(tile_cache_get(), address - 0x8000);
+
+    if (ctx.renderer == PPU_RENDER_THREAD) {
+        ppu_thread_write(address, value);
+    }
 }
 
 u8 ppu_vram_read(u16 address) {
     return ctx.vram[address - 0x8000];
-}
\ No newline at end of file
+}
+
+u32 ppu_state_size() {
+    return sizeof(ppu_state);
+}
+
+void ppu_save_state(void *dst) {
+    ppu_state s = {
+        .pfc = ctx.pfc,
+        .line_ticks = ctx.line_ticks,
+        .fetched_entry_count = ctx.fetched_entry_count,
+        .line_sprite_count = ctx.line_sprite_count,
+        .window_line = ctx.window_line,
+        .line_fast = ctx.line_fast,
+        .frame_skip = ctx.frame_skip
+    };
+
+    memcpy(s.fetched_entries, ctx.fetched_entries, sizeof(s.fetched_entries));
+    memcpy(s.line_sprites, ctx.line_sprites, sizeof(s.line_sprites));
+    memcpy(dst, &s, sizeof(s));
+}
+
+void ppu_load_state(const void *src) {
+    ppu_state s;
+    memcpy(&s, src, sizeof(s));
+
+    ctx.pfc = s.pfc;
+    ctx.line_ticks = s.line_ticks;
+    ctx.fetched_entry_count = s.fetched_entry_count;
+    ctx.line_sprite_count = s.line_sprite_count;
+    ctx.window_line = s.window_line;
+    ctx.line_fast = s.line_fast;
+    ctx.frame_skip = s.frame_skip;
+    memcpy(ctx.fetched_entries, s.fetched_entries, sizeof(s.fetched_entries));
+    memcpy(ctx.line_sprites, s.line_sprites, sizeof(s.line_sprites));
+    ctx.sprites.dirty = true;
+}
@@ -1,6 +1,6 @@
 #include <ppu.h>
 #include <lcd.h>
-#include <bus.h>
+#include <pixel.h>
 
 bool window_visible() {
     return LCDC_WIN_ENABLE && lcd_get_context()->win_x >= 0 &&
@@ -8,36 +8,26 @@ bool window_visible() {
     lcd_get_context()->win_y < YRES;
 }
 
-void pixel_fifo_push(u32 value) {
-    fifo_entry *next = malloc(sizeof(fifo_entry));
-    next->next = NULL;
-    next->value = value;
-
-    if(!ppu_get_context()->pfc.pixel_fifo.head) {
-        ppu_get_context()->pfc.pixel_fifo.head = ppu_get_context()->pfc.pixel_fifo.tail = next;
-    } else {
-        ppu_get_context()->pfc.pixel_fifo.tail->next = next;
-        ppu_get_context()->pfc.pixel_fifo.tail = next;
-    }
-    ppu_get_context()->pfc.pixel_fifo.size++;
+static void pixel_fifo_push(fifo *f, u8 value) {
+    f->data[(f->head + f->size) & (FIFO_SIZE - 1)] = value;
+    f->size++;
 }
 
-u32 pixel_fifo_pop() {
-    if(ppu_get_context()->pfc.pixel_fifo.size <= 0) {
+static u8 pixel_fifo_pop(fifo *f) {
+    if(f->size <= 0) {
         fprintf(stderr, "ERR IN PIXEL FIFO!\n");
         exit(-8);
     }
 
-    fifo_entry *popped = ppu_get_context()->pfc.pixel_fifo.head;
-    ppu_get_context()->pfc.pixel_fifo.head = popped->next;
-    ppu_get_context()->pfc.pixel_fifo.size--;
-    u32 val = popped->value;
-    free(popped);
+    u8 val = f->data[f->head];
+    f->head = (f->head + 1) & (FIFO_SIZE - 1);
+    f->size--;
 
     return val;
 }
 
-u32 fetch_sprite_pixels(int bit, u32 color, u8 bg_color) {
+//このピクセルで表示されるスプライトのFIFOエントリを返す。無い場合は0(透明)
+u8 fetch_sprite_pixels(u8 bg_color) {
     for (int i=0; i<ppu_get_context()->fetched_entry_count; i++) {
         int sp_x = (ppu_get_context()->fetched_entries[i].x - 8) + 
             ((lcd_get_context()->scroll_x % 8));
@@ -55,40 +45,28 @@ u32 fetch_sprite_pixels(int bit, u32 color, u8 bg_color) {
             continue;
         }
 
-        //既にFIFOにプッシュされたスプライトピクセルの数
-        bit = (7 - offset);
-
-        if (ppu_get_context()->fetched_entries[i].f_x_flip) {
-            bit = offset;
-        }
-
-        u8 hi = !!(ppu_get_context()->pfc.fetch_entry_data[i * 2] & (1 << bit));
-        u8 lo = !!(ppu_get_context()->pfc.fetch_entry_data[(i * 2) + 1] & (1 << bit)) << 1;
+        //左右反転はFS_DATA1で展開したときに済ませている
+        u8 color = ppu_get_context()->pfc.fetch_entry_row[i][offset];
 
         bool bg_priority = ppu_get_context()->fetched_entries[i].f_bgp;
 
-        if (!(hi|lo)) {
+        if (!color) {
             //transparent
             continue;
         }
 
+        //スプライトの重なりを考慮した処理
+        //最前面のスプライトから順に処理してもし不透明なピクセルを描画したらそこで抜けて背面のスプライトは描画しない
         if (!bg_priority || bg_color == 0) {
-            color = (ppu_get_context()->fetched_entries[i].f_pn) ? 
-                lcd_get_context()->sp2_colors[hi|lo] : lcd_get_context()->sp1_colors[hi|lo];
-
-            //スプライトの重なりを考慮した処理
-            //最前面のスプライトから順に処理してもし不透明なピクセルを描画したらそこでforループを抜けて背面のスプライトは描画しない
-            if (hi|lo) {
-                break;
-            }
+            return FIFO_ENTRY(color, ppu_get_context()->fetched_entries[i].f_pn, bg_priority);
         }
     }
 
-    return color;
+    return 0;
 }
 
 bool pipeline_fifo_add() {
-    if (ppu_get_context()->pfc.pixel_fifo.size > 8) {
+    if (ppu_get_context()->pfc.bg_fifo.size > 8) {
         return false;
     }
 
@@ -96,22 +74,20 @@ bool pipeline_fifo_add() {
     int x = ppu_get_context()->pfc.fetch_x - (8 - (lcd_get_context()->scroll_x % 8));
 
     //フェッチしたデータからPixelカラーを計算してPixel FIFOにプッシュ
-    for(int i=0; i<8; i++) {
-        int bit = 7-i;
-        u8 lo = !!(ppu_get_context()->pfc.bgw_fetch_data[1] & (1 << bit));
-        u8 hi = !!(ppu_get_context()->pfc.bgw_fetch_data[2] & (1 << bit)) << 1;
-        u32 color = lcd_get_context()->bg_colors[hi | lo];
+    u8 row[8];
+    pixel_decode_row(ppu_get_context()->pfc.bgw_fetch_data[1], ppu_get_context()->pfc.bgw_fetch_data[2], row);
 
-        if(!LCDC_BGW_ENABLE) {
-            color = lcd_get_context()->bg_colors[0];
-        }
+    for(int i=0; i<8; i++) {
+        u8 bg = LCDC_BGW_ENABLE ? row[i] : 0;
+        u8 obj = 0;
 
         if(LCDC_OBJ_ENABLE) {
-            color = fetch_sprite_pixels(bit, color, hi | lo);
+            obj = fetch_sprite_pixels(row[i]);
         }
 
         if (x >= 0) {
-            pixel_fifo_push(color);
+            pixel_fifo_push(&ppu_get_context()->pfc.bg_fifo, bg);
+            pixel_fifo_push(&ppu_get_context()->pfc.obj_fifo, obj);
             ppu_get_context()->pfc.fifo_x++;
         }
     }
@@ -119,20 +95,13 @@ bool pipeline_fifo_add() {
 }
 
 void pipeline_load_sprite_tile() {
-    oam_line_entry *le = ppu_get_context()->line_sprites;
-    //ラインエントリがフェッチ中の8ピクセルに含まれるか判定
-    while(le) {
-        int sp_x = (le->entry.x - 8) + (lcd_get_context()->scroll_x % 8);
+    //ラインのスプライトがフェッチ中の8ピクセルに含まれるか判定。最大3個
+    for(int i=0; i<ppu_get_context()->line_sprite_count && ppu_get_context()->fetched_entry_count < 3; i++) {
+        int sp_x = (ppu_get_context()->line_sprites[i].x - 8) + (lcd_get_context()->scroll_x % 8);
+
         if((sp_x >= ppu_get_context()->pfc.fetch_x && sp_x < ppu_get_context()->pfc.fetch_x + 8) ||
             ((sp_x + 8) >= ppu_get_context()->pfc.fetch_x && (sp_x + 8) < ppu_get_context()->pfc.fetch_x + 8)) {
-                ppu_get_context()->fetched_entries[ppu_get_context()->fetched_entry_count++] = le->entry;
-            }
-
-            le = le->next;
-
-        if((!le || ppu_get_context()->fetched_entry_count >= 3)) {
-            ////最大3ラインエントリ
-            break;
+            ppu_get_context()->fetched_entries[ppu_get_context()->fetched_entry_count++] = ppu_get_context()->line_sprites[i];
         }
     }
 }
@@ -157,7 +126,7 @@ void pipeline_load_sprite_data(u8 offset) {
         }
 
         //各ラインエントリごとにスキャンライン上のタイルデータ(2BPP分)を取得
-        ppu_get_context()->pfc.fetch_entry_data[(i * 2) + offset] = bus_read(0x8000 + (tile_index * 16) + ty + offset);
+        ppu_get_context()->pfc.fetch_entry_data[(i * 2) + offset] = ppu_vram_read(0x8000 + (tile_index * 16) + ty + offset);
     }
 }
 
@@ -173,7 +142,7 @@ void pipeline_load_window_tile() {
         if (lcd_get_context()->ly >= window_y && lcd_get_context()->ly < window_y + YRES) {
             u8 w_tile_y = ppu_get_context()->window_line / 8;
 
-            ppu_get_context()->pfc.bgw_fetch_data[0] = bus_read(LCDC_WIN_MAP_AREA + 
+            ppu_get_context()->pfc.bgw_fetch_data[0] = ppu_vram_read(LCDC_WIN_MAP_AREA + 
                 ((ppu_get_context()->pfc.fetch_x + 7 - lcd_get_context()->win_x) / 8) +
                 (w_tile_y * 32));
 
@@ -192,7 +161,7 @@ void pipeline_fetch() {
             //タイルマップからピクセルフェッチャーがのっているタイルIDを取得
             //タイルマップは32×32タイル。1タイルは8×8ピクセル
             if(LCDC_BGW_ENABLE) {
-                ppu_get_context()->pfc.bgw_fetch_data[0] = bus_read(LCDC_BG_MAP_AREA + (ppu_get_context()->pfc.map_x / 8) + ((ppu_get_context()->pfc.map_y / 8) * 32));
+                ppu_get_context()->pfc.bgw_fetch_data[0] = ppu_vram_read(LCDC_BG_MAP_AREA + (ppu_get_context()->pfc.map_x / 8) + ((ppu_get_context()->pfc.map_y / 8) * 32));
 
                 //タイルデータ領域が0x8800の場合はタイルIDに128を足す
                 if(LCDC_BGW_DATA_AREA == 0x8800) {
@@ -202,7 +171,7 @@ void pipeline_fetch() {
                 pipeline_load_window_tile();
             }
 
-            if(LCDC_OBJ_ENABLE && ppu_get_context()->line_sprites) {
+            if(LCDC_OBJ_ENABLE && ppu_get_context()->line_sprite_count) {
                 pipeline_load_sprite_tile();
             }
 
@@ -213,7 +182,7 @@ void pipeline_fetch() {
         //タイルデータ領域からスキャンラインに対応する2BPPをフェッチする
         //1Tile(16バイト)×タイルID + タイル内Yオフセット
         case FS_DATA0: {
-            ppu_get_context()->pfc.bgw_fetch_data[1] = bus_read(LCDC_BGW_DATA_AREA + (ppu_get_context()->pfc.bgw_fetch_data[0] * 16) + ppu_get_context()->pfc.tile_y);
+            ppu_get_context()->pfc.bgw_fetch_data[1] = ppu_vram_read(LCDC_BGW_DATA_AREA + (ppu_get_context()->pfc.bgw_fetch_data[0] * 16) + ppu_get_context()->pfc.tile_y);
 
             pipeline_load_sprite_data(0);
 
@@ -221,10 +190,25 @@ void pipeline_fetch() {
         } break;
 
         case FS_DATA1: {
-            ppu_get_context()->pfc.bgw_fetch_data[2] = bus_read(LCDC_BGW_DATA_AREA + (ppu_get_context()->pfc.bgw_fetch_data[0] * 16) + ppu_get_context()->pfc.tile_y + 1);
+            ppu_get_context()->pfc.bgw_fetch_data[2] = ppu_vram_read(LCDC_BGW_DATA_AREA + (ppu_get_context()->pfc.bgw_fetch_data[0] * 16) + ppu_get_context()->pfc.tile_y + 1);
 
             pipeline_load_sprite_data(1);
-            
+
+            //スプライトの行を展開しておく。左右反転の場合は逆順にする
+            for(int i=0; i<ppu_get_context()->fetched_entry_count; i++) {
+                u8 *row = ppu_get_context()->pfc.fetch_entry_row[i];
+                pixel_decode_row(ppu_get_context()->pfc.fetch_entry_data[i * 2],
+                    ppu_get_context()->pfc.fetch_entry_data[(i * 2) + 1], row);
+
+                if(ppu_get_context()->fetched_entries[i].f_x_flip) {
+                    for(int x=0; x<4; x++) {
+                        u8 t = row[x];
+                        row[x] = row[7 - x];
+                        row[7 - x] = t;
+                    }
+                }
+            }
+
             ppu_get_context()->pfc.cur_fetch_state = FS_IDLE;
         } break;
 
@@ -242,8 +226,17 @@ void pipeline_fetch() {
 
 void pipeline_push_pixel() {
     //Pixel FIFOの大きさが8より大きくなったらPOPする
-    if(ppu_get_context()->pfc.pixel_fifo.size > 8) {
-        u32 pixel_data = pixel_fifo_pop();
+    if(ppu_get_context()->pfc.bg_fifo.size > 8) {
+        u8 bg = pixel_fifo_pop(&ppu_get_context()->pfc.bg_fifo);
+        u8 obj = pixel_fifo_pop(&ppu_get_context()->pfc.obj_fifo);
+
+        //パレットはFIFOから取り出すときに適用する
+        u8 pixel_data = lcd_get_context()->bg_colors[FIFO_COLOR(bg)];
+
+        if (FIFO_COLOR(obj)) {
+            pixel_data = FIFO_PALETTE(obj) ? lcd_get_context()->sp2_colors[FIFO_COLOR(obj)] :
+                lcd_get_context()->sp1_colors[FIFO_COLOR(obj)];
+        }
 
         //Pixel FIFOにはタイル単位でピクセルがプッシュされるので、スクロール範囲内にない場合はピクセルを破棄する
         //LCDスクリーン範囲内にある場合はピクセルをラインの端から順に敷き詰める
@@ -272,9 +265,51 @@ void pipeline_process() {
 }
 
 void pipeline_fifo_reset() {
-    while(ppu_get_context()->pfc.pixel_fifo.size) {
-        pixel_fifo_pop();
+    ppu_get_context()->pfc.bg_fifo.head = ppu_get_context()->pfc.bg_fifo.size = 0;
+    ppu_get_context()->pfc.obj_fifo.head = ppu_get_context()->pfc.obj_fifo.size = 0;
+}
+//スキャンラインレンダラー用。ピクセルは描画済みなのでフェッチャーとFIFOのタイミングだけを進める
+//フェッチャーの状態遷移とFIFOのサイズはpipeline_process()と同じになる
+void pipeline_timing_process() {
+    pixel_fifo_context *pfc = &ppu_get_context()->pfc;
+    u8 fine_x = lcd_get_context()->scroll_x % 8;
+
+    if(!(ppu_get_context()->line_ticks & 1)) {
+        switch(pfc->cur_fetch_state) {
+            case FS_TILE:
+                pfc->fetch_x += 8;
+                pfc->cur_fetch_state = FS_DATA0;
+                break;
+            case FS_DATA0:
+                pfc->cur_fetch_state = FS_DATA1;
+                break;
+            case FS_DATA1:
+                pfc->cur_fetch_state = FS_IDLE;
+                break;
+            case FS_IDLE:
+                pfc->cur_fetch_state = FS_PUSH;
+                break;
+            case FS_PUSH:
+                if(pfc->bg_fifo.size <= 8) {
+                    if(pfc->fetch_x >= 8 - fine_x) {
+                        pfc->bg_fifo.size += 8;
+                        pfc->obj_fifo.size += 8;
+                        pfc->fifo_x += 8;
+                    }
+
+                    pfc->cur_fetch_state = FS_TILE;
+                }
+                break;
+        }
     }
 
-    ppu_get_context()->pfc.pixel_fifo.head = 0;
-}
\ No newline at end of file
+    if(pfc->bg_fifo.size > 8) {
+        pfc->bg_fifo.size--;
+        pfc->obj_fifo.size--;
+
+        if(pfc->line_x >= fine_x) {
+            pfc->pushed_x++;
+        }
+        pfc->line_x++;
+    }
+}
@@ -0,0 +1,228 @@
+#include <ppu.h>
+#include <lcd.h>
+#include <tile_cache.h>
+#include <pixel.h>
+#include <string.h>
+
+//スキャンラインレンダラー
+//モード3の開始時にBG/Window/スプライトを1ライン分まとめて描画する。
+//モード3の間はpipeline_timing_process()でフェッチャーのタイミングだけを進めてHBLANKへの遷移を合わせる。
+//モード3中に描画に影響する書き込みがあった場合はppu_scanline_fallback()でPixel FIFOに切り替える。
+//出力はPixel FIFOとビット単位で一致させる
+
+static ppu_line_state line_state;
+static u32 line_start_ticks;
+
+static bool line_window_visible(const ppu_line_state *st) {
+    return BIT(st->lcdc, 5) && st->win_x <= 166 && st->win_y < YRES;
+}
+
+//フェッチャーがfetch_xのFS_TILEで読み込むタイルIDを返す(LCDC.0が1の場合)
+u8 ppu_line_tile(const ppu_line_state *st, int fetch_x) {
+    u8 map_x = fetch_x + st->scroll_x;
+    u8 map_y = st->ly + st->scroll_y;
+    u16 bg_map = BIT(st->lcdc, 3) ? 0x1C00 : 0x1800;
+    u8 tile = st->vram[bg_map + (map_x / 8) + ((map_y / 8) * 32)];
+
+    if (line_window_visible(st) && fetch_x + 7 >= st->win_x &&
+            fetch_x + 7 < st->win_x + XRES + 14 &&
+            st->ly >= st->win_y && st->ly < st->win_y + YRES) {
+        u16 win_map = BIT(st->lcdc, 6) ? 0x1C00 : 0x1800;
+        tile = st->vram[win_map + ((fetch_x + 7 - st->win_x) / 8) + ((st->window_line / 8) * 32)];
+    }
+
+    //タイルデータ領域が0x8800の場合はタイルIDに128を足す
+    if (!BIT(st->lcdc, 4)) {
+        tile += 128;
+    }
+
+    return tile;
+}
+
+void ppu_render_line(const ppu_line_state *st, u8 *line) {
+    u8 fine_x = st->scroll_x % 8;
+    bool bgw_enable = BIT(st->lcdc, 0);
+    bool obj_enable = BIT(st->lcdc, 1);
+    u8 sprite_height = BIT(st->lcdc, 2) ? 16 : 8;
+    u16 tile_base = BIT(st->lcdc, 4) ? 0 : 128;
+    u8 tile_row = (st->ly + st->scroll_y) % 8;
+
+    //スプライトのスキャンライン上の行をタイルキャッシュから引いておく。左右反転も済ませる
+    const u8 *sp_row[10];
+    int sp_x[10];
+
+    for (int i=0; i<st->sprite_count; i++) {
+        const oam_entry *e = &st->sprites[i];
+        u8 ty = ((st->ly + 16) - e->y) * 2;
+
+        if (e->f_y_flip) {
+            ty = ((sprite_height * 2) - 2) - ty;
+        }
+
+        u8 tile_index = e->tile;
+
+        if (sprite_height == 16) {
+            tile_index &= ~(1);
+        }
+
+        sp_row[i] = tile_cache_row(st->tiles, st->vram, tile_index + (ty / 16), (ty / 2) % 8, e->f_x_flip);
+        sp_x[i] = (e->x - 8) + fine_x;
+    }
+
+    //FIFO上のx座標(fifo_x)はスクリーンのx座標+SCX%8。8ピクセル単位でフェッチする
+    //まずBG/Windowのカラー番号を1ライン分並べてからパレットでまとめて変換する
+    int last_fetch_x = XRES - 1 + fine_x;
+    int fetch_end = (last_fetch_x & ~7) + 8;
+    u8 bg_line[XRES + 8];
+
+    if (bgw_enable) {
+        //BGはレイヤーキャッシュの行をSCXから折り返してコピー。FIFO上のx=0はマップのSCX&~7
+        u8 map_y = st->ly + st->scroll_y;
+        const u8 *row = bg_layer_row(&st->layers[BIT(st->lcdc, 3)], st->tiles, st->vram,
+            BIT(st->lcdc, 3) ? 0x1C00 : 0x1800, BIT(st->lcdc, 4), map_y, st->scroll_x / 8, fetch_end / 8);
+        bg_layer_copy_row(row, st->scroll_x & ~7, bg_line, fetch_end);
+
+        //Windowが掛かるチャンクを上書き。Window内の行はwindow_lineではなくSCY+LYの下位3ビットになる
+        if (line_window_visible(st) && st->ly >= st->win_y && st->ly < st->win_y + YRES) {
+            u8 win_y = (st->window_line & ~7) | (map_y & 7);
+            bg_layer *win = &st->layers[BIT(st->lcdc, 6)];
+            u16 win_map = BIT(st->lcdc, 6) ? 0x1C00 : 0x1800;
+
+            for (int fetch_x = 0; fetch_x < fetch_end; fetch_x += 8) {
+                if (fetch_x + 7 < st->win_x || fetch_x + 7 >= st->win_x + XRES + 14) {
+                    continue;
+                }
+
+                int cell = (fetch_x + 7 - st->win_x) / 8;
+                const u8 *win_row = bg_layer_row(win, st->tiles, st->vram, win_map, BIT(st->lcdc, 4), win_y, cell, 1);
+                memcpy(bg_line + fetch_x, win_row + ((cell & 31) * 8), 8);
+            }
+        }
+
+        pixel_map_row(bg_line + fine_x, st->bg_colors, line, XRES);
+    } else {
+        //LCDC.0が0の場合は前回のタイルIDが使い回される(スプライトのBG優先判定にだけ効く)
+        const u8 *stale = tile_cache_row(st->tiles, st->vram, tile_base + st->stale_tile, tile_row, false);
+
+        for (int fetch_x = 0; fetch_x < fetch_end; fetch_x += 8) {
+            memcpy(bg_line + fetch_x, stale, 8);
+        }
+
+        memset(line, st->bg_colors[0], XRES);
+    }
+
+    if (!obj_enable || !st->sprite_count) {
+        return;
+    }
+
+    //スプライトを重ねる。LCDC.0が0でもBG優先の判定にはフェッチしたカラー番号を使う
+    for (int fetch_x = 0; fetch_x <= last_fetch_x; fetch_x += 8) {
+        //フェッチ中の8ピクセルに掛かるスプライトは最大3個
+        u8 fetched[3];
+        int fetched_count = 0;
+
+        for (int i=0; i<st->sprite_count && fetched_count < 3; i++) {
+            if (sp_x[i] >= fetch_x - 8 && sp_x[i] < fetch_x + 8) {
+                fetched[fetched_count++] = i;
+            }
+        }
+
+        for (int i=0; fetched_count && i<8; i++) {
+            int n = fetch_x + i;
+            int x = n - fine_x;
+
+            if (x < 0 || x >= XRES) {
+                continue;
+            }
+
+            for (int j=0; j<fetched_count; j++) {
+                const oam_entry *e = &st->sprites[fetched[j]];
+                int offset = n - sp_x[fetched[j]];
+
+                if (offset < 0 || offset > 7) {
+                    continue;
+                }
+
+                u8 c = sp_row[fetched[j]][offset];
+
+                if (!c) {
+                    continue;
+                }
+
+                //最前面の不透明なピクセルで決まる。BG優先でBGが0以外なら背面のスプライトを見る
+                if (!e->f_bgp || bg_line[n] == 0) {
+                    line[x] = e->f_pn ? st->sp2_colors[c] : st->sp1_colors[c];
+                    break;
+                }
+            }
+        }
+    }
+}
+
+//モード3の開始時に呼ばれる。現在の状態を保存して1ライン分描画する
+void ppu_scanline_begin() {
+    ppu_context *ctx = ppu_get_context();
+    lcd_context *lcd = lcd_get_context();
+    ppu_line_state *st = &line_state;
+
+    st->vram = ctx->vram;
+    st->tiles = tile_cache_get();
+    st->layers = bg_layer_get(0);
+    st->lcdc = lcd->lcdc;
+    st->ly = lcd->ly;
+    st->scroll_y = lcd->scroll_y;
+    st->scroll_x = lcd->scroll_x;
+    st->win_y = lcd->win_y;
+    st->win_x = lcd->win_x;
+    st->window_line = ctx->window_line;
+    st->stale_tile = ctx->pfc.bgw_fetch_data[0];
+    st->sprite_count = ctx->line_sprite_count;
+    memcpy(st->sprites, ctx->line_sprites, sizeof(oam_entry) * ctx->line_sprite_count);
+
+    memcpy(st->bg_colors, lcd->bg_colors, sizeof(st->bg_colors));
+    memcpy(st->sp1_colors, lcd->sp1_colors, sizeof(st->sp1_colors));
+    memcpy(st->sp2_colors, lcd->sp2_colors, sizeof(st->sp2_colors));
+
+    ppu_render_line(st, ctx->video_buffer + (st->ly * XRES));
+
+    line_start_ticks = ctx->line_ticks;
+    ctx->line_fast = true;
+}
+
+//モード3の終了時に呼ばれる。次のラインのためにフェッチャーが最後に読んだタイルIDを残す
+void ppu_scanline_end() {
+    ppu_context *ctx = ppu_get_context();
+
+    if (!ctx->line_fast) {
+        return;
+    }
+
+    if (BIT(line_state.lcdc, 0)) {
+        ctx->pfc.bgw_fetch_data[0] = ppu_line_tile(&line_state, ctx->pfc.fetch_x - 8);
+    }
+
+    ctx->line_fast = false;
+}
+
+//モード3中に描画に影響する書き込みがあった場合に、値が書き換わる前に呼ばれる。
+//モード3の開始時からここまでのドットをPixel FIFOで再実行して、このラインの残りはドット単位で描画する
+void ppu_scanline_fallback() {
+    ppu_context *ctx = ppu_get_context();
+    u32 now = ctx->line_ticks;
+
+    ctx->line_fast = false;
+
+    ctx->pfc.cur_fetch_state = FS_TILE;
+    ctx->pfc.line_x = 0;
+    ctx->pfc.fetch_x = 0;
+    ctx->pfc.pushed_x = 0;
+    ctx->pfc.fifo_x = 0;
+    ctx->pfc.bgw_fetch_data[0] = line_state.stale_tile;
+    pipeline_fifo_reset();
+
+    for (ctx->line_ticks = line_start_ticks + 1; ctx->line_ticks <= now; ctx->line_ticks++) {
+        pipeline_process();
+    }
+
+    ctx->line_ticks = now;
+}
@@ -5,7 +5,10 @@
 #include <ppu_sm.h>
 #include <common.h>
 #include <string.h>
-#include <cart.h>
+#include <cheat.h>
+#include <framebuf.h>
+#include <ppu_thread.h>
+#include <vram_view.h>
 
 //lyをインクリメント。
 //lyがly_compareに等しい場合はSTAT割り込みをリクエスト。
@@ -30,68 +33,38 @@ void increment_ly() {
     }
 }
 
+//スプライトインデックスから現在のラインに掛かるスプライトを取り出す
+//OAMの順に最大10個(x座標が0のものは数えない)をx座標が小さい順に並べる。x座標が同じ場合はOAMの順
 void load_line_sprites() {
-    int cur_y = lcd_get_context()->ly;
+    ppu_context *ctx = ppu_get_context();
+    u64 mask = ppu_sprite_index_line(lcd_get_context()->ly, LCDC_OBJ_HEIGHT);
 
-    u8 sprite_height = LCDC_OBJ_HEIGHT;
-    memset(ppu_get_context()->line_entry_array, 0, sizeof(ppu_get_context()->line_entry_array));
+    ctx->line_sprite_count = 0;
 
-    //最大40個のスプライトそれぞれがスキャンライン上にあるか個別に確認
-    for(int i=0; i<40; i++) {
-        oam_entry e = ppu_get_context()->oam_ram[i];
-
-        if(!e.x) {
+    for (int n=0; mask && ctx->line_sprite_count < 10; n++, mask >>= 1) {
+        if (!(mask & 1)) {
             continue;
         }
 
-        //スキャンライン上のスプライトは最大10個
-        if(ppu_get_context()->line_sprite_count>=10) {
-            break;
-        }
-
-        //スプライトがスキャンラインをまたいでいる場合にラインエントリを追加する
-        if(e.y - 16 <= cur_y && e.y - 16 + sprite_height > cur_y) {
-            //ラインエントリは最大10で固定なのでmalloc()/free()しないで予め配列でメモリを確保してポインタで参照する
-            oam_line_entry *entry = &ppu_get_context()->line_entry_array[ppu_get_context()->line_sprite_count++];
-            
-            entry->entry = e;
-            entry->next = NULL;
-
-            //line_spritesは先頭のラインエントリを指す
-            //以下先頭にラインエントリを追加する場合の処理
-            if(!ppu_get_context()->line_sprites || ppu_get_context()->line_sprites->entry.x > e.x) {
-                entry->next = ppu_get_context()->line_sprites;
-                ppu_get_context()->line_sprites = entry;
-                continue;
-            }
-
-            //以下先頭以外の位置にラインエントリを挿入する処理
-            //ラインエントリはx座標が小さい順になるように並べる
-            oam_line_entry *le = ppu_get_context()->line_sprites;
-            oam_line_entry *prev = le;
+        oam_entry e = ctx->oam_ram[n];
 
-            while(le) {
+        if (!e.x) {
+            continue;
+        }
 
-                if(le->entry.x > e.x) {
-                    prev->next = entry;
-                    entry->next = le;
-                    break;
-                }
+        int i = ctx->line_sprite_count++;
 
-                if(!le->next) {
-                    le->next = entry;
-                    break;
-                }
-
-                prev = le;
-                le = le->next;
-            }
+        while (i > 0 && ctx->line_sprites[i - 1].x > e.x) {
+            ctx->line_sprites[i] = ctx->line_sprites[i - 1];
+            i--;
         }
+
+        ctx->line_sprites[i] = e;
     }
 }
 
 //line_ticksが80以上になったらMODE_XFERに遷移。
-//Pixel FIFOを初期化
+//Pixel FIFOを初期化。スキャンラインレンダラーの場合はここで1ライン分描画する
 void ppu_mode_oam() {
     if(ppu_get_context()->line_ticks >= 80) {
         LCDS_MODE_SET(MODE_XFER);
@@ -101,12 +74,19 @@ void ppu_mode_oam() {
         ppu_get_context()->pfc.fetch_x = 0;
         ppu_get_context()->pfc.pushed_x = 0;
         ppu_get_context()->pfc.fifo_x = 0;
-    }
 
-    if(ppu_get_context()->line_ticks == 1) {
-        ppu_get_context()->line_sprites = 0;
-        ppu_get_context()->line_sprite_count = 0;
+        if(!ppu_get_context()->frame_skip) {
+            if(ppu_get_context()->renderer == PPU_RENDER_SCANLINE) {
+                ppu_scanline_begin();
+            } else if(ppu_get_context()->renderer == PPU_RENDER_THREAD) {
+                ppu_thread_line(lcd_get_context()->ly, ppu_get_context()->window_line);
+            }
+        }
+    }
 
+    //描画しないフレームとPPUスレッドで描画する場合はOAMスキャンも不要
+    if(ppu_get_context()->line_ticks == 1 && !ppu_get_context()->frame_skip &&
+        ppu_get_context()->renderer != PPU_RENDER_THREAD) {
         load_line_sprites();
     }
 }
@@ -115,9 +95,20 @@ void ppu_mode_oam() {
 //現在のラインで転送されたピクセルの数が画面の横幅(XRES)に達したら、FIFOをリセットして、MODE_HBLANKに遷移
 //HBLANK割り込みが有効な場合STAT割り込みを実行
 void ppu_mode_xfer() {
-    pipeline_process();
+    if(ppu_get_context()->line_fast || ppu_get_context()->frame_skip ||
+        ppu_get_context()->renderer == PPU_RENDER_THREAD) {
+        pipeline_timing_process();
+    } else {
+        pipeline_process();
+    }
 
     if(ppu_get_context()->pfc.pushed_x >= XRES) {
+        ppu_scanline_end();
+
+        if(ppu_get_context()->renderer == PPU_RENDER_THREAD && !ppu_get_context()->frame_skip) {
+            ppu_thread_line_end(ppu_get_context()->pfc.fetch_x);
+        }
+
         pipeline_fifo_reset();
 
         LCDS_MODE_SET(MODE_HBLANK);
@@ -131,35 +122,31 @@ void ppu_mode_xfer() {
 //line_ticksがTICKS_PER_LINEをこえたらlyをインクリメント。
 //lyがLINES_PER_FRAME以上になったらMODE_OAMに遷移して、lyを0にリセット。
 void ppu_mode_vblank() {
-    if(ppu_get_context()->line_ticks >= TICKS_PER_LINE) {
+    if(ppu_get_context()->line_ticks >= (u32)TICKS_PER_LINE) {
         increment_ly();
 
         if(lcd_get_context()->ly >= LINES_PER_FRAME) {
             LCDS_MODE_SET(MODE_OAM);
             lcd_get_context()->ly = 0;
             ppu_get_context()->window_line = 0;
+            ppu_get_context()->frame_skip = ppu_get_context()->skip_request ||
+                (ppu_get_context()->skip_interval > 1 &&
+                 ppu_get_context()->current_frame % ppu_get_context()->skip_interval);
         }
 
         ppu_get_context()->line_ticks = 0;
     }
 }
 
-static u32 target_frame_time = 1000 / 60; //1フレームの秒数ターゲット。Target frame time = 1000ms(1 second) / 60 FPS (Target FPS)
-static long prev_frame_time = 0;
-static long start_timer = 0;
-static long frame_count = 0;
-
 //line_ticksがTICKS_PER_LINEをこえたらlyをインクリメント。
 //lyがYRESより小さい場合はMODE_OAMに遷移。
 //lyがYRES以上になったらMODE_VBLANKに遷移して以下を実行。
 //1. VBLANK割り込みをリクエスト。
 //2. LCDSレジスタでVBLANK割り込みが有効な場合はSTAT割り込みをリクエスト。
-//3. FPS関連処理を実行
-// 3-1. フレーム時間が60FPS想定のターゲットフレーム時間より小さい場合はdelayさせる
-// 3-2. 1000ms経過したらフレームカウントを表示して初期化。
+//3. デバッグ表示用のスナップショットを取り、描画したフレームを公開してcurrent_frameを進める(ホストの時間への調整はpacer.cで行う)
 
 void ppu_mode_hblank() {
-    if (ppu_get_context()->line_ticks >= TICKS_PER_LINE) {
+    if (ppu_get_context()->line_ticks >= (u32)TICKS_PER_LINE) {
         increment_ly();
 
         if(lcd_get_context()->ly >= YRES) {
@@ -171,32 +158,36 @@ void ppu_mode_hblank() {
                 cpu_request_interrupt(IT_LCD_STAT);
             }
 
-            ppu_get_context()->current_frame++;
-
-            u32 end = get_ticks();
-            u32 frame_time = end - prev_frame_time;
-
-            if(frame_time < target_frame_time) {
-                delay((target_frame_time - frame_time));
-            }
+            cheat_apply_frame();
 
-            if(end - start_timer >= 1000) {
-                u32 fps = frame_count;
-                start_timer = end;
-                frame_count = 0;
+            //デバッグ表示が頼んでいればVRAM/OAMを写す
+            vram_view_capture();
 
-                printf("FPS: %d\n", fps);
-
-                if(cart_need_save()) {
-                    cart_battery_save();
+            //描画し終えたフレームを公開して次のバッファに切り替える
+            //PPUスレッドで描画する場合はPPUスレッドが公開する
+            if(!ppu_get_context()->frame_skip) {
+                if(ppu_get_context()->renderer == PPU_RENDER_THREAD) {
+                    ppu_thread_frame();
+                } else {
+                    ppu_get_context()->video_buffer = framebuf_publish();
                 }
             }
 
-            frame_count++;
-            prev_frame_time = get_ticks();
+            ppu_get_context()->current_frame++;
         }  else {
             LCDS_MODE_SET(MODE_OAM);
         }
         ppu_get_context()->line_ticks = 0;
     }
-}
\ No newline at end of file
+}
+
+//LCDオフ中はLYとモードを止めたまま、1フレーム分の時間を数えてcurrent_frameだけ進める
+void ppu_mode_lcd_off() {
+    if(++ppu_get_context()->line_ticks >= (u32)(LINES_PER_FRAME * TICKS_PER_LINE)) {
+        ppu_get_context()->line_ticks = 0;
+        ppu_get_context()->current_frame++;
+
+        //VBLANKが来なくてもデバッグ表示は更新する
+        vram_view_capture();
+    }
+}
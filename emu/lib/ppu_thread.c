@@ -0,0 +1,590 @@
+#include <ppu_thread.h>
+#include <ppu.h>
+#include <lcd.h>
+#include <mem.h>
+#include <video.h>
+#include <framebuf.h>
+#include <tile_cache.h>
+#include <bg_layer.h>
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <stdlib.h>
+
+//CPUスレッドが積んでPPUスレッドが読むリングバッファ(単一プロデューサー/単一コンシューマー)
+typedef struct {
+    ppu_log_entry entries[PPU_LOG_SIZE];
+    CACHE_ALIGNED _Atomic u32 head;     //CPUスレッドだけが書く
+    CACHE_ALIGNED _Atomic u32 tail;     //PPUスレッドだけが書く
+} ppu_log;
+
+//PPUスレッドが持つVRAM/OAM/LCDレジスタのコピーとキャッシュ
+typedef struct {
+    u8 vram[0x2000];
+    u8 oam[0xA0];
+    u8 regs[12];            //0xFF40-0xFF4B
+    u8 colors[12];          //bg_colors, sp1_colors, sp2_colors
+    u8 stale_tile;
+    u32 tile_writes[TILE_COUNT];    //タイル毎の書き込み回数。チェックポイントとの差分に使う
+    ppu_line_state line;    //描画中のライン
+    tile_cache tiles;
+    bg_layer layers[2];
+} ppu_shadow;
+
+//チャンクの最初のラインの直前の状態。ワーカーはここから自分のチャンクのログだけを反映する
+typedef struct {
+    u8 vram[0x2000];
+    u8 oam[0xA0];
+    u8 regs[12];
+    u8 colors[12];
+    u8 stale_tile;
+    u32 tile_writes[TILE_COUNT];
+} ppu_checkpoint;
+
+//フレームを分割して描画するワーカー。workers[0]はPPUスレッド自身
+typedef struct {
+    pthread_t thread;
+    ppu_shadow shadow;
+} ppu_worker;
+
+//分割描画の単位。空いたワーカーが次のチャンクを取っていく
+#define PPU_CHUNK_LINES 8
+#define PPU_CHUNK_COUNT (144 / PPU_CHUNK_LINES)
+
+static ppu_log log_buf;
+static ppu_shadow shadow;
+
+static pthread_t thread;
+static _Atomic bool running = false;
+static _Atomic u32 frames_rendered = 0;
+static u32 frames_pushed = 0;
+
+static int render_threads = 1;
+static ppu_worker *workers = NULL;
+static int worker_count = 0;        //起動できたワーカーの数(PPUスレッドを含む)
+
+//フレームの最初のラインからVBLANKまでのログ。分割描画のときだけ使う
+static ppu_log_entry *pending = NULL;
+static u32 pending_count = 0;
+static u32 pending_size = 0;
+
+//チャンク毎のチェックポイントと、pendingの中でのチャンクの範囲。ラインが来なかったチャンクは-1
+static ppu_checkpoint checkpoints[PPU_CHUNK_COUNT];
+static int chunk_first[PPU_CHUNK_COUNT];
+static int chunk_last[PPU_CHUNK_COUNT];
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static u32 pool_generation = 0;
+static bool pool_quit = false;
+static u8 *pool_frame = NULL;
+static _Atomic int next_chunk = PPU_CHUNK_COUNT;
+static _Atomic int chunks_done = 0;
+
+//描画が遅れてもCPUスレッドはこのフレーム数までしか先に進まない
+#define PPU_THREAD_MAX_LAG 1
+
+//スレッド間で待つ条件ごとの寝床。起こす側は寝ているスレッドがいるときだけロックを取る
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    _Atomic int sleepers;
+} ppu_wake;
+
+#define PPU_WAKE_INITIALIZER { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 }
+
+static ppu_wake log_wake = PPU_WAKE_INITIALIZER;     //PPUスレッドがログを待つ
+static ppu_wake space_wake = PPU_WAKE_INITIALIZER;   //CPUスレッドがログの空きと描画を待つ
+static ppu_wake chunk_wake = PPU_WAKE_INITIALIZER;   //PPUスレッドがワーカーの描画を待つ
+
+//寝る前にyieldで回す回数
+#define PPU_WAIT_SPINS 64
+
+//readyになるまで待つ。しばらくはyieldで回し、それでも進まなければwake_signal()まで寝る
+static void wake_wait(ppu_wake *w, bool (*ready)()) {
+    for (int i=0; i<PPU_WAIT_SPINS; i++) {
+        if (ready()) {
+            return;
+        }
+
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&w->lock);
+    atomic_fetch_add(&w->sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while (!ready()) {
+        pthread_cond_wait(&w->cond, &w->lock);
+    }
+
+    atomic_fetch_sub(&w->sleepers, 1);
+    pthread_mutex_unlock(&w->lock);
+}
+
+//条件を進めた後に呼ぶ。フェンスでsleepersを読む前に条件の書き込みを見えるようにする
+static void wake_signal(ppu_wake *w) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&w->sleepers, memory_order_relaxed)) {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+static bool log_readable() {
+    return atomic_load_explicit(&log_buf.head, memory_order_acquire) != atomic_load_explicit(&log_buf.tail, memory_order_relaxed) ||
+        !atomic_load_explicit(&running, memory_order_acquire);
+}
+
+static bool log_writable() {
+    return atomic_load_explicit(&log_buf.head, memory_order_relaxed) - atomic_load_explicit(&log_buf.tail, memory_order_acquire) < PPU_LOG_SIZE;
+}
+
+static bool frame_caught_up() {
+    return frames_pushed - atomic_load_explicit(&frames_rendered, memory_order_acquire) <= PPU_THREAD_MAX_LAG;
+}
+
+static bool chunks_finished() {
+    return atomic_load_explicit(&chunks_done, memory_order_acquire) >= PPU_CHUNK_COUNT;
+}
+
+static void log_push(u8 type, u16 address, u8 value) {
+    u32 head = atomic_load_explicit(&log_buf.head, memory_order_relaxed);
+
+    //満杯のときは寝ているPPUスレッドを起こしてから空くのを待つ
+    if (!log_writable()) {
+        wake_signal(&log_wake);
+        wake_wait(&space_wake, log_writable);
+    }
+
+    ppu_log_entry *e = &log_buf.entries[head & (PPU_LOG_SIZE - 1)];
+    e->address = address;
+    e->value = value;
+    e->type = type;
+
+    atomic_store_explicit(&log_buf.head, head + 1, memory_order_release);
+
+    //PPUスレッドを起こすのはラインとフレームの区切りとLCDCの書き込み(LCDオフの白画面)だけ
+    //間の書き込みは次の区切りでまとめて処理される
+    if (type == PPU_LOG_LINE || type == PPU_LOG_FRAME || (type == PPU_LOG_WRITE && address == 0xFF40)) {
+        wake_signal(&log_wake);
+    }
+}
+
+//OAMの順に最大10個(x座標が0のものは数えない)をx座標が小さい順に並べる。load_line_sprites()と同じ規則
+static void shadow_line_sprites(const ppu_shadow *sh, ppu_line_state *st) {
+    const oam_entry *oam = (const oam_entry *)sh->oam;
+    u8 height = BIT(st->lcdc, 2) ? 16 : 8;
+
+    st->sprite_count = 0;
+
+    for (int n=0; n<40 && st->sprite_count < 10; n++) {
+        oam_entry e = oam[n];
+
+        if (st->ly + 16 < e.y || st->ly + 16 >= e.y + height || !e.x) {
+            continue;
+        }
+
+        int i = st->sprite_count++;
+
+        while (i > 0 && st->sprites[i - 1].x > e.x) {
+            st->sprites[i] = st->sprites[i - 1];
+            i--;
+        }
+
+        st->sprites[i] = e;
+    }
+}
+
+//ppu_scanline_begin()と同じ状態をコピーから作る。frameがNULLでなければ1ライン描画する
+static void shadow_line(ppu_shadow *sh, u8 ly, u8 window_line, u8 *frame) {
+    ppu_line_state *st = &sh->line;
+
+    st->vram = sh->vram;
+    st->tiles = &sh->tiles;
+    st->layers = sh->layers;
+    st->lcdc = sh->regs[0];
+    st->ly = ly;
+    st->scroll_y = sh->regs[2];
+    st->scroll_x = sh->regs[3];
+    st->win_y = sh->regs[10];
+    st->win_x = sh->regs[11];
+    st->window_line = window_line;
+    st->stale_tile = sh->stale_tile;
+
+    if (!frame) {
+        return;
+    }
+
+    memcpy(st->bg_colors, sh->colors, 4);
+    memcpy(st->sp1_colors, sh->colors + 4, 4);
+    memcpy(st->sp2_colors, sh->colors + 8, 4);
+
+    shadow_line_sprites(sh, st);
+
+    ppu_render_line(st, frame + (ly * XRES));
+}
+
+//ログのエントリを1つ反映する。frameがNULLの場合は描画せずに状態だけ進める
+static void shadow_apply(ppu_shadow *sh, const ppu_log_entry *e, u8 *frame) {
+    switch(e->type) {
+        case PPU_LOG_WRITE:
+            if (e->address >= 0xFF40) {
+                sh->regs[e->address - 0xFF40] = e->value;
+            } else if (e->address >= 0xFE00) {
+                sh->oam[e->address - 0xFE00] = e->value;
+            } else {
+                sh->vram[e->address - 0x8000] = e->value;
+                tile_cache_invalidate(&sh->tiles, e->address - 0x8000);
+
+                if (e->address - 0x8000 < TILE_COUNT * 16) {
+                    sh->tile_writes[(e->address - 0x8000) / 16]++;
+                }
+            }
+            break;
+        case PPU_LOG_COLOR:
+            sh->colors[e->address] = e->value;
+            break;
+        case PPU_LOG_LINE:
+            shadow_line(sh, e->address, e->value, frame);
+            break;
+        case PPU_LOG_LINE_END:
+            //次のラインのためにフェッチャーが最後に読んだタイルIDを残す(ppu_scanline_end()と同じ)
+            if (BIT(sh->line.lcdc, 0)) {
+                sh->stale_tile = ppu_line_tile(&sh->line, e->value - 8);
+            }
+            break;
+    }
+}
+
+static void checkpoint_save(ppu_checkpoint *cp, const ppu_shadow *sh) {
+    memcpy(cp->vram, sh->vram, sizeof(cp->vram));
+    memcpy(cp->oam, sh->oam, sizeof(cp->oam));
+    memcpy(cp->regs, sh->regs, sizeof(cp->regs));
+    memcpy(cp->colors, sh->colors, sizeof(cp->colors));
+    cp->stale_tile = sh->stale_tile;
+    memcpy(cp->tile_writes, sh->tile_writes, sizeof(cp->tile_writes));
+}
+
+//チェックポイントの状態をdstにコピーする。どちらも同じログを順に反映しているので、
+//書き込み回数が同じタイルは中身も同じ。違うタイルだけコピーしてキャッシュを無効にする
+static void shadow_copy(ppu_shadow *dst, const ppu_checkpoint *src) {
+    for (int i=0; i<TILE_COUNT; i++) {
+        if (dst->tile_writes[i] != src->tile_writes[i]) {
+            memcpy(dst->vram + (i * 16), src->vram + (i * 16), 16);
+            tile_cache_invalidate(&dst->tiles, i * 16);
+            dst->tile_writes[i] = src->tile_writes[i];
+        }
+    }
+
+    memcpy(dst->vram + (TILE_COUNT * 16), src->vram + (TILE_COUNT * 16), sizeof(src->vram) - (TILE_COUNT * 16));
+    memcpy(dst->oam, src->oam, sizeof(src->oam));
+    memcpy(dst->regs, src->regs, sizeof(src->regs));
+    memcpy(dst->colors, src->colors, sizeof(src->colors));
+    dst->stale_tile = src->stale_tile;
+}
+
+static void shadow_init(ppu_shadow *sh) {
+    memset(sh, 0, sizeof(*sh));
+    tile_cache_init(&sh->tiles);
+    bg_layer_init(&sh->layers[0]);
+    bg_layer_init(&sh->layers[1]);
+}
+
+//チャンクのラインを描画する。チェックポイントから自分の範囲のログだけを反映する
+static void render_chunk(ppu_shadow *sh, int chunk) {
+    if (chunk_first[chunk] < 0) {
+        return;
+    }
+
+    shadow_copy(sh, &checkpoints[chunk]);
+
+    for (int i=chunk_first[chunk]; i<chunk_last[chunk]; i++) {
+        const ppu_log_entry *e = &pending[i];
+        shadow_apply(sh, e, e->type == PPU_LOG_LINE ? pool_frame : NULL);
+    }
+}
+
+static void render_chunks(ppu_worker *w) {
+    int chunk;
+
+    while ((chunk = atomic_fetch_add_explicit(&next_chunk, 1, memory_order_acq_rel)) < PPU_CHUNK_COUNT) {
+        render_chunk(&w->shadow, chunk);
+        atomic_fetch_add_explicit(&chunks_done, 1, memory_order_release);
+        wake_signal(&chunk_wake);
+    }
+}
+
+static void *worker_run(void *p) {
+    ppu_worker *w = p;
+    u32 generation = 0;
+
+    while (true) {
+        pthread_mutex_lock(&pool_lock);
+
+        while (pool_generation == generation && !pool_quit) {
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        }
+
+        generation = pool_generation;
+        bool quit = pool_quit;
+
+        pthread_mutex_unlock(&pool_lock);
+
+        if (quit) {
+            break;
+        }
+
+        render_chunks(w);
+    }
+
+    return NULL;
+}
+
+//溜めたフレームをワーカーで分割してバックバッファに描画する。renderでなければ捨てる
+//shadowにはログを受け取った時点で反映済み
+static void frame_flush(bool render) {
+    if (render && pending_count) {
+        int end = pending_count;
+
+        for (int c=PPU_CHUNK_COUNT - 1; c>=0; c--) {
+            if (chunk_first[c] >= 0) {
+                chunk_last[c] = end;
+                end = chunk_first[c];
+            }
+        }
+
+        pool_frame = framebuf_back();
+        atomic_store_explicit(&chunks_done, 0, memory_order_relaxed);
+        atomic_store_explicit(&next_chunk, 0, memory_order_release);
+
+        pthread_mutex_lock(&pool_lock);
+        pool_generation++;
+        pthread_cond_broadcast(&pool_cond);
+        pthread_mutex_unlock(&pool_lock);
+
+        render_chunks(&workers[0]);
+
+        wake_wait(&chunk_wake, chunks_finished);
+    }
+
+    for (int c=0; c<PPU_CHUNK_COUNT; c++) {
+        chunk_first[c] = -1;
+    }
+
+    pending_count = 0;
+}
+
+static void pending_push(const ppu_log_entry *e) {
+    if (pending_count == pending_size) {
+        pending_size = pending_size ? pending_size * 2 : 4096;
+        pending = realloc(pending, pending_size * sizeof(ppu_log_entry));
+    }
+
+    pending[pending_count++] = *e;
+}
+
+static void process_entry(const ppu_log_entry *e) {
+    //LCDをオフにしたら描画途中のフレームは捨てて白い画面を出す
+    if (e->type == PPU_LOG_WRITE && e->address == 0xFF40 && BIT(shadow.regs[0], 7) && !BIT(e->value, 7)) {
+        frame_flush(false);
+        shadow_apply(&shadow, e, NULL);
+
+        memset(framebuf_back(), VIDEO_PIXEL(0, 0), FRAMEBUF_SIZE);
+        framebuf_publish();
+        return;
+    }
+
+    if (e->type == PPU_LOG_FRAME) {
+        frame_flush(true);
+        framebuf_publish();
+        atomic_fetch_add_explicit(&frames_rendered, 1, memory_order_release);
+        wake_signal(&space_wake);
+        return;
+    }
+
+    //1スレッドの場合はラインが来たらすぐ描画する
+    if (worker_count <= 1) {
+        shadow_apply(&shadow, e, framebuf_back());
+        return;
+    }
+
+    //分割描画の場合は状態だけ進めて、フレームの最初のラインからVBLANKまでを溜めておく
+    //チャンクの最初のラインではその直前の状態をチェックポイントに残す
+    if (e->type == PPU_LOG_LINE && chunk_first[e->address / PPU_CHUNK_LINES] < 0) {
+        checkpoint_save(&checkpoints[e->address / PPU_CHUNK_LINES], &shadow);
+        chunk_first[e->address / PPU_CHUNK_LINES] = pending_count;
+    }
+
+    if (pending_count || e->type == PPU_LOG_LINE) {
+        pending_push(e);
+    }
+
+    shadow_apply(&shadow, e, NULL);
+}
+
+static void *ppu_thread_run(void *p) {
+    u32 tail = atomic_load_explicit(&log_buf.tail, memory_order_relaxed);
+
+    while (true) {
+        wake_wait(&log_wake, log_readable);
+
+        //runningを先に読む。止める前に積まれたエントリは必ず処理してから終わる
+        bool alive = atomic_load_explicit(&running, memory_order_acquire);
+        u32 head = atomic_load_explicit(&log_buf.head, memory_order_acquire);
+
+        if (tail == head) {
+            if (!alive) {
+                break;
+            }
+
+            continue;
+        }
+
+        for (; tail != head; tail++) {
+            process_entry(&log_buf.entries[tail & (PPU_LOG_SIZE - 1)]);
+        }
+
+        atomic_store_explicit(&log_buf.tail, tail, memory_order_release);
+        wake_signal(&space_wake);
+    }
+
+    return NULL;
+}
+
+void ppu_thread_set_render_threads(int count) {
+    render_threads = count < 1 ? 1 : count > PPU_MAX_RENDER_THREADS ? PPU_MAX_RENDER_THREADS : count;
+}
+
+//ワーカーを止めて解放する
+static void pool_stop() {
+    pthread_mutex_lock(&pool_lock);
+    pool_quit = true;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int i=1; i<worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+}
+
+bool ppu_thread_start() {
+    ppu_thread_stop();
+
+    shadow_init(&shadow);
+    frame_flush(false);
+
+    workers = calloc(render_threads, sizeof(ppu_worker));
+    worker_count = 1;
+    pool_quit = false;
+
+    for (int i=0; i<render_threads; i++) {
+        shadow_init(&workers[i].shadow);
+    }
+
+    //起動できなかった分はPPUスレッドと他のワーカーが描画する
+    for (int i=1; i<render_threads; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i])) {
+            fprintf(stderr, "FAILED TO START RENDER THREAD %d!\n", i);
+            break;
+        }
+
+        worker_count++;
+    }
+
+    atomic_store(&log_buf.head, 0);
+    atomic_store(&log_buf.tail, 0);
+    atomic_store(&frames_rendered, 0);
+    frames_pushed = 0;
+
+    ppu_thread_sync();
+
+    atomic_store(&running, true);
+
+    if (pthread_create(&thread, NULL, ppu_thread_run, NULL)) {
+        fprintf(stderr, "FAILED TO START PPU THREAD!\n");
+        atomic_store(&running, false);
+        pool_stop();
+        return false;
+    }
+
+    return true;
+}
+
+void ppu_thread_stop() {
+    if (!atomic_load(&running)) {
+        return;
+    }
+
+    atomic_store_explicit(&running, false, memory_order_release);
+    wake_signal(&log_wake);
+    pthread_join(thread, NULL);
+    pool_stop();
+}
+
+bool ppu_thread_running() {
+    return atomic_load_explicit(&running, memory_order_relaxed);
+}
+
+//パレット番号(0=BGP, 1=OBP0, 2=OBP1)の変換結果
+static const u8 *lcd_colors(u8 pal) {
+    lcd_context *lcd = lcd_get_context();
+    return pal == 0 ? lcd->bg_colors : pal == 1 ? lcd->sp1_colors : lcd->sp2_colors;
+}
+
+void ppu_thread_sync() {
+    const mem_arena *arena = mem_get_arena();
+    const u8 *regs = (const u8 *)lcd_get_context();
+
+    for (int i=0; i<0x2000; i++) {
+        log_push(PPU_LOG_WRITE, 0x8000 + i, arena->vram[i]);
+    }
+
+    for (int i=0; i<0xA0; i++) {
+        log_push(PPU_LOG_WRITE, 0xFE00 + i, arena->oam[i]);
+    }
+
+    for (int i=0; i<12; i++) {
+        log_push(PPU_LOG_WRITE, 0xFF40 + i, regs[i]);
+        log_push(PPU_LOG_COLOR, i, lcd_colors(i / 4)[i % 4]);
+    }
+
+    wake_signal(&log_wake);
+}
+
+void ppu_thread_write(u16 address, u8 value) {
+    log_push(PPU_LOG_WRITE, address, value);
+
+    //パレットはlcd_write()で変換した結果を送る
+    if (address >= 0xFF47 && address <= 0xFF49) {
+        u8 pal = address - 0xFF47;
+        const u8 *colors = lcd_colors(pal);
+
+        for (int i=0; i<4; i++) {
+            log_push(PPU_LOG_COLOR, (pal * 4) + i, colors[i]);
+        }
+    }
+}
+
+void ppu_thread_line(u8 ly, u8 window_line) {
+    log_push(PPU_LOG_LINE, ly, window_line);
+}
+
+void ppu_thread_line_end(u8 fetch_x) {
+    log_push(PPU_LOG_LINE_END, 0, fetch_x);
+}
+
+void ppu_thread_frame() {
+    log_push(PPU_LOG_FRAME, 0, 0);
+    frames_pushed++;
+
+    wake_wait(&space_wake, frame_caught_up);
+}
@@ -1,11 +1,5 @@
 #include <ram.h>
-
-typedef struct {
-    u8 wram[0x2000];
-    u8 hram[0x80];
-} ram_context;
-
-static ram_context ctx;
+#include <mem.h>
 
 u8 wram_read(u16 address) {
     address -= 0xC000;
@@ -15,20 +9,20 @@ u8 wram_read(u16 address) {
         exit(-1);        
     }
 
-    return ctx.wram[address];
+    return gb_arena.wram[address];
 }
 
 void wram_write(u16 address, u8 value) {
     address -= 0xC000;
-    ctx.wram[address] = value;
+    gb_arena.wram[address] = value;
 }
 
 u8 hram_read(u16 address) {
     address -= 0xFF80;
-    return ctx.hram[address];
+    return gb_arena.hram[address];
 }
 
 void hram_write(u16 address, u8 value) {
     address -= 0xFF80;
-    ctx.hram[address] = value;
-}
\ No newline at end of file
+    gb_arena.hram[address] = value;
+}
@@ -0,0 +1,496 @@
+#include <romdb.h>
+#include <cart.h>
+#include <checksum.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#define ROMDB_MAGIC "GBIX"
+#define ROMDB_VERSION 1
+
+//インデックスファイルのレイアウト(リトルエンディアン)
+//  "GBIX" u32:version u32:count
+//  エントリ毎: u16:name_len name u64:mtime u64:size char[16]:title
+//             u8:type u8:mapper u8:rom_size u8:ram_size u8:cgb_flag u8:version
+//             u8:flags(bit0=header_ok, bit1=global_ok) u32:crc32 u8[20]:sha1
+
+//名前が空のエントリのバイト数。countがファイルに収まるかの確認に使う
+#define ROMDB_MIN_ENTRY (2 + 8 + 8 + 16 + 7 + 4 + 20)
+
+static void put_u16(FILE *fp, u16 v) {
+    fputc(v & 0xFF, fp);
+    fputc(v >> 8, fp);
+}
+
+static void put_u32(FILE *fp, u32 v) {
+    put_u16(fp, v & 0xFFFF);
+    put_u16(fp, v >> 16);
+}
+
+static void put_u64(FILE *fp, u64 v) {
+    put_u32(fp, v & 0xFFFFFFFF);
+    put_u32(fp, v >> 32);
+}
+
+static bool get_bytes(FILE *fp, void *dst, u32 len) {
+    return fread(dst, 1, len, fp) == len;
+}
+
+static u64 get_le(FILE *fp, int bytes, bool *ok) {
+    u8 b[8];
+    u64 v = 0;
+
+    if (!get_bytes(fp, b, bytes)) {
+        *ok = false;
+        return 0;
+    }
+
+    for (int i=bytes - 1; i>=0; i--) {
+        v = (v << 8) | b[i];
+    }
+    return v;
+}
+
+static void romdb_path(const char *dir, const char *name, char *out, size_t len) {
+    snprintf(out, len, "%s/%s", dir, name);
+}
+
+bool romdb_load(const char *dir, romdb *db) {
+    char path[4096];
+    romdb_path(dir, ROMDB_FILE, path, sizeof(path));
+
+    db->entries = NULL;
+    db->count = 0;
+
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        return false;
+    }
+
+    bool ok = true;
+    char magic[4];
+
+    if (!get_bytes(fp, magic, 4) || memcmp(magic, ROMDB_MAGIC, 4) ||
+        get_le(fp, 4, &ok) != ROMDB_VERSION) {
+        fclose(fp);
+        return false;
+    }
+
+    u32 count = get_le(fp, 4, &ok);
+
+    //壊れたcountで巨大な領域を確保しないように、残りのサイズに収まるか確かめる
+    long start = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    long remaining = ftell(fp) - start;
+    fseek(fp, start, SEEK_SET);
+
+    if (!ok || start < 0 || remaining < 0 || count > (u64)remaining / ROMDB_MIN_ENTRY) {
+        fprintf(stderr, "ROMDB: ignoring corrupt index %s\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    db->entries = calloc(count ? count : 1, sizeof(romdb_entry));
+
+    if (!db->entries) {
+        fclose(fp);
+        return false;
+    }
+
+    for (u32 i=0; i<count && ok; i++) {
+        romdb_entry *e = &db->entries[i];
+        u16 name_len = get_le(fp, 2, &ok);
+
+        e->name = calloc(name_len + 1, 1);
+        db->count = i + 1;
+
+        if (!e->name) {
+            ok = false;
+            break;
+        }
+
+        ok = ok && get_bytes(fp, e->name, name_len);
+        e->mtime = get_le(fp, 8, &ok);
+        e->size = get_le(fp, 8, &ok);
+        ok = ok && get_bytes(fp, e->title, 16);
+
+        u8 fields[7];
+        ok = ok && get_bytes(fp, fields, sizeof(fields));
+        e->type = fields[0];
+        e->mapper = fields[1];
+        e->rom_size = fields[2];
+        e->ram_size = fields[3];
+        e->cgb_flag = fields[4];
+        e->version = fields[5];
+        e->header_ok = fields[6] & 1;
+        e->global_ok = (fields[6] >> 1) & 1;
+
+        e->crc32 = get_le(fp, 4, &ok);
+        ok = ok && get_bytes(fp, e->sha1, 20);
+    }
+
+    fclose(fp);
+
+    if (!ok) {
+        fprintf(stderr, "ROMDB: ignoring corrupt index %s\n", path);
+        romdb_free(db);
+    }
+
+    return ok;
+}
+
+bool romdb_save(const char *dir, const romdb *db) {
+    char path[4096];
+    char tmp[4100];
+    romdb_path(dir, ROMDB_FILE, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp, "wb");
+
+    if (!fp) {
+        fprintf(stderr, "FAILED TO OPEN: %s\n", tmp);
+        return false;
+    }
+
+    fwrite(ROMDB_MAGIC, 1, 4, fp);
+    put_u32(fp, ROMDB_VERSION);
+    put_u32(fp, db->count);
+
+    for (u32 i=0; i<db->count; i++) {
+        const romdb_entry *e = &db->entries[i];
+        u16 name_len = strlen(e->name);
+
+        put_u16(fp, name_len);
+        fwrite(e->name, 1, name_len, fp);
+        put_u64(fp, e->mtime);
+        put_u64(fp, e->size);
+        fwrite(e->title, 1, 16, fp);
+
+        u8 fields[7] = {
+            e->type, e->mapper, e->rom_size, e->ram_size, e->cgb_flag, e->version,
+            (e->header_ok ? 1 : 0) | (e->global_ok ? 2 : 0)
+        };
+        fwrite(fields, 1, sizeof(fields), fp);
+
+        put_u32(fp, e->crc32);
+        fwrite(e->sha1, 1, 20, fp);
+    }
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+
+    //途中で落ちても古いインデックスが残るように置き換えはrenameで行う
+    if (!ok || rename(tmp, path)) {
+        fprintf(stderr, "ROMDB: failed to write %s\n", path);
+        remove(tmp);
+        return false;
+    }
+
+    return true;
+}
+
+void romdb_free(romdb *db) {
+    for (u32 i=0; i<db->count; i++) {
+        free(db->entries[i].name);
+    }
+
+    free(db->entries);
+    db->entries = NULL;
+    db->count = 0;
+}
+
+// ----------------------------------------------------------------------------
+// スキャン
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    romdb_entry *entries;
+    u32 count;
+    u32 capacity;
+} entry_list;
+
+static bool is_rom_file(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext && (!strcasecmp(ext, ".gb") || !strcasecmp(ext, ".gbc") || !strcasecmp(ext, ".sgb"));
+}
+
+static void scan_dir(const char *root, const char *rel, entry_list *list, int depth) {
+    char path[4096];
+
+    if (*rel) {
+        romdb_path(root, rel, path, sizeof(path));
+    } else {
+        snprintf(path, sizeof(path), "%s", root);
+    }
+
+    DIR *d = opendir(path);
+
+    if (!d) {
+        return;
+    }
+
+    struct dirent *de;
+
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+
+        char name[4096];
+        char full[8192];
+
+        if (*rel) {
+            snprintf(name, sizeof(name), "%s/%s", rel, de->d_name);
+        } else {
+            snprintf(name, sizeof(name), "%s", de->d_name);
+        }
+
+        snprintf(full, sizeof(full), "%s/%s", root, name);
+
+        struct stat st;
+
+        if (stat(full, &st)) {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (depth < 8) {
+                scan_dir(root, name, list, depth + 1);
+            }
+            continue;
+        }
+
+        if (!S_ISREG(st.st_mode) || !is_rom_file(name)) {
+            continue;
+        }
+
+        if (list->count == list->capacity) {
+            list->capacity = list->capacity ? list->capacity * 2 : 256;
+            list->entries = realloc(list->entries, list->capacity * sizeof(romdb_entry));
+        }
+
+        romdb_entry *e = &list->entries[list->count++];
+        memset(e, 0, sizeof(romdb_entry));
+        e->name = strdup(name);
+        e->mtime = st.st_mtime;
+        e->size = st.st_size;
+    }
+
+    closedir(d);
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    return strcmp(((const romdb_entry *)a)->name, ((const romdb_entry *)b)->name);
+}
+
+static void parse_rom(const u8 *rom, u32 size, romdb_entry *e) {
+    e->crc32 = crc32(rom, size);
+    sha1(rom, size, e->sha1);
+
+    if (size < 0x150) {
+        e->mapper = MAPPER_OTHER;
+        return;
+    }
+
+    const rom_header *h = (const rom_header *)(rom + 0x100);
+
+    memcpy(e->title, h->title, 16);
+    e->title[16] = 0;
+
+    //CGBフラグはタイトルの最後のバイトと重なっている
+    e->cgb_flag = rom[0x143];
+    if (e->cgb_flag & 0x80) {
+        e->title[15] = 0;
+    }
+
+    e->type = h->type;
+    e->mapper = cart_mapper_of(h->type);
+    e->rom_size = h->rom_size;
+    e->ram_size = h->ram_size;
+    e->version = h->version;
+    e->header_ok = cart_header_checksum(rom) == h->checksum;
+    e->global_ok = cart_global_checksum(rom, size) == ((rom[0x14E] << 8) | rom[0x14F]);
+}
+
+//読めなかった場合はfalse。エントリはmtime/sizeだけのままになる
+static bool index_file(const char *dir, romdb_entry *e) {
+    char path[8192];
+    romdb_path(dir, e->name, path, sizeof(path));
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    void *p = e->size ? mmap(NULL, e->size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    parse_rom(p, e->size, e);
+    munmap(p, e->size);
+    return true;
+#else
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        return false;
+    }
+
+    u8 *p = malloc(e->size);
+    bool ok = p && fread(p, 1, e->size, fp) == e->size;
+
+    if (ok) {
+        parse_rom(p, e->size, e);
+    }
+
+    free(p);
+    fclose(fp);
+    return ok;
+#endif
+}
+
+typedef struct {
+    const char *dir;
+    romdb_entry **todo;
+    bool *failed;           //todoと同じ並び。読めなかったROM
+    u32 todo_count;
+    atomic_uint next;
+} index_job;
+
+static void *index_worker(void *p) {
+    index_job *job = p;
+
+    while (true) {
+        u32 i = atomic_fetch_add(&job->next, 1);
+
+        if (i >= job->todo_count) {
+            break;
+        }
+
+        job->failed[i] = !index_file(job->dir, job->todo[i]);
+    }
+
+    return 0;
+}
+
+bool romdb_index(const char *dir, int threads) {
+    if (threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        threads = threads > 0 ? threads : 1;
+    }
+
+    romdb old;
+    romdb_load(dir, &old);
+    qsort(old.entries, old.count, sizeof(romdb_entry), entry_cmp);
+
+    entry_list list = {0};
+    scan_dir(dir, "", &list, 0);
+    qsort(list.entries, list.count, sizeof(romdb_entry), entry_cmp);
+
+    //mtimeとsizeが一致するエントリは前回の結果を使う
+    index_job job = {
+        .dir = dir,
+        .todo = malloc((list.count ? list.count : 1) * sizeof(romdb_entry *)),
+        .failed = calloc(list.count ? list.count : 1, sizeof(bool)),
+        .todo_count = 0
+    };
+    atomic_init(&job.next, 0);
+
+    if (!job.todo || !job.failed) {
+        free(job.todo);
+        free(job.failed);
+        romdb_free(&old);
+        return false;
+    }
+
+    for (u32 i=0; i<list.count; i++) {
+        romdb_entry *e = &list.entries[i];
+        romdb_entry *prev = old.count ? bsearch(e, old.entries, old.count, sizeof(romdb_entry), entry_cmp) : NULL;
+
+        if (prev && prev->mtime == e->mtime && prev->size == e->size) {
+            char *name = e->name;
+            *e = *prev;
+            e->name = name;
+        } else {
+            job.todo[job.todo_count++] = e;
+        }
+    }
+
+    if (threads > (int)job.todo_count) {
+        threads = job.todo_count ? job.todo_count : 1;
+    }
+
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, index_worker, &job)) {
+            break;
+        }
+    }
+
+    //スレッドが作れなかった場合もこのスレッドで残りを処理する
+    index_worker(&job);
+
+    for (int i=0; i<started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    //読めなかったROMはインデックスに入れない。次回は新しいファイルとして読み直す
+    u32 failed = 0;
+
+    for (u32 i=0; i<job.todo_count; i++) {
+        if (job.failed[i]) {
+            fprintf(stderr, "ROMDB: failed to read %s/%s\n", dir, job.todo[i]->name);
+            free(job.todo[i]->name);
+            job.todo[i]->name = NULL;
+            failed++;
+        }
+    }
+
+    u32 kept = 0;
+
+    for (u32 i=0; i<list.count; i++) {
+        if (list.entries[i].name) {
+            list.entries[kept++] = list.entries[i];
+        }
+    }
+
+    romdb db = {list.entries, kept};
+
+    for (u32 i=0; i<db.count; i++) {
+        romdb_entry *e = &db.entries[i];
+        printf("%08X  %-5s  %-16s  %s%s\n", e->crc32, cart_mapper_name(e->mapper),
+            e->title, e->name, e->header_ok ? "" : "  (bad header checksum)");
+    }
+
+    bool ok = romdb_save(dir, &db);
+
+    printf("Indexed %u ROMs (%u updated, %u failed, %d threads): %s/%s\n",
+        db.count, job.todo_count - failed, failed, started ? started : 1, dir, ROMDB_FILE);
+
+    free(workers);
+    free(job.todo);
+    free(job.failed);
+    romdb_free(&db);
+    romdb_free(&old);
+
+    return ok;
+}
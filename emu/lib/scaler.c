@@ -0,0 +1,519 @@
+#include <scaler.h>
+#include <pixel.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCALER_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+//参照実装
+//範囲外は端のピクセルを繰り返す
+static inline u8 px(const u8 *src, int w, int h, int x, int y) {
+    x = x < 0 ? 0 : x >= w ? w - 1 : x;
+    y = y < 0 ? 0 : y >= h ? h - 1 : y;
+    return src[(y * w) + x];
+}
+
+void scaler_nearest_ref(const u8 *src, int w, int h, u8 *dst, int pitch, int factor) {
+    for (int y=0; y<h * factor; y++) {
+        for (int x=0; x<w * factor; x++) {
+            dst[(y * pitch) + x] = src[((y / factor) * w) + (x / factor)];
+        }
+    }
+}
+
+//A B C
+//D E F
+//G H I
+void scaler_scale2x_ref(const u8 *src, int w, int h, u8 *dst, int pitch) {
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            u8 b = px(src, w, h, x, y - 1);
+            u8 d = px(src, w, h, x - 1, y);
+            u8 e = px(src, w, h, x, y);
+            u8 f = px(src, w, h, x + 1, y);
+            u8 hh = px(src, w, h, x, y + 1);
+            u8 *out = dst + (y * 2 * pitch) + (x * 2);
+
+            out[0] = (d == b && b != f && d != hh) ? d : e;
+            out[1] = (b == f && b != d && f != hh) ? f : e;
+            out[pitch] = (d == hh && d != b && hh != f) ? d : e;
+            out[pitch + 1] = (hh == f && d != hh && b != f) ? f : e;
+        }
+    }
+}
+
+void scaler_scale3x_ref(const u8 *src, int w, int h, u8 *dst, int pitch) {
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            u8 a = px(src, w, h, x - 1, y - 1);
+            u8 b = px(src, w, h, x, y - 1);
+            u8 c = px(src, w, h, x + 1, y - 1);
+            u8 d = px(src, w, h, x - 1, y);
+            u8 e = px(src, w, h, x, y);
+            u8 f = px(src, w, h, x + 1, y);
+            u8 g = px(src, w, h, x - 1, y + 1);
+            u8 hh = px(src, w, h, x, y + 1);
+            u8 i = px(src, w, h, x + 1, y + 1);
+            u8 *out = dst + (y * 3 * pitch) + (x * 3);
+
+            bool db = d == b && b != f && d != hh;  //左上の角
+            bool bf = b == f && b != d && f != hh;  //右上の角
+            bool dh = d == hh && d != b && hh != f; //左下の角
+            bool hf = hh == f && d != hh && b != f; //右下の角
+
+            out[0] = db ? d : e;
+            out[1] = (db && e != c) || (bf && e != a) ? b : e;
+            out[2] = bf ? f : e;
+            out[pitch] = (db && e != g) || (dh && e != a) ? d : e;
+            out[pitch + 1] = e;
+            out[pitch + 2] = (bf && e != i) || (hf && e != c) ? f : e;
+            out[(pitch * 2)] = dh ? d : e;
+            out[(pitch * 2) + 1] = (dh && e != i) || (hf && e != g) ? hh : e;
+            out[(pitch * 2) + 2] = hf ? f : e;
+        }
+    }
+}
+
+//xBRで比べるピクセルの差。シェードの差にパレットが違えば1を足す
+static inline int pixel_dist(u8 a, u8 b) {
+    int d = (a & 3) - (b & 3);
+    return (d < 0 ? -d : d) + (((a ^ b) & 12) ? 1 : 0);
+}
+
+//右下の角を基準にした近傍の位置。rotで90度ずつ回して他の角に使う
+//rot: 0=右下, 1=右上, 2=左上, 3=左下
+static void xbr_rotate(int rot, int dx, int dy, int *rx, int *ry) {
+    switch(rot) {
+        case 0: *rx = dx; *ry = dy; break;
+        case 1: *rx = dy; *ry = -dx; break;
+        case 2: *rx = -dx; *ry = -dy; break;
+        default: *rx = -dy; *ry = dx; break;
+    }
+}
+
+//   B  C
+//D  E  F  F4
+//G  H  I  I4
+//  H5 I5
+enum { XBR_E, XBR_F, XBR_H, XBR_I, XBR_C, XBR_G, XBR_D, XBR_B, XBR_F4, XBR_H5, XBR_I4, XBR_I5, XBR_COUNT };
+
+static const int xbr_offsets[XBR_COUNT][2] = {
+    {0, 0}, {1, 0}, {0, 1}, {1, 1}, {1, -1}, {-1, 1}, {-1, 0}, {0, -1}, {2, 0}, {0, 2}, {2, 1}, {1, 2}
+};
+
+//各角の出力位置(x, y)
+static const int xbr_corners[4][2] = {{1, 1}, {1, 0}, {0, 0}, {0, 1}};
+
+//角の辺の向きを2本の対角線の重みで比べ、辺があれば近い方の隣のピクセルを使う
+static inline u8 xbr_corner(const u8 *p, int (*dist)(u8, u8)) {
+    int wd1 = dist(p[XBR_E], p[XBR_C]) + dist(p[XBR_E], p[XBR_G]) + dist(p[XBR_I], p[XBR_F4]) +
+              dist(p[XBR_I], p[XBR_H5]) + (4 * dist(p[XBR_H], p[XBR_F]));
+    int wd2 = dist(p[XBR_H], p[XBR_D]) + dist(p[XBR_H], p[XBR_I5]) + dist(p[XBR_F], p[XBR_I4]) +
+              dist(p[XBR_F], p[XBR_B]) + (4 * dist(p[XBR_E], p[XBR_I]));
+
+    if (wd1 >= wd2) {
+        return p[XBR_E];
+    }
+
+    return dist(p[XBR_E], p[XBR_F]) <= dist(p[XBR_E], p[XBR_H]) ? p[XBR_F] : p[XBR_H];
+}
+
+void scaler_xbr_ref(const u8 *src, int w, int h, u8 *dst, int pitch) {
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            for (int rot=0; rot<4; rot++) {
+                u8 p[XBR_COUNT];
+
+                for (int n=0; n<XBR_COUNT; n++) {
+                    int rx, ry;
+                    xbr_rotate(rot, xbr_offsets[n][0], xbr_offsets[n][1], &rx, &ry);
+                    p[n] = px(src, w, h, x + rx, y + ry);
+                }
+
+                dst[(((y * 2) + xbr_corners[rot][1]) * pitch) + (x * 2) + xbr_corners[rot][0]] = xbr_corner(p, pixel_dist);
+            }
+        }
+    }
+}
+
+//高速版
+//上下2ライン、左右PAD_Xピクセルを端のピクセルで埋めたコピーを作り、範囲チェックなしで近傍を読む
+#define PAD_X 16
+#define PAD_STRIDE (SCALER_MAX_W + (PAD_X * 2))
+
+static u8 padded[(SCALER_MAX_H + 4) * PAD_STRIDE];
+
+//ラインyの先頭(y=-2からh+1まで)
+#define PAD_ROW(y) (padded + (((y) + 2) * PAD_STRIDE) + PAD_X)
+
+static void pad_frame(const u8 *src, int w, int h) {
+    for (int y=-2; y<h + 2; y++) {
+        const u8 *line = src + ((y < 0 ? 0 : y >= h ? h - 1 : y) * w);
+        u8 *row = PAD_ROW(y);
+
+        memcpy(row, line, w);
+        memset(row - PAD_X, line[0], PAD_X);
+        memset(row + w, line[w - 1], PAD_X);
+    }
+}
+
+#ifdef SCALER_X86_DISPATCH
+//SSSE3
+//16ピクセルずつ。条件は比較結果のマスクで選ぶ
+
+//CPUの判定はpixel.cのものを使う
+static bool use_ssse3() {
+    return pixel_isa_supported(PIXEL_ISA_SSSE3);
+}
+
+#define SEL(mask, a, b) _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+
+//a, b, cを1バイトずつ交互に並べて48バイトにする
+__attribute__((target("ssse3")))
+static void interleave3(__m128i a, __m128i b, __m128i c, u8 *out) {
+    static u8 masks[3][3][16];
+    static bool ready = false;
+
+    if (!ready) {
+        for (int chunk=0; chunk<3; chunk++) {
+            for (int k=0; k<16; k++) {
+                int n = (chunk * 16) + k;
+
+                for (int s=0; s<3; s++) {
+                    masks[chunk][s][k] = (n % 3) == s ? (n / 3) : 0x80;
+                }
+            }
+        }
+
+        ready = true;
+    }
+
+    for (int chunk=0; chunk<3; chunk++) {
+        __m128i v = _mm_or_si128(
+            _mm_or_si128(_mm_shuffle_epi8(a, _mm_loadu_si128((const __m128i *)masks[chunk][0])),
+                         _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *)masks[chunk][1]))),
+            _mm_shuffle_epi8(c, _mm_loadu_si128((const __m128i *)masks[chunk][2])));
+        _mm_storeu_si128((__m128i *)(out + (chunk * 16)), v);
+    }
+}
+
+//1ラインを横にfactor倍する。処理したピクセル数を返す
+__attribute__((target("ssse3")))
+static int nearest_row_ssse3(const u8 *src, int w, u8 *out, int factor) {
+    int x = 0;
+
+    if (factor < 2 || factor > 4) {
+        return 0;
+    }
+
+    for (; x + 16 <= w; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        u8 *o = out + (x * factor);
+
+        if (factor == 2) {
+            _mm_storeu_si128((__m128i *)o, _mm_unpacklo_epi8(v, v));
+            _mm_storeu_si128((__m128i *)(o + 16), _mm_unpackhi_epi8(v, v));
+        } else if (factor == 3) {
+            interleave3(v, v, v, o);
+        } else {
+            __m128i lo = _mm_unpacklo_epi8(v, v);
+            __m128i hi = _mm_unpackhi_epi8(v, v);
+            _mm_storeu_si128((__m128i *)o, _mm_unpacklo_epi16(lo, lo));
+            _mm_storeu_si128((__m128i *)(o + 16), _mm_unpackhi_epi16(lo, lo));
+            _mm_storeu_si128((__m128i *)(o + 32), _mm_unpacklo_epi16(hi, hi));
+            _mm_storeu_si128((__m128i *)(o + 48), _mm_unpackhi_epi16(hi, hi));
+        }
+    }
+
+    return x;
+}
+
+__attribute__((target("ssse3")))
+static int scale2x_row_ssse3(int y, int w, u8 *out0, u8 *out1) {
+    const u8 *rb = PAD_ROW(y - 1);
+    const u8 *re = PAD_ROW(y);
+    const u8 *rh = PAD_ROW(y + 1);
+    int x = 0;
+
+    for (; x + 16 <= w; x += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(rb + x));
+        __m128i d = _mm_loadu_si128((const __m128i *)(re + x - 1));
+        __m128i e = _mm_loadu_si128((const __m128i *)(re + x));
+        __m128i f = _mm_loadu_si128((const __m128i *)(re + x + 1));
+        __m128i h = _mm_loadu_si128((const __m128i *)(rh + x));
+        __m128i db = _mm_cmpeq_epi8(d, b);
+        __m128i bf = _mm_cmpeq_epi8(b, f);
+        __m128i dh = _mm_cmpeq_epi8(d, h);
+        __m128i hf = _mm_cmpeq_epi8(h, f);
+
+        __m128i e0 = SEL(_mm_andnot_si128(_mm_or_si128(bf, dh), db), d, e);
+        __m128i e1 = SEL(_mm_andnot_si128(_mm_or_si128(db, hf), bf), f, e);
+        __m128i e2 = SEL(_mm_andnot_si128(_mm_or_si128(db, hf), dh), d, e);
+        __m128i e3 = SEL(_mm_andnot_si128(_mm_or_si128(dh, bf), hf), f, e);
+
+        _mm_storeu_si128((__m128i *)(out0 + (x * 2)), _mm_unpacklo_epi8(e0, e1));
+        _mm_storeu_si128((__m128i *)(out0 + (x * 2) + 16), _mm_unpackhi_epi8(e0, e1));
+        _mm_storeu_si128((__m128i *)(out1 + (x * 2)), _mm_unpacklo_epi8(e2, e3));
+        _mm_storeu_si128((__m128i *)(out1 + (x * 2) + 16), _mm_unpackhi_epi8(e2, e3));
+    }
+
+    return x;
+}
+
+__attribute__((target("ssse3")))
+static int scale3x_row_ssse3(int y, int w, u8 *out0, u8 *out1, u8 *out2) {
+    const u8 *rb = PAD_ROW(y - 1);
+    const u8 *re = PAD_ROW(y);
+    const u8 *rh = PAD_ROW(y + 1);
+    int x = 0;
+
+    for (; x + 16 <= w; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(rb + x - 1));
+        __m128i b = _mm_loadu_si128((const __m128i *)(rb + x));
+        __m128i c = _mm_loadu_si128((const __m128i *)(rb + x + 1));
+        __m128i d = _mm_loadu_si128((const __m128i *)(re + x - 1));
+        __m128i e = _mm_loadu_si128((const __m128i *)(re + x));
+        __m128i f = _mm_loadu_si128((const __m128i *)(re + x + 1));
+        __m128i g = _mm_loadu_si128((const __m128i *)(rh + x - 1));
+        __m128i h = _mm_loadu_si128((const __m128i *)(rh + x));
+        __m128i i = _mm_loadu_si128((const __m128i *)(rh + x + 1));
+
+        __m128i eq_db = _mm_cmpeq_epi8(d, b);
+        __m128i eq_bf = _mm_cmpeq_epi8(b, f);
+        __m128i eq_dh = _mm_cmpeq_epi8(d, h);
+        __m128i eq_hf = _mm_cmpeq_epi8(h, f);
+
+        __m128i db = _mm_andnot_si128(_mm_or_si128(eq_bf, eq_dh), eq_db);
+        __m128i bf = _mm_andnot_si128(_mm_or_si128(eq_db, eq_hf), eq_bf);
+        __m128i dh = _mm_andnot_si128(_mm_or_si128(eq_db, eq_hf), eq_dh);
+        __m128i hf = _mm_andnot_si128(_mm_or_si128(eq_dh, eq_bf), eq_hf);
+
+        //E != Xのマスク
+        __m128i na = _mm_andnot_si128(_mm_cmpeq_epi8(e, a), _mm_set1_epi8(-1));
+        __m128i nc = _mm_andnot_si128(_mm_cmpeq_epi8(e, c), _mm_set1_epi8(-1));
+        __m128i ng = _mm_andnot_si128(_mm_cmpeq_epi8(e, g), _mm_set1_epi8(-1));
+        __m128i ni = _mm_andnot_si128(_mm_cmpeq_epi8(e, i), _mm_set1_epi8(-1));
+
+        __m128i o0 = SEL(db, d, e);
+        __m128i o1 = SEL(_mm_or_si128(_mm_and_si128(db, nc), _mm_and_si128(bf, na)), b, e);
+        __m128i o2 = SEL(bf, f, e);
+        __m128i o3 = SEL(_mm_or_si128(_mm_and_si128(db, ng), _mm_and_si128(dh, na)), d, e);
+        __m128i o5 = SEL(_mm_or_si128(_mm_and_si128(bf, ni), _mm_and_si128(hf, nc)), f, e);
+        __m128i o6 = SEL(dh, d, e);
+        __m128i o7 = SEL(_mm_or_si128(_mm_and_si128(dh, ni), _mm_and_si128(hf, ng)), h, e);
+        __m128i o8 = SEL(hf, f, e);
+
+        interleave3(o0, o1, o2, out0 + (x * 3));
+        interleave3(o3, e, o5, out1 + (x * 3));
+        interleave3(o6, o7, o8, out2 + (x * 3));
+    }
+
+    return x;
+}
+#endif
+
+static void nearest_row(const u8 *src, int w, u8 *out, int factor, int x) {
+    for (; x<w; x++) {
+        memset(out + (x * factor), src[x], factor);
+    }
+}
+
+void scaler_nearest(const u8 *src, int w, int h, u8 *dst, int pitch, int factor) {
+    for (int y=0; y<h; y++) {
+        u8 *out = dst + (y * factor * pitch);
+        int done = 0;
+
+#ifdef SCALER_X86_DISPATCH
+        if (use_ssse3()) {
+            done = nearest_row_ssse3(src + (y * w), w, out, factor);
+        }
+#endif
+
+        nearest_row(src + (y * w), w, out, factor, done);
+
+        //縦方向は同じラインをコピーする
+        for (int n=1; n<factor; n++) {
+            memcpy(out + (n * pitch), out, w * factor);
+        }
+    }
+}
+
+void scaler_scale2x(const u8 *src, int w, int h, u8 *dst, int pitch) {
+    pad_frame(src, w, h);
+
+    for (int y=0; y<h; y++) {
+        const u8 *rb = PAD_ROW(y - 1);
+        const u8 *re = PAD_ROW(y);
+        const u8 *rh = PAD_ROW(y + 1);
+        u8 *out0 = dst + (y * 2 * pitch);
+        u8 *out1 = out0 + pitch;
+        int x = 0;
+
+#ifdef SCALER_X86_DISPATCH
+        if (use_ssse3()) {
+            x = scale2x_row_ssse3(y, w, out0, out1);
+        }
+#endif
+
+        for (; x<w; x++) {
+            u8 b = rb[x], d = re[x - 1], e = re[x], f = re[x + 1], hh = rh[x];
+
+            out0[x * 2] = (d == b && b != f && d != hh) ? d : e;
+            out0[(x * 2) + 1] = (b == f && b != d && f != hh) ? f : e;
+            out1[x * 2] = (d == hh && d != b && hh != f) ? d : e;
+            out1[(x * 2) + 1] = (hh == f && d != hh && b != f) ? f : e;
+        }
+    }
+}
+
+void scaler_scale3x(const u8 *src, int w, int h, u8 *dst, int pitch) {
+    pad_frame(src, w, h);
+
+    for (int y=0; y<h; y++) {
+        const u8 *rb = PAD_ROW(y - 1);
+        const u8 *re = PAD_ROW(y);
+        const u8 *rh = PAD_ROW(y + 1);
+        u8 *out0 = dst + (y * 3 * pitch);
+        u8 *out1 = out0 + pitch;
+        u8 *out2 = out1 + pitch;
+        int x = 0;
+
+#ifdef SCALER_X86_DISPATCH
+        if (use_ssse3()) {
+            x = scale3x_row_ssse3(y, w, out0, out1, out2);
+        }
+#endif
+
+        for (; x<w; x++) {
+            u8 a = rb[x - 1], b = rb[x], c = rb[x + 1];
+            u8 d = re[x - 1], e = re[x], f = re[x + 1];
+            u8 g = rh[x - 1], hh = rh[x], i = rh[x + 1];
+            bool db = d == b && b != f && d != hh;
+            bool bf = b == f && b != d && f != hh;
+            bool dh = d == hh && d != b && hh != f;
+            bool hf = hh == f && d != hh && b != f;
+            int o = x * 3;
+
+            out0[o] = db ? d : e;
+            out0[o + 1] = (db && e != c) || (bf && e != a) ? b : e;
+            out0[o + 2] = bf ? f : e;
+            out1[o] = (db && e != g) || (dh && e != a) ? d : e;
+            out1[o + 1] = e;
+            out1[o + 2] = (bf && e != i) || (hf && e != c) ? f : e;
+            out2[o] = dh ? d : e;
+            out2[o + 1] = (dh && e != i) || (hf && e != g) ? hh : e;
+            out2[o + 2] = hf ? f : e;
+        }
+    }
+}
+
+//xBRは近傍の条件が込み入っているのでSIMD化せず、差をテーブルで引いて近傍の位置を前計算する
+static u8 dist_table[16][16];
+
+static inline int table_dist(u8 a, u8 b) {
+    return dist_table[a & 15][b & 15];
+}
+
+void scaler_xbr(const u8 *src, int w, int h, u8 *dst, int pitch) {
+    static int offsets[4][XBR_COUNT];
+    static bool ready = false;
+
+    if (!ready) {
+        for (int a=0; a<16; a++) {
+            for (int b=0; b<16; b++) {
+                dist_table[a][b] = pixel_dist(a, b);
+            }
+        }
+
+        for (int rot=0; rot<4; rot++) {
+            for (int n=0; n<XBR_COUNT; n++) {
+                int rx, ry;
+                xbr_rotate(rot, xbr_offsets[n][0], xbr_offsets[n][1], &rx, &ry);
+                offsets[rot][n] = (ry * PAD_STRIDE) + rx;
+            }
+        }
+
+        ready = true;
+    }
+
+    pad_frame(src, w, h);
+
+    for (int y=0; y<h; y++) {
+        const u8 *row = PAD_ROW(y);
+
+        for (int x=0; x<w; x++) {
+            const u8 *e = row + x;
+
+            for (int rot=0; rot<4; rot++) {
+                u8 p[XBR_COUNT];
+
+                for (int n=0; n<XBR_COUNT; n++) {
+                    p[n] = e[offsets[rot][n]];
+                }
+
+                dst[(((y * 2) + xbr_corners[rot][1]) * pitch) + (x * 2) + xbr_corners[rot][0]] = xbr_corner(p, table_dist);
+            }
+        }
+    }
+}
+
+int scaler_factor(scaler_type type, int factor) {
+    switch(type) {
+        case SCALER_NEAREST: return factor;
+        case SCALER_SCALE2X: return 2;
+        case SCALER_SCALE3X: return 3;
+        case SCALER_XBR: return 2;
+        default: return 1;
+    }
+}
+
+void scaler_apply(scaler_type type, int factor, const u8 *src, int w, int h, u8 *dst, int pitch) {
+    switch(type) {
+        case SCALER_NEAREST:
+            scaler_nearest(src, w, h, dst, pitch, factor);
+            break;
+        case SCALER_SCALE2X:
+            scaler_scale2x(src, w, h, dst, pitch);
+            break;
+        case SCALER_SCALE3X:
+            scaler_scale3x(src, w, h, dst, pitch);
+            break;
+        case SCALER_XBR:
+            scaler_xbr(src, w, h, dst, pitch);
+            break;
+        default:
+            for (int y=0; y<h; y++) {
+                memcpy(dst + (y * pitch), src + (y * w), w);
+            }
+            break;
+    }
+}
+
+bool scaler_parse(const char *name, scaler_type *type, int *factor) {
+    *factor = 1;
+
+    if (!strcmp(name, "none")) {
+        *type = SCALER_NONE;
+    } else if (!strcmp(name, "scale2x")) {
+        *type = SCALER_SCALE2X;
+    } else if (!strcmp(name, "scale3x")) {
+        *type = SCALER_SCALE3X;
+    } else if (!strcmp(name, "xbr")) {
+        *type = SCALER_XBR;
+    } else if (!strncmp(name, "nearest", 7) && name[7] >= '2' && name[7] <= '8' && !name[8]) {
+        *type = SCALER_NEAREST;
+        *factor = name[7] - '0';
+    } else {
+        printf("Unknown scaler: %s (none, nearest2-8, scale2x, scale3x, xbr)\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+const char *scaler_name(scaler_type type) {
+    static const char *names[] = {"none", "nearest", "scale2x", "scale3x", "xbr"};
+    return names[type];
+}
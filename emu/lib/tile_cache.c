@@ -0,0 +1,38 @@
+#include <tile_cache.h>
+#include <pixel.h>
+#include <string.h>
+
+static tile_cache cache;
+
+tile_cache *tile_cache_get() {
+    return &cache;
+}
+
+void tile_cache_init(tile_cache *tc) {
+    tile_cache_invalidate_all(tc);
+}
+
+void tile_cache_invalidate_all(tile_cache *tc) {
+    memset(tc->dirty, true, sizeof(tc->dirty));
+
+    for (int i=0; i<TILE_COUNT; i++) {
+        tc->version[i]++;
+    }
+}
+
+void tile_cache_decode(tile_cache *tc, const u8 *vram, u16 tile) {
+    const u8 *data = vram + (tile * 16);
+
+    for (int y=0; y<8; y++) {
+        u8 *row = tc->rows[tile][y];
+        u8 *flipped = tc->flipped[tile][y];
+
+        pixel_decode_row(data[y * 2], data[(y * 2) + 1], row);
+
+        for (int x=0; x<8; x++) {
+            flipped[x] = row[7 - x];
+        }
+    }
+
+    tc->dirty[tile] = false;
+}
@@ -1,5 +1,6 @@
 #include <timer.h>
 #include <interrupts.h>
+#include <string.h>
 
 static  timer_context ctx = {0};
 
@@ -7,6 +8,18 @@ timer_context *timer_get_context() {
     return &ctx;
 }
 
+u32 timer_state_size() {
+    return sizeof(ctx);
+}
+
+void timer_save_state(void *dst) {
+    memcpy(dst, &ctx, sizeof(ctx));
+}
+
+void timer_load_state(const void *src) {
+    memcpy(&ctx, src, sizeof(ctx));
+}
+
 void timer_init() {
     ctx.div = 0xAC00;
 }
@@ -1,24 +1,69 @@
 #include <ui.h>
 #include <emu.h>
-#include <bus.h>
 #include <ppu.h>
 #include <gamepad.h>
 #include <apu.h>
+#include <cheat.h>
+#include <pixel.h>
+#include <video.h>
+#include <framebuf.h>
+#include <scaler.h>
+#include <hud.h>
+#include <vram_view.h>
+
+#include <stdatomic.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 
 SDL_Window *sdlWindow;
 SDL_Renderer *sdlRenderer;
-SDL_Texture *sdlTexture;
-SDL_Surface *screen; 
+SDL_Texture *sdlTexture;     //160x144(スケーラー使用時はその倍率)。ウィンドウへの拡大はSDL_RenderCopyで行う
 
+//F2のデバッグ表示。開いたときに作り、閉じても隠すだけで残しておく
 SDL_Window *sdlDebugWindow;
 SDL_Renderer *sdlDebugRenderer;
 SDL_Texture *sdlDebugTexture;
-SDL_Surface *debugScreen;
 
-static int scale = 4;
+//--debug-view-rate。デバッグ表示を更新する頻度(Hz)
+static u32 debug_rate = 10;
+static bool debug_visible = false;
+static u32 debug_last_request = 0;
+static vram_snapshot debug_snap;
+static u8 debug_pixels[VRAM_VIEW_W * VRAM_VIEW_H];
+
+void ui_set_debug_rate(u32 hz) {
+    debug_rate = hz ? hz : 1;
+}
+
+//--scaler。SCALER_NONEの場合はテクスチャの拡大だけで表示する
+static scaler_type ui_scaler = SCALER_NONE;
+static int ui_scaler_factor = 1;
+
+//拡大したフレーム(1ピクセル1バイト)
+static u8 scaled[(160 * 8) * (144 * 8)];
+
+void ui_set_scaler(scaler_type type, int factor) {
+    ui_scaler = type;
+    ui_scaler_factor = factor;
+}
+
+//フレームの公開を知らせるユーザーイベント
+static u32 frame_event = (u32)-1;
+
+//キューに入っている未処理のフレームイベント。UIが遅れても1つしか積まない
+static _Atomic bool frame_event_pending = false;
+
+static void on_frame_published() {
+    if (atomic_exchange(&frame_event_pending, true)) {
+        return;
+    }
+
+    SDL_Event e;
+    SDL_zero(e);
+    e.type = frame_event;
+    SDL_PushEvent(&e);
+}
 
 void ui_init() {
     
@@ -26,41 +71,40 @@ void ui_init() {
     printf("SDL INIT\n");
     TTF_Init();
     printf("TTF INIT\n");
+
+    pixel_init();
+    printf("PIXEL KERNELS: %s\n", pixel_isa_name(pixel_get_isa()));
     
     // Initialize APU audio (handles errors internally per Requirement 11.5)
     apu_audio_init();
     printf("APU AUDIO INIT\n");
 
-    SDL_CreateWindowAndRenderer(SCREEN_WIDTH, SCREEN_HEIGHT, 0, &sdlWindow, &sdlRenderer);
+    //スケーラーの出力が既定のウィンドウより大きい場合はウィンドウをその大きさにする
+    int n = scaler_factor(ui_scaler, ui_scaler_factor);
+    int width = XRES * n > SCREEN_WIDTH ? XRES * n : SCREEN_WIDTH;
+    int height = YRES * n > SCREEN_HEIGHT ? YRES * n : SCREEN_HEIGHT;
+
+    SDL_CreateWindowAndRenderer(width, height, SDL_WINDOW_RESIZABLE, &sdlWindow, &sdlRenderer);
 
-    screen = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
-                                            0x00FF0000,
-                                            0x0000FF00,
-                                            0x000000FF,
-                                            0xFF000000);
+    //ドットがぼやけないように最近傍で拡大する
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
     sdlTexture = SDL_CreateTexture(sdlRenderer,
                                                 SDL_PIXELFORMAT_ARGB8888,
                                                 SDL_TEXTUREACCESS_STREAMING,
-                                                SCREEN_WIDTH, SCREEN_HEIGHT);
+                                                XRES * n, YRES * n);
+
+    if (ui_scaler != SCALER_NONE) {
+        printf("SCALER: %s x%d\n", scaler_name(ui_scaler), n);
+    }
+
+    hud_init(sdlRenderer);
+
+    frame_event = SDL_RegisterEvents(1);
+
+    if (frame_event != (u32)-1) {
+        framebuf_set_notify(on_frame_published);
+    }
 
-    //SDL_CreateWindowAndRenderer(16 * 8 * scale, 32 * 8 * scale, 0, &sdlDebugWindow, &sdlDebugRenderer);
-    
-    debugScreen = SDL_CreateRGBSurface(0, (16 * 8 * scale) + (16 * scale), 
-                                            (32 * 8 * scale) + (64 * scale), 32,
-                                            0x00FF0000,
-                                            0x0000FF00,
-                                            0x000000FF,
-                                            0xFF000000);
-
-    sdlDebugTexture = SDL_CreateTexture(sdlDebugRenderer,
-                                            SDL_PIXELFORMAT_ARGB8888,
-                                            SDL_TEXTUREACCESS_STREAMING,
-                                            (16 * 8 * scale) + (16 * scale), 
-                                            (32 * 8 * scale) + (64 * scale));
-    
-    int x,y;
-    SDL_GetWindowPosition(sdlWindow, &x, &y);
-    //SDL_SetWindowPosition(sdlDebugWindow, x + SCREEN_WIDTH + 10, y);    
 }
 
 void delay(u32 ms) {
@@ -71,86 +115,240 @@ u32 get_ticks() {
     return SDL_GetTicks();
 }
 
-static unsigned long tile_colors[4] =  {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+//デバッグ表示のウィンドウを初めて開くときに作る。メインウィンドウの右に置く
+static bool create_debug_window() {
+    int x, y, w, h;
+    SDL_GetWindowPosition(sdlWindow, &x, &y);
+    SDL_GetWindowSize(sdlWindow, &w, &h);
+
+    sdlDebugWindow = SDL_CreateWindow("VRAM", x + w + 10, y,
+                                      VRAM_VIEW_W * 2, VRAM_VIEW_H * 2, SDL_WINDOW_RESIZABLE);
+
+    if (!sdlDebugWindow) {
+        printf("Failed to create debug window: %s\n", SDL_GetError());
+        return false;
+    }
+
+    sdlDebugRenderer = SDL_CreateRenderer(sdlDebugWindow, -1, 0);
+
+    if (sdlDebugRenderer) {
+        sdlDebugTexture = SDL_CreateTexture(sdlDebugRenderer,
+                                            SDL_PIXELFORMAT_ARGB8888,
+                                            SDL_TEXTUREACCESS_STREAMING,
+                                            VRAM_VIEW_W, VRAM_VIEW_H);
+    }
+
+    if (!sdlDebugTexture) {
+        printf("Failed to create debug renderer: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(sdlDebugRenderer);
+        SDL_DestroyWindow(sdlDebugWindow);
+        sdlDebugRenderer = NULL;
+        sdlDebugWindow = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static void toggle_debug_window() {
+    if (!sdlDebugWindow && !create_debug_window()) {
+        return;
+    }
 
-void display_tile(SDL_Surface *surface, u16 startLocation, u16 tileNum, int x, int y) {
-    SDL_Rect rc;
+    debug_visible = !debug_visible;
 
-    for(int tileY=0; tileY<16; tileY += 2) {
-        u8 b1 = bus_read(startLocation + (tileNum * 16) + tileY);
-        u8 b2 = bus_read(startLocation + (tileNum * 16) + tileY + 1);
+    if (debug_visible) {
+        SDL_ShowWindow(sdlDebugWindow);
+        //開いたらすぐに1枚目を頼む
+        debug_last_request = SDL_GetTicks() - (1000 / debug_rate);
+    } else {
+        SDL_HideWindow(sdlDebugWindow);
+    }
+}
 
-        for(int bit = 7; bit >= 0; bit--) {
-            u8 lo = !!(b1 & (1 << bit));
-            u8 hi = !!(b2 & (1 << bit)) << 1;
+//debug_rateの間隔でスナップショットを頼み、届いていれば描き直す
+//VRAMの読み出しも描画もUIスレッドで行うので、CPUスレッドはVBLANKでコピーするだけ
+static void update_dbg_window() {
+    if (!debug_visible) {
+        return;
+    }
 
-            u8 color = hi | lo;
+    u32 now = SDL_GetTicks();
 
-            rc.x = x + ((7 - bit) * scale);
-            rc.y = y + (tileY / 2 * scale);
-            rc.w = scale;
-            rc.h = scale;
+    if (now - debug_last_request >= 1000 / debug_rate) {
+        debug_last_request = now;
+        vram_view_request();
+    }
 
-            SDL_FillRect(surface, &rc, tile_colors[color]);
-        }
+    if (!vram_view_take(&debug_snap)) {
+        return;
+    }
+
+    vram_view_render(&debug_snap, debug_pixels);
+
+    void *pixels;
+    int pitch;
+
+    if (SDL_LockTexture(sdlDebugTexture, NULL, &pixels, &pitch)) {
+        return;
+    }
+
+    for (int y = 0; y < VRAM_VIEW_H; y++) {
+        video_convert(debug_pixels + (y * VRAM_VIEW_W), (u8 *)pixels + (y * pitch), VRAM_VIEW_W, VIDEO_ARGB8888);
+    }
+
+    SDL_UnlockTexture(sdlDebugTexture);
+
+    SDL_SetRenderDrawColor(sdlDebugRenderer, 0, 0, 0, 255);
+    SDL_RenderClear(sdlDebugRenderer);
+    SDL_RenderCopy(sdlDebugRenderer, sdlDebugTexture, NULL, NULL);
+    SDL_RenderPresent(sdlDebugRenderer);
+}
+
+//前回表示したフレームのライン毎のハッシュ。変わったラインだけ描き直す
+static u64 shown_lines[FRAMEBUF_LINES];
+static bool redraw_all = true;
+
+//ラインy0からy1の手前までをテクスチャに直接変換する
+static void update_lines(const u8 *frame, int y0, int y1) {
+    SDL_Rect rc = {0, y0, XRES, y1 - y0};
+    void *pixels;
+    int pitch;
+
+    if (SDL_LockTexture(sdlTexture, &rc, &pixels, &pitch)) {
+        return;
+    }
+
+    for (int line_num = y0; line_num < y1; line_num++) {
+        video_convert(frame + (line_num * XRES), (u8 *)pixels + ((line_num - y0) * pitch), XRES, VIDEO_ARGB8888);
     }
+
+    SDL_UnlockTexture(sdlTexture);
+}
+
+//スケーラーで拡大してからテクスチャ全体を変換する
+//Scale2x等は周りのピクセルを見るので変わったラインだけの更新はしない
+static void update_scaled(const u8 *frame) {
+    int n = scaler_factor(ui_scaler, ui_scaler_factor);
+    void *pixels;
+    int pitch;
+
+    scaler_apply(ui_scaler, ui_scaler_factor, frame, XRES, YRES, scaled, XRES * n);
+
+    if (SDL_LockTexture(sdlTexture, NULL, &pixels, &pitch)) {
+        return;
+    }
+
+    for (int y = 0; y < YRES * n; y++) {
+        video_convert(scaled + (y * XRES * n), (u8 *)pixels + (y * pitch), XRES * n, VIDEO_ARGB8888);
+    }
+
+    SDL_UnlockTexture(sdlTexture);
 }
 
-void update_dbg_window() {
-    int xDraw = 0;
-    int yDraw = 0;
-    int tileNum = 0;
+//現在のフレームをスケーラーで拡大してBMPに保存する
+static void save_screenshot() {
+    int n = scaler_factor(ui_scaler, ui_scaler_factor);
+    int w = XRES * n;
+    int h = YRES * n;
+    u32 *argb = malloc(w * h * sizeof(u32));
+    char name[64];
+
+    if (!argb) {
+        return;
+    }
+
+    scaler_apply(ui_scaler, ui_scaler_factor, framebuf_acquire(NULL), XRES, YRES, scaled, w);
 
-    SDL_Rect rc;
-    rc.x = 0;
-    rc.y = 0;
-    rc.w = debugScreen->w;
-    rc.h = debugScreen->h;
-    SDL_FillRect(debugScreen, &rc, 0xFF111111);
+    for (int y = 0; y < h; y++) {
+        video_convert(scaled + (y * w), argb + (y * w), w, VIDEO_ARGB8888);
+    }
+
+    snprintf(name, sizeof(name), "screenshot_%u.bmp", ppu_get_context()->current_frame);
 
-    u16 addr = 0x8000;
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(argb, w, h, 32, w * sizeof(u32), SDL_PIXELFORMAT_ARGB8888);
+
+    if (!surface || SDL_SaveBMP(surface, name)) {
+        printf("Failed to save screenshot: %s\n", SDL_GetError());
+    } else {
+        printf("Saved %s\n", name);
+    }
 
-    for(int y = 0; y < 24; y++) {
-        for(int x=0; x < 16; x++) {
-            display_tile(debugScreen, addr, tileNum, xDraw + (x * scale), yDraw + (y * scale));
-            xDraw += (8 * scale);
-            tileNum++;
+    SDL_FreeSurface(surface);
+    free(argb);
+}
+
+//ウィンドウに収まる最大の整数倍で中央に置く。余白は黒
+static SDL_Rect screen_rect() {
+    int w, h;
+    SDL_GetRendererOutputSize(sdlRenderer, &w, &h);
+
+    //スケーラーの出力を縮小しないように、その倍率の整数倍にする
+    int m = scaler_factor(ui_scaler, ui_scaler_factor);
+    int n = (w / (XRES * m)) < (h / (YRES * m)) ? (w / (XRES * m)) : (h / (YRES * m));
+
+    //スケーラーの出力が収まらない場合は切り取らずに縦横比を保って縮小する
+    if (n < 1) {
+        int fw = w;
+        int fh = (w * YRES) / XRES;
+
+        if (fh > h) {
+            fh = h;
+            fw = (h * XRES) / YRES;
         }
 
-        yDraw += (8 * scale);
-        xDraw = 0;
+        SDL_Rect rc = {(w - fw) / 2, (h - fh) / 2, fw, fh};
+        return rc;
     }
 
-    SDL_UpdateTexture(sdlDebugTexture, NULL, debugScreen->pixels, debugScreen->pitch);
-	SDL_RenderClear(sdlDebugRenderer);
-	SDL_RenderCopy(sdlDebugRenderer, sdlDebugTexture, NULL, NULL);
-	SDL_RenderPresent(sdlDebugRenderer);
+    n *= m;
+
+    SDL_Rect rc = {(w - (XRES * n)) / 2, (h - (YRES * n)) / 2, XRES * n, YRES * n};
+    return rc;
 }
 
 void ui_update() {
-    SDL_Rect rc;
-    rc.x = rc.y = 0;
-    rc.w = rc.h = 2048;
+    //フレームバッファはシェードなので表示するときに変わったラインだけARGBに変換する
+    const u8 *frame = framebuf_acquire(NULL);
+    framebuf_dirty dirty;
 
-    u32 *video_buffer = ppu_get_context()->video_buffer;
+    update_dbg_window();
 
-    for (int line_num = 0; line_num < YRES; line_num++) {
-        for (int x = 0; x < XRES; x++) {
-            rc.x = x * scale;
-            rc.y = line_num * scale;
-            rc.w = scale;
-            rc.h = scale;
+    int changed = framebuf_dirty_lines(shown_lines, &dirty);
+
+    if (!changed && !redraw_all && !hud_changed()) {
+        //前回と同じフレームでHUDも変わっていないので表示し直さない
+        return;
+    }
 
-            SDL_FillRect(screen, &rc, video_buffer[x + (line_num * XRES)]);
+    //続けて変わったラインはまとめて1回で更新する
+    for (int y = 0; ui_scaler == SCALER_NONE && y < YRES; y++) {
+        if (!redraw_all && !FRAMEBUF_LINE_DIRTY(&dirty, y)) {
+            continue;
         }
+
+        int end = y + 1;
+
+        while (end < YRES && (redraw_all || FRAMEBUF_LINE_DIRTY(&dirty, end))) {
+            end++;
+        }
+
+        update_lines(frame, y, end);
+        y = end;
     }
 
-    SDL_UpdateTexture(sdlTexture, NULL, screen->pixels, screen->pitch);
+    if (ui_scaler != SCALER_NONE) {
+        update_scaled(frame);
+    }
+
+    redraw_all = false;
+
+    SDL_Rect dst = screen_rect();
+    SDL_SetRenderDrawColor(sdlRenderer, 0, 0, 0, 255);
     SDL_RenderClear(sdlRenderer);
-    SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, NULL);
+    SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, &dst);
+    hud_draw(sdlRenderer);
     SDL_RenderPresent(sdlRenderer);
-
-    //update_dbg_window();
 }
 
 void ui_on_key(bool down, u32 key_code) {
@@ -166,20 +364,77 @@ void ui_on_key(bool down, u32 key_code) {
     }
 }
 
-void ui_handle_events() {
-    SDL_Event e;
-    while (SDL_PollEvent(&e) > 0)
-    {
-        if (e.type == SDL_KEYDOWN) {
-            ui_on_key(true, e.key.keysym.sym);
+static void handle_event(SDL_Event *e) {
+    if (e->type == frame_event) {
+        atomic_store(&frame_event_pending, false);
+        return;
+    }
+
+    if (e->type == SDL_KEYDOWN) {
+        ui_on_key(true, e->key.keysym.sym);
+
+        //ブレーク中の再開/一時停止
+        if (e->key.keysym.sym == SDLK_p && !e->key.repeat) {
+            emu_set_paused(!emu_get_context()->paused);
+        }
+
+        if (e->key.keysym.sym == SDLK_c && !e->key.repeat) {
+            cheat_toggle_all();
         }
 
-        if (e.type == SDL_KEYUP) {
-            ui_on_key(false, e.key.keysym.sym);
+        if (e->key.keysym.sym == SDLK_F12 && !e->key.repeat) {
+            save_screenshot();
         }
 
-        if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_CLOSE) {
+        if (e->key.keysym.sym == SDLK_F1 && !e->key.repeat) {
+            hud_toggle();
+        }
+
+        if (e->key.keysym.sym == SDLK_F2 && !e->key.repeat) {
+            toggle_debug_window();
+        }
+    }
+
+    if (e->type == SDL_KEYUP) {
+        ui_on_key(false, e->key.keysym.sym);
+    }
+
+    //デバッグ表示のウィンドウを閉じた場合は隠すだけ
+    if (e->type == SDL_WINDOWEVENT && e->window.event == SDL_WINDOWEVENT_CLOSE) {
+        if (sdlDebugWindow && e->window.windowID == SDL_GetWindowID(sdlDebugWindow)) {
+            debug_visible = false;
+            SDL_HideWindow(sdlDebugWindow);
+        } else {
             emu_get_context()->die = true;
         }
     }
+
+    //ウィンドウが隠れたりサイズが変わった後は次のフレームを全て描き直す
+    if (e->type == SDL_WINDOWEVENT && (e->window.event == SDL_WINDOWEVENT_EXPOSED ||
+            e->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)) {
+        redraw_all = true;
+    }
+}
+
+void ui_handle_events() {
+    SDL_Event e;
+
+    while (SDL_PollEvent(&e) > 0) {
+        handle_event(&e);
+    }
+}
+
+u32 ui_wait_timeout() {
+    //debug_rateは1以上なので1000を超えない
+    return debug_visible ? 1000 / debug_rate : 1000;
+}
+
+void ui_wait_events(u32 timeout_ms) {
+    SDL_Event e;
+
+    if (SDL_WaitEventTimeout(&e, timeout_ms)) {
+        handle_event(&e);
+    }
+
+    ui_handle_events();
 }
\ No newline at end of file
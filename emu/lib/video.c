@@ -0,0 +1,277 @@
+#include <video.h>
+#include <ppu.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VIDEO_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+static const u32 colors_default[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+
+//変換テーブル。SIMD版はpshufbで引けるようにバイト毎のプレーンに分けて持つ
+typedef struct {
+    u32 argb[VIDEO_COLORS];
+    u16 rgb565[VIDEO_COLORS];
+    u8 gray[VIDEO_COLORS];
+    u8 argb_plane[4][VIDEO_COLORS];     //B, G, R, A
+    u8 rgb565_plane[2][VIDEO_COLORS];   //下位, 上位
+} video_tables;
+
+static video_tables tables;
+static bool tables_ready = false;
+
+//SIMD版の変換関数。変換したピクセル数を返す
+static int (*convert_simd)(const u8 *src, void *dst, int count, video_format fmt) = NULL;
+
+static void select_convert();
+
+void video_set_colors(const u32 *colors) {
+    for (int i=0; i<VIDEO_COLORS; i++) {
+        u32 c = colors ? colors[i] : colors_default[i & 3];
+        u8 r = (c >> 16) & 0xFF;
+        u8 g = (c >> 8) & 0xFF;
+        u8 b = c & 0xFF;
+
+        tables.argb[i] = c;
+        tables.rgb565[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        tables.gray[i] = ((r * 77) + (g * 150) + (b * 29)) >> 8;
+
+        for (int n=0; n<4; n++) {
+            tables.argb_plane[n][i] = (c >> (n * 8)) & 0xFF;
+        }
+
+        tables.rgb565_plane[0][i] = tables.rgb565[i] & 0xFF;
+        tables.rgb565_plane[1][i] = tables.rgb565[i] >> 8;
+    }
+
+    if (!tables_ready) {
+        select_convert();
+    }
+
+    tables_ready = true;
+}
+
+bool video_parse_colors(const char *spec) {
+    u32 colors[12];
+    int count = 0;
+    const char *p = spec;
+
+    while (*p && count < 12) {
+        char *end;
+        unsigned long v = strtoul(p, &end, 16);
+
+        if (end - p != 6) {
+            break;
+        }
+
+        colors[count++] = 0xFF000000 | v;
+        p = end;
+
+        if (*p == ',') {
+            p++;
+        }
+    }
+
+    if (*p || (count != 4 && count != 12)) {
+        printf("Invalid palette: %s (expected 4 or 12 RRGGBB colors)\n", spec);
+        return false;
+    }
+
+    u32 table[VIDEO_COLORS];
+
+    for (int i=0; i<VIDEO_COLORS; i++) {
+        int pal = (i >> 2) > 2 ? 0 : (i >> 2);
+        table[i] = colors[count == 4 ? (i & 3) : (pal * 4) + (i & 3)];
+    }
+
+    video_set_colors(table);
+    return true;
+}
+
+int video_bytes_per_pixel(video_format fmt) {
+    switch(fmt) {
+        case VIDEO_ARGB8888: return 4;
+        case VIDEO_RGB565: return 2;
+        default: return 1;
+    }
+}
+
+static void convert_scalar(const u8 *src, void *dst, int count, video_format fmt) {
+    switch(fmt) {
+        case VIDEO_ARGB8888:
+            for (int i=0; i<count; i++) {
+                ((u32 *)dst)[i] = tables.argb[src[i] & 15];
+            }
+            break;
+        case VIDEO_RGB565:
+            for (int i=0; i<count; i++) {
+                ((u16 *)dst)[i] = tables.rgb565[src[i] & 15];
+            }
+            break;
+        case VIDEO_GRAY8:
+            for (int i=0; i<count; i++) {
+                ((u8 *)dst)[i] = tables.gray[src[i] & 15];
+            }
+            break;
+    }
+}
+
+#ifdef VIDEO_X86_DISPATCH
+//SSSE3
+//16ピクセルずつpshufbで各バイトプレーンを引いてからunpackで並べ直す
+__attribute__((target("ssse3")))
+static int convert_ssse3(const u8 *src, void *dst, int count, video_format fmt) {
+    const __m128i mask = _mm_set1_epi8(15);
+    int i = 0;
+
+    if (fmt == VIDEO_ARGB8888) {
+        __m128i tb = _mm_loadu_si128((const __m128i *)tables.argb_plane[0]);
+        __m128i tg = _mm_loadu_si128((const __m128i *)tables.argb_plane[1]);
+        __m128i tr = _mm_loadu_si128((const __m128i *)tables.argb_plane[2]);
+        __m128i ta = _mm_loadu_si128((const __m128i *)tables.argb_plane[3]);
+
+        for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + i)), mask);
+            __m128i b = _mm_shuffle_epi8(tb, v);
+            __m128i g = _mm_shuffle_epi8(tg, v);
+            __m128i r = _mm_shuffle_epi8(tr, v);
+            __m128i a = _mm_shuffle_epi8(ta, v);
+            __m128i bg_lo = _mm_unpacklo_epi8(b, g);
+            __m128i bg_hi = _mm_unpackhi_epi8(b, g);
+            __m128i ra_lo = _mm_unpacklo_epi8(r, a);
+            __m128i ra_hi = _mm_unpackhi_epi8(r, a);
+            __m128i *out = (__m128i *)((u32 *)dst + i);
+
+            _mm_storeu_si128(out, _mm_unpacklo_epi16(bg_lo, ra_lo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+        }
+    } else if (fmt == VIDEO_RGB565) {
+        __m128i tl = _mm_loadu_si128((const __m128i *)tables.rgb565_plane[0]);
+        __m128i th = _mm_loadu_si128((const __m128i *)tables.rgb565_plane[1]);
+
+        for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + i)), mask);
+            __m128i l = _mm_shuffle_epi8(tl, v);
+            __m128i h = _mm_shuffle_epi8(th, v);
+            __m128i *out = (__m128i *)((u16 *)dst + i);
+
+            _mm_storeu_si128(out, _mm_unpacklo_epi8(l, h));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(l, h));
+        }
+    } else {
+        __m128i tgray = _mm_loadu_si128((const __m128i *)tables.gray);
+
+        for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + i)), mask);
+            _mm_storeu_si128((__m128i *)((u8 *)dst + i), _mm_shuffle_epi8(tgray, v));
+        }
+    }
+
+    return i;
+}
+
+//AVX2
+//32ピクセルずつ。unpackは128bitレーン内で動くので最後にレーンを並べ替える
+__attribute__((target("avx2")))
+static int convert_avx2(const u8 *src, void *dst, int count, video_format fmt) {
+    const __m256i mask = _mm256_set1_epi8(15);
+    int i = 0;
+
+#define LOAD_TABLE(t) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(t)))
+
+    if (fmt == VIDEO_ARGB8888) {
+        __m256i tb = LOAD_TABLE(tables.argb_plane[0]);
+        __m256i tg = LOAD_TABLE(tables.argb_plane[1]);
+        __m256i tr = LOAD_TABLE(tables.argb_plane[2]);
+        __m256i ta = LOAD_TABLE(tables.argb_plane[3]);
+
+        for (; i + 32 <= count; i += 32) {
+            __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src + i)), mask);
+            __m256i b = _mm256_shuffle_epi8(tb, v);
+            __m256i g = _mm256_shuffle_epi8(tg, v);
+            __m256i r = _mm256_shuffle_epi8(tr, v);
+            __m256i a = _mm256_shuffle_epi8(ta, v);
+            __m256i bg_lo = _mm256_unpacklo_epi8(b, g);
+            __m256i bg_hi = _mm256_unpackhi_epi8(b, g);
+            __m256i ra_lo = _mm256_unpacklo_epi8(r, a);
+            __m256i ra_hi = _mm256_unpackhi_epi8(r, a);
+            __m256i p0 = _mm256_unpacklo_epi16(bg_lo, ra_lo);  //0-3 | 16-19
+            __m256i p1 = _mm256_unpackhi_epi16(bg_lo, ra_lo);  //4-7 | 20-23
+            __m256i p2 = _mm256_unpacklo_epi16(bg_hi, ra_hi);  //8-11 | 24-27
+            __m256i p3 = _mm256_unpackhi_epi16(bg_hi, ra_hi);  //12-15 | 28-31
+            __m256i *out = (__m256i *)((u32 *)dst + i);
+
+            _mm256_storeu_si256(out, _mm256_permute2x128_si256(p0, p1, 0x20));
+            _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+            _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+            _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+        }
+    } else if (fmt == VIDEO_RGB565) {
+        __m256i tl = LOAD_TABLE(tables.rgb565_plane[0]);
+        __m256i th = LOAD_TABLE(tables.rgb565_plane[1]);
+
+        for (; i + 32 <= count; i += 32) {
+            __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src + i)), mask);
+            __m256i l = _mm256_shuffle_epi8(tl, v);
+            __m256i h = _mm256_shuffle_epi8(th, v);
+            __m256i lo = _mm256_unpacklo_epi8(l, h);    //0-7 | 16-23
+            __m256i hi = _mm256_unpackhi_epi8(l, h);    //8-15 | 24-31
+            __m256i *out = (__m256i *)((u16 *)dst + i);
+
+            _mm256_storeu_si256(out, _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+    } else {
+        __m256i tgray = LOAD_TABLE(tables.gray);
+
+        for (; i + 32 <= count; i += 32) {
+            __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src + i)), mask);
+            _mm256_storeu_si256((__m256i *)((u8 *)dst + i), _mm256_shuffle_epi8(tgray, v));
+        }
+    }
+
+#undef LOAD_TABLE
+
+    return i;
+}
+#endif
+
+static void select_convert() {
+#ifdef VIDEO_X86_DISPATCH
+    if (__builtin_cpu_supports("avx2")) {
+        convert_simd = convert_avx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        convert_simd = convert_ssse3;
+    }
+#endif
+}
+
+void video_convert(const u8 *src, void *dst, int count, video_format fmt) {
+    int done = 0;
+
+    if (!tables_ready) {
+        video_set_colors(NULL);
+    }
+
+    if (convert_simd) {
+        done = convert_simd(src, dst, count, fmt);
+    }
+
+    //残りのピクセル
+    convert_scalar(src + done, (u8 *)dst + (done * video_bytes_per_pixel(fmt)), count - done, fmt);
+}
+
+void video_convert_frame(const u8 *src, void *dst, int pitch, video_format fmt) {
+    //ピッチが詰まっている場合は1回で変換する
+    if (pitch == XRES * video_bytes_per_pixel(fmt)) {
+        video_convert(src, dst, XRES * YRES, fmt);
+        return;
+    }
+
+    for (int y=0; y<YRES; y++) {
+        video_convert(src + (y * XRES), (u8 *)dst + (y * pitch), XRES, fmt);
+    }
+}
@@ -0,0 +1,184 @@
+#include <vram_view.h>
+#include <ppu.h>
+#include <mem.h>
+#include <pixel.h>
+#include <video.h>
+#include <emu.h>
+#include <tile_cache.h>
+#include <bg_layer.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct {
+    _Atomic bool requested;
+    bool ready;
+    pthread_mutex_t lock;
+    vram_snapshot snap;
+} vram_view_context;
+
+static vram_view_context ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+//UIスレッドがBGマップを描くためのキャッシュ。PPUのものとは別に持つ
+//前回描いたスナップショットのタイルデータと比べて、変わったタイルだけ展開し直す
+typedef struct {
+    tile_cache tiles;
+    bg_layer layers[2];
+    u8 tile_data[TILE_COUNT * 16];
+    bool initialized;
+} vram_view_cache;
+
+static vram_view_cache cache;
+
+//タイルデータは生のカラー番号をBGPの無いグレーで表示する
+static const u8 raw_colors[4] = {
+    VIDEO_PIXEL(0, 0), VIDEO_PIXEL(1, 0), VIDEO_PIXEL(2, 0), VIDEO_PIXEL(3, 0)
+};
+
+void vram_view_request() {
+    atomic_store(&ctx.requested, true);
+    emu_wake_paused();
+}
+
+void vram_view_capture() {
+    if (!atomic_load_explicit(&ctx.requested, memory_order_relaxed)) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    memcpy(ctx.snap.vram, gb_arena.vram, sizeof(ctx.snap.vram));
+    memcpy(ctx.snap.oam, gb_arena.oam, sizeof(ctx.snap.oam));
+    ctx.snap.lcd = *lcd_get_context();
+    ctx.snap.frame = ppu_get_context()->current_frame;
+    ctx.ready = true;
+    pthread_mutex_unlock(&ctx.lock);
+
+    atomic_store(&ctx.requested, false);
+}
+
+bool vram_view_take(vram_snapshot *out) {
+    bool ready;
+
+    pthread_mutex_lock(&ctx.lock);
+    ready = ctx.ready;
+
+    if (ready) {
+        *out = ctx.snap;
+        ctx.ready = false;
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    return ready;
+}
+
+//タイル(0-383)の1行をカラー番号に展開してパレットで変換する
+static void draw_tile_row(const vram_snapshot *snap, u16 tile, u8 row, bool flip,
+                          const u8 *colors, u8 *out) {
+    const u8 *data = snap->vram + (tile * 16) + (row * 2);
+    u8 index[8];
+
+    pixel_decode_row(data[0], data[1], index);
+
+    if (flip) {
+        for (int i=0; i<4; i++) {
+            u8 t = index[i];
+            index[i] = index[7 - i];
+            index[7 - i] = t;
+        }
+    }
+
+    pixel_map_row(index, colors, out, 8);
+}
+
+static void draw_tiles(const vram_snapshot *snap, u8 *out) {
+    for (int tile=0; tile<384; tile++) {
+        int x = VRAM_VIEW_TILES_X + ((tile % 16) * 8);
+        int y = (tile / 16) * 8;
+
+        for (int row=0; row<8; row++) {
+            draw_tile_row(snap, tile, row, false, raw_colors, out + ((y + row) * VRAM_VIEW_W) + x);
+        }
+    }
+}
+
+static void cache_update(const vram_snapshot *snap) {
+    if (!cache.initialized) {
+        tile_cache_init(&cache.tiles);
+        bg_layer_init(&cache.layers[0]);
+        bg_layer_init(&cache.layers[1]);
+        memcpy(cache.tile_data, snap->vram, sizeof(cache.tile_data));
+        cache.initialized = true;
+        return;
+    }
+
+    for (int i=0; i<TILE_COUNT; i++) {
+        if (memcmp(cache.tile_data + (i * 16), snap->vram + (i * 16), 16)) {
+            memcpy(cache.tile_data + (i * 16), snap->vram + (i * 16), 16);
+            tile_cache_invalidate(&cache.tiles, i * 16);
+        }
+    }
+}
+
+//mapは0x9800なら0、0x9C00なら1。LCDC.4のアドレッシングとBGPで描く
+//マップはbg_layerで変わったマスだけ描き直し、行ごとにパレットで変換する
+static void draw_map(const vram_snapshot *snap, int map, int left, u8 *out) {
+    bg_layer *layer = &cache.layers[map];
+
+    bg_layer_update_all(layer, &cache.tiles, snap->vram, 0x1800 + (map * 0x400), BIT(snap->lcd.lcdc, 4));
+
+    for (int y=0; y<256; y++) {
+        pixel_map_row(layer->pixels[y], snap->lcd.bg_colors, out + (y * VRAM_VIEW_W) + left, 256);
+    }
+}
+
+//表示中の範囲をシェードを反転した枠で示す。画面は256×256の中で折り返す
+static void draw_viewport(const vram_snapshot *snap, int left, u8 *out) {
+    u8 sx = snap->lcd.scroll_x;
+    u8 sy = snap->lcd.scroll_y;
+
+    for (int i=0; i<XRES; i++) {
+        u8 x = sx + i;
+        out[(sy * VRAM_VIEW_W) + left + x] ^= 3;
+        out[((u8)(sy + YRES - 1) * VRAM_VIEW_W) + left + x] ^= 3;
+    }
+
+    for (int i=1; i<YRES - 1; i++) {
+        u8 y = sy + i;
+        out[(y * VRAM_VIEW_W) + left + sx] ^= 3;
+        out[(y * VRAM_VIEW_W) + left + (u8)(sx + XRES - 1)] ^= 3;
+    }
+}
+
+//40個のスプライトを8×5に並べる。8×16モードの場合は2タイル分描く
+static void draw_oam(const vram_snapshot *snap, u8 *out) {
+    const oam_entry *entries = (const oam_entry *)snap->oam;
+    int height = BIT(snap->lcd.lcdc, 2) ? 16 : 8;
+
+    for (int i=0; i<40; i++) {
+        const oam_entry *e = &entries[i];
+        const u8 *colors = e->f_pn ? snap->lcd.sp2_colors : snap->lcd.sp1_colors;
+        int x = VRAM_VIEW_OAM_X + ((i % 8) * VRAM_VIEW_OAM_CELL_W) + 2;
+        int y = ((i / 8) * VRAM_VIEW_OAM_CELL_H) + 2;
+        u8 tile = height == 16 ? (e->tile & 0xFE) : e->tile;
+
+        for (int row=0; row<height; row++) {
+            int src = e->f_y_flip ? (height - 1 - row) : row;
+            draw_tile_row(snap, tile + (src / 8), src % 8, e->f_x_flip, colors, out + ((y + row) * VRAM_VIEW_W) + x);
+        }
+    }
+}
+
+void vram_view_render(const vram_snapshot *snap, u8 *out) {
+    memset(out, VIDEO_PIXEL(1, 0), VRAM_VIEW_W * VRAM_VIEW_H);
+
+    draw_tiles(snap, out);
+    cache_update(snap);
+    draw_map(snap, 0, VRAM_VIEW_MAP0_X, out);
+    draw_map(snap, 1, VRAM_VIEW_MAP1_X, out);
+    draw_viewport(snap, BIT(snap->lcd.lcdc, 3) ? VRAM_VIEW_MAP1_X : VRAM_VIEW_MAP0_X, out);
+    draw_oam(snap, out);
+}
@@ -0,0 +1,184 @@
+#include <watch.h>
+#include <bus.h>
+#include <emu.h>
+#include <string.h>
+
+//読み書きウォッチポイントは該当ページのバスハンドラだけをスローパスに差し替える。
+//何も設定されていなければbus_read/bus_writeのコストは変わらない
+
+static watchpoint watches[MAX_WATCHPOINTS];
+
+bool watch_exec_armed = false;
+
+//ブレークした命令を再開時にもう一度止めないためのフラグ
+static bool resume_pending = false;
+static u16 resume_pc;
+
+static void watch_update_hooks() {
+    bool pages[0x100] = {0};
+    watch_exec_armed = false;
+
+    for (int i=0; i<MAX_WATCHPOINTS; i++) {
+        watchpoint *w = &watches[i];
+
+        if (!w->active) {
+            continue;
+        }
+
+        if (w->type & WATCH_EXEC) {
+            watch_exec_armed = true;
+        }
+
+        if (w->type & (WATCH_READ | WATCH_WRITE)) {
+            for (int page = w->start >> 8; page <= (w->end >> 8); page++) {
+                pages[page] = true;
+            }
+        }
+    }
+
+    for (int page = 0; page < 0x100; page++) {
+        bus_set_page_hook(page, BUS_HOOK_WATCH, pages[page]);
+    }
+}
+
+int watch_add(u8 type, u16 start, u16 end, bool has_value, u8 value) {
+    if (end < start) {
+        u16 t = start;
+        start = end;
+        end = t;
+    }
+
+    for (int i=0; i<MAX_WATCHPOINTS; i++) {
+        if (watches[i].active) {
+            continue;
+        }
+
+        watches[i].active = true;
+        watches[i].type = type;
+        watches[i].start = start;
+        watches[i].end = end;
+        watches[i].has_value = has_value;
+        watches[i].value = value;
+
+        watch_update_hooks();
+        return i;
+    }
+
+    fprintf(stderr, "WATCH: too many watchpoints (max %d)\n", MAX_WATCHPOINTS);
+    return -1;
+}
+
+void watch_remove(int id) {
+    if (id < 0 || id >= MAX_WATCHPOINTS) {
+        return;
+    }
+
+    watches[id].active = false;
+    watch_update_hooks();
+}
+
+void watch_clear() {
+    memset(watches, 0, sizeof(watches));
+    resume_pending = false;
+    watch_update_hooks();
+}
+
+bool watch_parse(const char *spec) {
+    u8 type = 0;
+    const char *p = spec;
+
+    for (; *p && *p != ':'; p++) {
+        switch (*p) {
+            case 'r': type |= WATCH_READ; break;
+            case 'w': type |= WATCH_WRITE; break;
+            case 'x': type |= WATCH_EXEC; break;
+            default:
+                fprintf(stderr, "WATCH: invalid type in '%s'\n", spec);
+                return false;
+        }
+    }
+
+    if (*p != ':' || !type) {
+        fprintf(stderr, "WATCH: expected [r|w|rw|x]:START[-END][=VALUE], got '%s'\n", spec);
+        return false;
+    }
+
+    char *end;
+    unsigned long start = strtoul(p + 1, &end, 16);
+    unsigned long last = start;
+    unsigned long value = 0;
+    bool has_value = false;
+
+    if (*end == '-') {
+        last = strtoul(end + 1, &end, 16);
+    }
+
+    if (*end == '=') {
+        value = strtoul(end + 1, &end, 16);
+        has_value = true;
+    }
+
+    if (*end || start > 0xFFFF || last > 0xFFFF || value > 0xFF) {
+        fprintf(stderr, "WATCH: invalid range/value in '%s'\n", spec);
+        return false;
+    }
+
+    return watch_add(type, start, last, has_value, value) >= 0;
+}
+
+static void watch_hit(const char *kind, u16 address, u8 value) {
+    printf("WATCH: %s %04X = %02X\n", kind, address, value);
+    emu_get_context()->paused = true;
+}
+
+static bool watch_match(watchpoint *w, u8 type, u16 address, u8 value) {
+    return w->active && (w->type & type) && BETWEEN(address, w->start, w->end) &&
+        (!w->has_value || w->value == value);
+}
+
+void watch_on_read(u16 address, u8 value) {
+    for (int i=0; i<MAX_WATCHPOINTS; i++) {
+        if (watch_match(&watches[i], WATCH_READ, address, value)) {
+            watch_hit("read", address, value);
+            return;
+        }
+    }
+}
+
+void watch_on_write(u16 address, u8 value) {
+    for (int i=0; i<MAX_WATCHPOINTS; i++) {
+        if (watch_match(&watches[i], WATCH_WRITE, address, value)) {
+            watch_hit("write", address, value);
+            return;
+        }
+    }
+}
+
+//trueを返した場合、命令を実行せずに停止する
+bool watch_check_exec(u16 pc) {
+    if (resume_pending && pc == resume_pc) {
+        resume_pending = false;
+        return false;
+    }
+
+    resume_pending = false;
+
+    for (int i=0; i<MAX_WATCHPOINTS; i++) {
+        if (!watches[i].active || !(watches[i].type & WATCH_EXEC) ||
+            !BETWEEN(pc, watches[i].start, watches[i].end)) {
+            continue;
+        }
+
+        if (watches[i].has_value && watches[i].value != bus_read_raw(pc)) {
+            continue;
+        }
+
+        printf("WATCH: exec %04X\n", pc);
+        emu_get_context()->paused = true;
+        resume_pending = true;
+        resume_pc = pc;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,69 @@
+#include <scaler.h>
+#include <ppu.h>
+#include <video.h>
+
+#include <string.h>
+#include <time.h>
+
+// Times each scaler kernel against its scalar reference on a 160x144 frame.
+// usage: bench_scaler [frames]
+
+typedef void (*scale_fn)(const u8 *src, int w, int h, u8 *dst, int pitch);
+
+static u8 src[160 * 144];
+static u8 out[(160 * 4) * (144 * 4)];
+static u8 ref[(160 * 4) * (144 * 4)];
+
+static double seconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench(const char *name, scale_fn fast, scale_fn slow, int n, int frames) {
+    clock_t start = clock();
+
+    for (int i=0; i<frames; i++) {
+        fast(src, XRES, YRES, out, XRES * n);
+    }
+
+    double t_fast = seconds(start);
+    start = clock();
+
+    for (int i=0; i<frames; i++) {
+        slow(src, XRES, YRES, ref, XRES * n);
+    }
+
+    double t_slow = seconds(start);
+    bool same = !memcmp(out, ref, (XRES * n) * (YRES * n));
+
+    printf("%-10s %8.1f us %8.1f us  x%.2f %s\n", name,
+        t_fast * 1e6 / frames, t_slow * 1e6 / frames,
+        t_fast > 0 ? t_slow / t_fast : 0, same ? "" : "MISMATCH");
+}
+
+static void nearest2(const u8 *s, int w, int h, u8 *d, int p) { scaler_nearest(s, w, h, d, p, 2); }
+static void nearest2_ref(const u8 *s, int w, int h, u8 *d, int p) { scaler_nearest_ref(s, w, h, d, p, 2); }
+static void nearest3(const u8 *s, int w, int h, u8 *d, int p) { scaler_nearest(s, w, h, d, p, 3); }
+static void nearest3_ref(const u8 *s, int w, int h, u8 *d, int p) { scaler_nearest_ref(s, w, h, d, p, 3); }
+static void nearest4(const u8 *s, int w, int h, u8 *d, int p) { scaler_nearest(s, w, h, d, p, 4); }
+static void nearest4_ref(const u8 *s, int w, int h, u8 *d, int p) { scaler_nearest_ref(s, w, h, d, p, 4); }
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 1000;
+    u32 seed = 1;
+
+    // Something tile-like: runs of one shade with occasional edges
+    for (int i=0; i<XRES * YRES; i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = (seed >> 16) % 8 < 6 && i ? src[i - 1] : VIDEO_PIXEL((seed >> 20) & 3, 0);
+    }
+
+    printf("%-10s %11s %11s\n", "kernel", "fast", "reference");
+    bench("nearest2", nearest2, nearest2_ref, 2, frames);
+    bench("nearest3", nearest3, nearest3_ref, 3, frames);
+    bench("nearest4", nearest4, nearest4_ref, 4, frames);
+    bench("scale2x", scaler_scale2x, scaler_scale2x_ref, 2, frames);
+    bench("scale3x", scaler_scale3x, scaler_scale3x_ref, 3, frames);
+    bench("xbr", scaler_xbr, scaler_xbr_ref, 2, frames);
+
+    return 0;
+}
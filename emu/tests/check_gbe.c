@@ -4,7 +4,32 @@
 #include <emu.h>
 
 #include <cpu.h>
+#include <interrupts.h>
 #include <apu.h>
+#include <bus.h>
+#include <watch.h>
+#include <cheat.h>
+#include <patch.h>
+#include <checksum.h>
+#include <romdb.h>
+#include <ppu.h>
+#include <lcd.h>
+#include <mem.h>
+#include <tile_cache.h>
+#include <pixel.h>
+#include <video.h>
+#include <framebuf.h>
+#include <ppu_thread.h>
+#include <scaler.h>
+#include <pacer.h>
+#include <governor.h>
+#include <vram_view.h>
+#include <timer.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 START_TEST(test_nothing) {
     bool b = cpu_step();
@@ -186,6 +211,1246 @@ START_TEST(test_apu_disabled_ignores_writes) {
         "NR51 should be 0x00 after ignored write, got 0x%02X", nr51);
 } END_TEST
 
+// ============================================================================
+// Watchpoint Tests
+// ============================================================================
+
+/**
+ * A write watchpoint with a value condition pauses emulation only when the
+ * matching value is written inside its range, and clearing it restores the
+ * plain bus path.
+ */
+START_TEST(test_watch_write_value_condition) {
+    watch_clear();
+    emu_get_context()->paused = false;
+
+    ck_assert(watch_parse("w:C010-C01F=42"));
+
+    bus_write(0xC010, 0x41);
+    ck_assert_msg(!emu_get_context()->paused, "non-matching value must not break");
+
+    bus_write(0xC020, 0x42);
+    ck_assert_msg(!emu_get_context()->paused, "write outside range must not break");
+
+    bus_write(0xC01F, 0x42);
+    ck_assert_msg(emu_get_context()->paused, "matching write should pause emulation");
+    ck_assert_uint_eq(bus_read(0xC01F), 0x42);
+
+    watch_clear();
+    emu_get_context()->paused = false;
+
+    bus_write(0xC01F, 0x42);
+    ck_assert_msg(!emu_get_context()->paused, "cleared watchpoint must not break");
+} END_TEST
+
+/**
+ * The value condition of an exec breakpoint compares the opcode without
+ * going through the hooked bus, so it does not trigger read watchpoints.
+ */
+START_TEST(test_watch_exec_value_is_unhooked) {
+    watch_clear();
+    emu_get_context()->paused = false;
+
+    bus_write(0xC100, 0x00);
+    ck_assert(watch_parse("r:C100"));
+    ck_assert(watch_parse("x:C100=3E"));
+
+    ck_assert(!watch_check_exec(0xC100));
+    ck_assert_msg(!emu_get_context()->paused, "opcode compare must not fire the read watchpoint");
+
+    watch_clear();
+    bus_write(0xC100, 0x3E);
+    ck_assert(watch_parse("r:C100"));
+    ck_assert(watch_parse("x:C100=3E"));
+
+    ck_assert(watch_check_exec(0xC100));
+
+    watch_clear();
+    emu_get_context()->paused = false;
+} END_TEST
+
+// ============================================================================
+// Cheat Code Tests
+// ============================================================================
+
+/**
+ * Game Genie and GameShark codes decode to the expected address, value and
+ * compare byte; malformed codes are rejected.
+ */
+START_TEST(test_cheat_code_decoding) {
+    cheat c;
+
+    ck_assert(cheat_parse("00A-17B-C49", &c));
+    ck_assert_uint_eq(c.type, CHEAT_GAME_GENIE);
+    ck_assert_uint_eq(c.address, 0x4A17);
+    ck_assert_uint_eq(c.value, 0x00);
+    ck_assert(c.has_compare);
+    ck_assert_uint_eq(c.compare, 0xC8);
+
+    ck_assert(cheat_parse("3EA-0AF", &c));
+    ck_assert_uint_eq(c.address, 0x0A0A);
+    ck_assert_uint_eq(c.value, 0x3E);
+    ck_assert(!c.has_compare);
+
+    ck_assert(cheat_parse("010238CD", &c));
+    ck_assert_uint_eq(c.type, CHEAT_GAMESHARK);
+    ck_assert_uint_eq(c.address, 0xCD38);
+    ck_assert_uint_eq(c.value, 0x02);
+
+    ck_assert(!cheat_parse("01023", &c));
+    ck_assert(!cheat_parse("XYZ-123", &c));
+} END_TEST
+
+/**
+ * GameShark codes are written once per frame; Game Genie codes only
+ * replace reads that match their compare byte. Toggling all cheats is
+ * deferred to the next frame.
+ */
+START_TEST(test_cheat_apply) {
+    cheat_clear();
+
+    ck_assert_int_eq(cheat_add("0142D0C0"), 0);
+    bus_write(0xC0D0, 0x00);
+    cheat_apply_frame();
+    ck_assert_uint_eq(bus_read(0xC0D0), 0x42);
+
+    ck_assert_int_eq(cheat_add("00A-17B-C49"), 1);
+    ck_assert_uint_eq(cheat_filter_read(0x4A17, 0xC8), 0x00);
+    ck_assert_uint_eq(cheat_filter_read(0x4A17, 0x12), 0x12);
+    ck_assert_uint_eq(cheat_filter_read(0x4A18, 0xC8), 0xC8);
+
+    cheat_set_enabled(1, false);
+    ck_assert_uint_eq(cheat_filter_read(0x4A17, 0xC8), 0xC8);
+
+    // Toggling from the UI takes effect at the next frame on the CPU thread
+    cheat_toggle_all();
+    bus_write(0xC0D0, 0x00);
+    cheat_apply_frame();
+    ck_assert_uint_eq(bus_read(0xC0D0), 0x00);
+
+    cheat_toggle_all();
+    cheat_apply_frame();
+    ck_assert_uint_eq(bus_read(0xC0D0), 0x42);
+
+    cheat_clear();
+} END_TEST
+
+// ============================================================================
+// ROM Patch Tests
+// ============================================================================
+
+static void write_file(const char *path, const u8 *data, u32 len) {
+    FILE *fp = fopen(path, "wb");
+    fwrite(data, len, 1, fp);
+    fclose(fp);
+}
+
+/**
+ * IPS normal and RLE records are applied, and a record past the end of the
+ * image grows the target, record by record.
+ */
+START_TEST(test_patch_ips) {
+    u8 source[16];
+    for (int i = 0; i < 16; i++) {
+        source[i] = i;
+    }
+
+    static const u8 ips[] = {
+        'P', 'A', 'T', 'C', 'H',
+        0x00, 0x00, 0x02, 0x00, 0x02, 0xAA, 0xBB,       // offset 2: AA BB
+        0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x03, 0xCC, // offset 8: RLE CC x3
+        0x00, 0x00, 0x10, 0x00, 0x01, 0xDD,             // offset 16: grow
+        0x00, 0x00, 0x11, 0x00, 0x01, 0xEE,             // offset 17: grow again
+        0x00, 0x00, 0x28, 0x00, 0x01, 0xFF,             // offset 40: grow past 2x
+        'E', 'O', 'F'
+    };
+    write_file("check_gbe_patch.ips", ips, sizeof(ips));
+
+    u8 image[16];
+    memcpy(image, source, sizeof(image));
+    u8 *target = image;
+    u32 target_size = sizeof(image);
+
+    ck_assert(patch_apply("check_gbe_patch.ips", source, sizeof(source), &target, &target_size));
+    remove("check_gbe_patch.ips");
+
+    ck_assert_uint_eq(target_size, 41);
+    ck_assert_uint_eq(target[1], 0x01);
+    ck_assert_uint_eq(target[2], 0xAA);
+    ck_assert_uint_eq(target[3], 0xBB);
+    ck_assert_uint_eq(target[8], 0xCC);
+    ck_assert_uint_eq(target[10], 0xCC);
+    ck_assert_uint_eq(target[11], 0x0B);
+    ck_assert_uint_eq(target[16], 0xDD);
+    ck_assert_uint_eq(target[17], 0xEE);
+    ck_assert_uint_eq(target[30], 0x00);
+    ck_assert_uint_eq(target[40], 0xFF);
+
+    // The grown image is a heap copy; the caller's buffer is left alone
+    ck_assert(target != image);
+    ck_assert_uint_eq(image[2], 0xAA);
+    free(target);
+} END_TEST
+
+/**
+ * UPS patches are applied and their CRC32s are verified; a patch made for
+ * a different base ROM is rejected.
+ */
+START_TEST(test_patch_ups_crc) {
+    u8 source[16];
+    u8 expected[16];
+    for (int i = 0; i < 16; i++) {
+        source[i] = expected[i] = i;
+    }
+    expected[4] = 0x55;
+    expected[5] = 0x66;
+
+    u8 ups[64];
+    u32 n = 0;
+    memcpy(ups, "UPS1", 4);
+    n = 4;
+    ups[n++] = 0x80 | 16;               // source size
+    ups[n++] = 0x80 | 16;               // target size
+    ups[n++] = 0x80 | 4;                // skip 4 bytes
+    ups[n++] = source[4] ^ 0x55;
+    ups[n++] = source[5] ^ 0x66;
+    ups[n++] = 0x00;
+
+    u32 crcs[2] = { crc32(source, 16), crc32(expected, 16) };
+    for (int c = 0; c < 2; c++) {
+        for (int b = 0; b < 4; b++) {
+            ups[n++] = (crcs[c] >> (b * 8)) & 0xFF;
+        }
+    }
+    u32 patch_crc = crc32(ups, n);
+    for (int b = 0; b < 4; b++) {
+        ups[n++] = (patch_crc >> (b * 8)) & 0xFF;
+    }
+    write_file("check_gbe_patch.ups", ups, n);
+
+    u8 image[16];
+    memcpy(image, source, sizeof(image));
+    u8 *target = image;
+    u32 target_size = sizeof(image);
+
+    ck_assert(patch_apply("check_gbe_patch.ups", source, sizeof(source), &target, &target_size));
+    ck_assert_mem_eq(target, expected, 16);
+
+    source[0] = 0xFF;
+    memcpy(image, source, sizeof(image));
+    ck_assert_msg(!patch_apply("check_gbe_patch.ups", source, sizeof(source), &target, &target_size),
+        "patch for a different base ROM must fail CRC validation");
+    remove("check_gbe_patch.ups");
+} END_TEST
+
+// ============================================================================
+// ROM Index Tests
+// ============================================================================
+
+/**
+ * An index whose entry count cannot fit in the file is rejected instead of
+ * being allocated.
+ */
+START_TEST(test_romdb_rejects_bad_count) {
+    static const u8 index[] = {
+        'G', 'B', 'I', 'X', 1, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0
+    };
+    romdb db;
+
+    mkdir("check_gbe_romdb", 0755);
+    write_file("check_gbe_romdb/" ROMDB_FILE, index, sizeof(index));
+
+    ck_assert(!romdb_load("check_gbe_romdb", &db));
+    ck_assert_uint_eq(db.count, 0);
+    ck_assert(db.entries == NULL);
+
+    remove("check_gbe_romdb/" ROMDB_FILE);
+    rmdir("check_gbe_romdb");
+} END_TEST
+
+/**
+ * ROMs that cannot be read are left out of the saved index, so a later
+ * scan picks them up again instead of trusting an empty entry.
+ */
+START_TEST(test_romdb_retries_unreadable) {
+    static u8 rom[0x150];
+    romdb db;
+
+    mkdir("check_gbe_romdb", 0755);
+    write_file("check_gbe_romdb/ok.gb", rom, sizeof(rom));
+    write_file("check_gbe_romdb/empty.gb", rom, 0);
+
+    ck_assert(romdb_index("check_gbe_romdb", 1));
+    ck_assert(romdb_load("check_gbe_romdb", &db));
+    ck_assert_uint_eq(db.count, 1);
+    ck_assert_str_eq(db.entries[0].name, "ok.gb");
+    romdb_free(&db);
+
+    write_file("check_gbe_romdb/empty.gb", rom, sizeof(rom));
+
+    ck_assert(romdb_index("check_gbe_romdb", 1));
+    ck_assert(romdb_load("check_gbe_romdb", &db));
+    ck_assert_uint_eq(db.count, 2);
+    ck_assert_uint_eq(db.entries[0].crc32, crc32(rom, sizeof(rom)));
+    romdb_free(&db);
+
+    remove("check_gbe_romdb/ok.gb");
+    remove("check_gbe_romdb/empty.gb");
+    remove("check_gbe_romdb/" ROMDB_FILE);
+    rmdir("check_gbe_romdb");
+} END_TEST
+
+// ============================================================================
+// Checksum Tests
+// ============================================================================
+
+/**
+ * CRC32 and SHA-1 match the standard test vectors.
+ */
+START_TEST(test_checksum_vectors) {
+    static const u8 sha1_abc[20] = {
+        0xA9, 0x99, 0x3E, 0x36, 0x47, 0x06, 0x81, 0x6A, 0xBA, 0x3E,
+        0x25, 0x71, 0x78, 0x50, 0xC2, 0x6C, 0x9C, 0xD0, 0xD8, 0x9D
+    };
+    static const u8 sha1_empty[20] = {
+        0xDA, 0x39, 0xA3, 0xEE, 0x5E, 0x6B, 0x4B, 0x0D, 0x32, 0x55,
+        0xBF, 0xEF, 0x95, 0x60, 0x18, 0x90, 0xAF, 0xD8, 0x07, 0x09
+    };
+    u8 digest[20];
+
+    ck_assert_uint_eq(crc32((const u8 *)"123456789", 9), 0xCBF43926);
+    ck_assert_uint_eq(crc32_update(crc32((const u8 *)"1234", 4), (const u8 *)"56789", 5), 0xCBF43926);
+
+    sha1((const u8 *)"abc", 3, digest);
+    ck_assert_mem_eq(digest, sha1_abc, 20);
+
+    sha1((const u8 *)"", 0, digest);
+    ck_assert_mem_eq(digest, sha1_empty, 20);
+} END_TEST
+
+// ============================================================================
+// Snapshot Tests
+// ============================================================================
+
+/**
+ * Restoring a machine snapshot brings back the CPU registers, the timer and
+ * the LCD/PPU position along with memory, so the machine runs on from the
+ * restored point exactly as it did the first time.
+ */
+START_TEST(test_snapshot_restores_machine_state) {
+    u8 *snap = malloc(mem_snapshot_size());
+    ck_assert(snap != NULL);
+
+    ppu_set_renderer(PPU_RENDER_FIFO);
+    ppu_init();
+    timer_init();
+    cpu_init();
+    cpu_set_int_flags(0);
+
+    cpu_get_regs()->pc = 0x1234;
+    cpu_get_regs()->a = 0x56;
+    timer_write(0xFF07, 0x05);
+    gb_arena.wram[0x10] = 0x77;
+
+    for (int i=0; i<1000; i++) {
+        ppu_tick();
+        timer_tick();
+    }
+
+    mem_snapshot(snap);
+
+    timer_context timer = *timer_get_context();
+    u8 ly = lcd_get_context()->ly;
+    u32 line_ticks = ppu_get_context()->line_ticks;
+
+    // Run on, then record where the machine ends up
+    for (int i=0; i<5000; i++) {
+        ppu_tick();
+        timer_tick();
+    }
+
+    timer_context timer_after = *timer_get_context();
+    u8 ly_after = lcd_get_context()->ly;
+    u8 int_flags_after = cpu_get_int_flags();
+
+    cpu_get_regs()->pc = 0x4321;
+    cpu_get_regs()->a = 0;
+    gb_arena.wram[0x10] = 0;
+    lcd_write(0xFF42, 0x40);
+
+    mem_restore(snap);
+
+    ck_assert_uint_eq(cpu_get_regs()->pc, 0x1234);
+    ck_assert_uint_eq(cpu_get_regs()->a, 0x56);
+    ck_assert_uint_eq(gb_arena.wram[0x10], 0x77);
+    ck_assert_uint_eq(lcd_get_context()->scroll_y, 0);
+    ck_assert_uint_eq(lcd_get_context()->ly, ly);
+    ck_assert_uint_eq(ppu_get_context()->line_ticks, line_ticks);
+    ck_assert_mem_eq(timer_get_context(), &timer, sizeof(timer));
+
+    for (int i=0; i<5000; i++) {
+        ppu_tick();
+        timer_tick();
+    }
+
+    ck_assert_mem_eq(timer_get_context(), &timer_after, sizeof(timer_after));
+    ck_assert_uint_eq(lcd_get_context()->ly, ly_after);
+    ck_assert_uint_eq(cpu_get_int_flags(), int_flags_after);
+
+    free(snap);
+} END_TEST
+
+// ============================================================================
+// PPU Renderer Tests
+// ============================================================================
+
+/**
+ * Render one frame of pseudo-random VRAM/OAM with the given renderer.
+ * SCX, the BG map and BGP change during HBlank on a few lines. If mid_line
+ * is set, SCY is rewritten in the middle of mode 3 on line 60 to exercise
+ * the FIFO fallback.
+ */
+static void render_test_frame(ppu_renderer renderer, bool mid_line, u8 *out) {
+    u32 seed = 12345;
+
+    ppu_set_renderer(renderer);
+    ppu_init();
+
+    for (int i=0; i<0x2000; i++) {
+        seed = seed * 1103515245 + 12345;
+        ppu_vram_write(0x8000 + i, seed >> 16);
+    }
+
+    for (int i=0; i<0xA0; i++) {
+        seed = seed * 1103515245 + 12345;
+        ppu_oam_write(0xFE00 + i, i % 4 == 1 ? (seed >> 16) % 176 : seed >> 16);
+    }
+
+    lcd_write(0xFF40, 0xE3);
+    lcd_write(0xFF42, 5);
+    lcd_write(0xFF43, 3);
+    lcd_write(0xFF4A, 30);
+    lcd_write(0xFF4B, 50);
+    lcd_write(0xFF48, 0xE4);
+    lcd_write(0xFF49, 0x1B);
+
+    for (int i=0; i<LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+        ppu_tick();
+
+        if (mid_line && lcd_get_context()->ly == 60 && ppu_get_context()->line_ticks == 150) {
+            lcd_write(0xFF42, 9);
+        }
+
+        if (ppu_get_context()->line_ticks == 400) {
+            if (lcd_get_context()->ly == 30) {
+                lcd_write(0xFF43, 17);
+            } else if (lcd_get_context()->ly == 90) {
+                ppu_vram_write(0x9800 + ((95 + 5) / 8) * 32 + 4, 0x42);
+            } else if (lcd_get_context()->ly == 100) {
+                lcd_write(0xFF47, 0x1B);
+            }
+        }
+    }
+
+    // Let the PPU thread drain its log before reading the frame
+    ppu_thread_stop();
+    memcpy(out, framebuf_acquire(NULL), XRES * YRES);
+}
+
+/**
+ * The scanline renderer produces the same frame as the FIFO pipeline.
+ */
+START_TEST(test_scanline_matches_fifo) {
+    static u8 fifo_frame[160 * 144];
+    static u8 scanline_frame[160 * 144];
+
+    render_test_frame(PPU_RENDER_FIFO, true, fifo_frame);
+    render_test_frame(PPU_RENDER_SCANLINE, true, scanline_frame);
+    ppu_set_renderer(PPU_RENDER_FIFO);
+
+    ck_assert_mem_eq(fifo_frame, scanline_frame, sizeof(fifo_frame));
+} END_TEST
+
+/**
+ * The PPU thread renders the same frame from the register-write log when
+ * there are no writes in the middle of mode 3, both line by line and split
+ * across a pool of render threads.
+ */
+START_TEST(test_ppu_thread_matches_fifo) {
+    static u8 fifo_frame[160 * 144];
+    static u8 thread_frame[160 * 144];
+    static u8 pool_frame[160 * 144];
+
+    render_test_frame(PPU_RENDER_FIFO, false, fifo_frame);
+    render_test_frame(PPU_RENDER_THREAD, false, thread_frame);
+
+    ppu_thread_set_render_threads(4);
+    render_test_frame(PPU_RENDER_THREAD, false, pool_frame);
+    ppu_thread_set_render_threads(1);
+    ppu_set_renderer(PPU_RENDER_FIFO);
+
+    ck_assert(!ppu_thread_running());
+    ck_assert_mem_eq(fifo_frame, thread_frame, sizeof(fifo_frame));
+    ck_assert_mem_eq(fifo_frame, pool_frame, sizeof(fifo_frame));
+} END_TEST
+
+/**
+ * Run two frames and record LY, STAT and IF after every dot. The second
+ * frame is optionally skipped; SCX changes every line so mode 3 length varies.
+ */
+static u32 trace_skip_frames(bool skip, u8 *trace) {
+    u32 published = framebuf_frame_count();
+    int n = 0;
+
+    ppu_set_renderer(PPU_RENDER_SCANLINE);
+    ppu_init();
+    cpu_set_int_flags(0);
+
+    lcd_write(0xFF40, 0xE3);
+    lcd_write(0xFF41, 0x78);
+    lcd_write(0xFF45, 70);
+
+    for (int f=0; f<2; f++) {
+        ppu_skip_frame(skip && f == 0);
+
+        for (int i=0; i<LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+            if (ppu_get_context()->line_ticks == 0) {
+                lcd_write(0xFF43, lcd_get_context()->ly % 8);
+            }
+
+            ppu_tick();
+            trace[n++] = lcd_get_context()->ly;
+            trace[n++] = lcd_get_context()->lcds;
+            trace[n++] = cpu_get_int_flags();
+        }
+    }
+
+    ppu_skip_frame(false);
+    ppu_set_renderer(PPU_RENDER_FIFO);
+    return framebuf_frame_count() - published;
+}
+
+/**
+ * A skipped frame keeps the exact mode/LY/STAT/interrupt timing and is not
+ * published to the frame buffer.
+ */
+START_TEST(test_skip_frame_timing) {
+    static u8 normal[2 * 154 * 456 * 3];
+    static u8 skipped[2 * 154 * 456 * 3];
+
+    ck_assert_uint_eq(trace_skip_frames(false, normal), 2);
+    ck_assert_uint_eq(trace_skip_frames(true, skipped), 1);
+    ck_assert_mem_eq(normal, skipped, sizeof(normal));
+} END_TEST
+
+/**
+ * With the LCD off, LY stays 0 in mode 0 without interrupts. Turning it
+ * back on starts a fresh frame whose first VBlank is 144 lines later.
+ */
+START_TEST(test_lcd_off_holds_state) {
+    ppu_init();
+    cpu_set_int_flags(0);
+
+    lcd_write(0xFF41, 0x78);
+
+    for (int i=0; i<1000; i++) {
+        ppu_tick();
+    }
+
+    u32 published = framebuf_frame_count();
+    lcd_write(0xFF40, 0x11);
+
+    ck_assert_uint_eq(framebuf_frame_count(), published + 1);
+    ck_assert_uint_eq(framebuf_acquire(NULL)[0], VIDEO_PIXEL(0, 0));
+
+    cpu_set_int_flags(0);
+    u32 frame = ppu_get_context()->current_frame;
+
+    for (int i=0; i<3 * LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+        ppu_tick();
+        ck_assert_uint_eq(lcd_get_context()->ly, 0);
+        ck_assert_uint_eq(LCDS_MODE, MODE_HBLANK);
+    }
+
+    ck_assert_uint_eq(cpu_get_int_flags(), 0);
+
+    // Frame time keeps passing for the pacer while the screen is off
+    ck_assert_uint_eq(ppu_get_context()->current_frame, frame + 3);
+
+    lcd_write(0xFF40, 0x91);
+    ck_assert_uint_eq(LCDS_MODE, MODE_OAM);
+
+    for (int i=0; i<YRES * TICKS_PER_LINE; i++) {
+        ck_assert_uint_eq(cpu_get_int_flags() & IT_VBLANK, 0);
+        ppu_tick();
+    }
+
+    ck_assert_uint_eq(lcd_get_context()->ly, YRES);
+    ck_assert(cpu_get_int_flags() & IT_VBLANK);
+} END_TEST
+
+/**
+ * Tile cache rows follow VRAM writes, including the flipped variant.
+ */
+START_TEST(test_tile_cache_invalidation) {
+    static const u8 row0[8] = {0, 1, 2, 3, 0, 1, 2, 3};
+    static const u8 row0_flipped[8] = {3, 2, 1, 0, 3, 2, 1, 0};
+    static const u8 row0_new[8] = {3, 3, 3, 3, 3, 3, 3, 3};
+    tile_cache *tc = tile_cache_get();
+
+    ppu_init();
+
+    // Tile 257 (0x9010), row 0: lo=0x55, hi=0x33
+    ppu_vram_write(0x9010, 0x55);
+    ppu_vram_write(0x9011, 0x33);
+
+    ck_assert_mem_eq(tile_cache_row(tc, gb_arena.vram, 257, 0, false), row0, 8);
+    ck_assert_mem_eq(tile_cache_row(tc, gb_arena.vram, 257, 0, true), row0_flipped, 8);
+
+    ppu_vram_write(0x9010, 0xFF);
+    ppu_vram_write(0x9011, 0xFF);
+
+    ck_assert_mem_eq(tile_cache_row(tc, gb_arena.vram, 257, 0, false), row0_new, 8);
+} END_TEST
+
+/**
+ * Every pixel kernel variant the CPU supports matches a plain bit loop
+ * for all 65536 bitplane pairs.
+ */
+START_TEST(test_pixel_kernels_match_scalar) {
+    static const u32 palette[4] = {0xFFE0F8D0, 0xFF88C070, 0xFF346856, 0xFF081820};
+    pixel_isa prev = pixel_get_isa();
+
+    pixel_init();
+
+    for (int isa = PIXEL_ISA_SCALAR; isa <= PIXEL_ISA_BMI2; isa++) {
+        if (!pixel_use_isa(isa)) {
+            continue;
+        }
+
+        for (int v = 0; v < 0x10000; v++) {
+            u8 lo = v & 0xFF;
+            u8 hi = v >> 8;
+            u8 expect[8];
+            u8 index[8];
+            u32 argb[8];
+
+            for (int i = 0; i < 8; i++) {
+                expect[i] = ((lo >> (7 - i)) & 1) | (((hi >> (7 - i)) & 1) << 1);
+            }
+
+            pixel_decode_row(lo, hi, index);
+            ck_assert_mem_eq(index, expect, 8);
+
+            pixel_decode_row_argb(lo, hi, palette, argb);
+
+            for (int i = 0; i < 8; i++) {
+                ck_assert_uint_eq(argb[i], palette[expect[i]]);
+            }
+        }
+
+        static const u8 shades[4] = {0x03, 0x06, 0x09, 0x0C};
+        u8 row[45];
+        u8 mapped[45];
+
+        for (int i = 0; i < 45; i++) {
+            row[i] = (i * 7) & 3;
+        }
+
+        pixel_map_row(row, shades, mapped, 45);
+
+        for (int i = 0; i < 45; i++) {
+            ck_assert_uint_eq(mapped[i], shades[row[i]]);
+        }
+    }
+
+    pixel_use_isa(prev);
+} END_TEST
+
+/**
+ * The per-line sprite index kept up to date by OAM writes matches a full
+ * scan of OAM, for both sprite heights.
+ */
+START_TEST(test_sprite_index_incremental) {
+    u32 seed = 777;
+
+    ppu_init();
+    ppu_sprite_index_line(0, 8);
+
+    for (int i = 0; i < 2000; i++) {
+        seed = seed * 1103515245 + 12345;
+        ppu_oam_write(0xFE00 + ((seed >> 16) % 40) * 4, (seed >> 8) % 176);
+    }
+
+    for (int height = 8; height <= 16; height += 8) {
+        for (int ly = 0; ly < 144; ly++) {
+            u64 expect = 0;
+
+            for (int n = 0; n < 40; n++) {
+                int y = ppu_get_context()->oam_ram[n].y;
+
+                if (y - 16 <= ly && y - 16 + height > ly) {
+                    expect |= 1ULL << n;
+                }
+            }
+
+            ck_assert(ppu_sprite_index_line(ly, height) == expect);
+        }
+    }
+} END_TEST
+
+/**
+ * The BG layer cache redraws a cell when either its map entry or the tile
+ * data it points at changes.
+ */
+START_TEST(test_bg_layer_updates) {
+    static const u8 zero[8] = {0};
+    static const u8 ones[8] = {3, 3, 3, 3, 3, 3, 3, 3};
+    bg_layer *layer = bg_layer_get(0);
+    const u8 *row;
+
+    ppu_init();
+    memset(gb_arena.vram, 0, sizeof(gb_arena.vram));
+    tile_cache_invalidate_all(tile_cache_get());
+
+    row = bg_layer_row(layer, tile_cache_get(), gb_arena.vram, 0x1800, true, 8, 0, 32);
+    ck_assert_mem_eq(row + 8, zero, 8);
+
+    // Tile 1 row 0 becomes color 3, then map cell (1, 1) points at it
+    ppu_vram_write(0x8010, 0xFF);
+    ppu_vram_write(0x8011, 0xFF);
+    row = bg_layer_row(layer, tile_cache_get(), gb_arena.vram, 0x1800, true, 8, 0, 32);
+    ck_assert_mem_eq(row + 8, zero, 8);
+
+    ppu_vram_write(0x9821, 0x01);
+    row = bg_layer_row(layer, tile_cache_get(), gb_arena.vram, 0x1800, true, 8, 0, 32);
+    ck_assert_mem_eq(row + 8, ones, 8);
+
+    ppu_vram_write(0x8010, 0x00);
+    ppu_vram_write(0x8011, 0x00);
+    row = bg_layer_row(layer, tile_cache_get(), gb_arena.vram, 0x1800, true, 8, 0, 32);
+    ck_assert_mem_eq(row + 8, zero, 8);
+} END_TEST
+
+/**
+ * Frame conversion maps shade/palette pixels through the 16-entry color
+ * table for every output format, including the scalar tail.
+ */
+START_TEST(test_video_convert_formats) {
+    u8 src[45];
+    u32 argb[45];
+    u16 rgb565[45];
+    u8 gray[45];
+
+    ck_assert(video_parse_colors("FFFFFF,AAAAAA,555555,000000,"
+        "FF0000,AA0000,550000,000000,0000FF,0000AA,000055,000000"));
+    ck_assert(!video_parse_colors("FFFFFF,AAAAAA"));
+
+    for (int i = 0; i < 45; i++) {
+        src[i] = VIDEO_PIXEL(i & 3, (i >> 2) % 3);
+    }
+
+    video_convert(src, argb, 45, VIDEO_ARGB8888);
+    video_convert(src, rgb565, 45, VIDEO_RGB565);
+    video_convert(src, gray, 45, VIDEO_GRAY8);
+
+    ck_assert_uint_eq(argb[0], 0xFFFFFFFF);
+    ck_assert_uint_eq(argb[5], 0xFFAA0000);
+    ck_assert_uint_eq(argb[10], 0xFF000055);
+    ck_assert_uint_eq(argb[44], 0xFF0000FF);
+    ck_assert_uint_eq(rgb565[0], 0xFFFF);
+    ck_assert_uint_eq(rgb565[4], 0xF800);
+    ck_assert_uint_eq(rgb565[8], 0x001F);
+    ck_assert_uint_eq(gray[3], 0);
+    ck_assert_uint_eq(gray[4], (0xFF * 77) >> 8);
+
+    for (int i = 0; i < 45; i++) {
+        u32 c = argb[i];
+        ck_assert_uint_eq(rgb565[i], (((c >> 19) & 0x1F) << 11) | (((c >> 10) & 0x3F) << 5) | ((c >> 3) & 0x1F));
+    }
+
+    video_set_colors(NULL);
+} END_TEST
+
+/**
+ * Triple buffer: the reader always sees a whole frame, never the one being
+ * written, and frame numbers only move forward.
+ */
+static void *framebuf_writer(void *arg) {
+    int frames = *(int *)arg;
+    u8 *back = framebuf_back();
+
+    for (int i = 1; i <= frames; i++) {
+        memset(back, framebuf_frame_count() + 1, FRAMEBUF_SIZE);
+        back = framebuf_publish();
+    }
+
+    return NULL;
+}
+
+START_TEST(test_framebuf_no_tearing) {
+    int frames = 2000;
+    u32 base = framebuf_frame_count();
+    u32 last = 0;
+    pthread_t writer;
+
+    framebuf_acquire(&last);
+    pthread_create(&writer, NULL, framebuf_writer, &frames);
+
+    while (last < base + frames) {
+        u32 frame;
+        const u8 *p = framebuf_acquire(&frame);
+
+        ck_assert_uint_ge(frame, last);
+
+        if (frame > base) {
+            for (int i = 0; i < FRAMEBUF_SIZE; i++) {
+                ck_assert_uint_eq(p[i], (u8)frame);
+            }
+        }
+
+        last = frame;
+    }
+
+    pthread_join(writer, NULL);
+} END_TEST
+
+static int notify_count;
+static u32 notify_frame;
+
+static void count_notify() {
+    notify_count++;
+    notify_frame = framebuf_frame_count();
+}
+
+/**
+ * The debug viewer gets a VRAM/OAM copy only when it asked for one, taken
+ * at the start of VBlank (or at the frame boundary while the LCD is off), and renders tiles, both BG maps (with the LCDC
+ * tile addressing and the SCX/SCY outline) and sprites from that copy.
+ */
+START_TEST(test_vram_view_snapshot) {
+    static vram_snapshot snap;
+    static vram_snapshot later;
+    static u8 out[VRAM_VIEW_W * VRAM_VIEW_H];
+
+    ppu_init();
+    cpu_set_int_flags(0);
+
+    // Tile 1 is all color 1, tile 2 has color 1 only in its leftmost column,
+    // tile 256 (0x9000) is all color 2
+    for (int row=0; row<8; row++) {
+        gb_arena.vram[0x10 + (row * 2)] = 0xFF;
+        gb_arena.vram[0x20 + (row * 2)] = 0x80;
+        gb_arena.vram[0x1001 + (row * 2)] = 0xFF;
+    }
+
+    gb_arena.vram[0x1800] = 1;
+    gb_arena.vram[0x1C00] = 0;
+    gb_arena.oam[2] = 2;
+    gb_arena.oam[3] = 0x20;     // X flip, OBP0
+
+    // Nothing is copied while the viewer is closed
+    for (int i=0; i<LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+        ppu_tick();
+    }
+
+    ck_assert(!vram_view_take(&snap));
+
+    vram_view_request();
+
+    for (int i=0; i<LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+        ppu_tick();
+    }
+
+    ck_assert(vram_view_take(&snap));
+    ck_assert(!vram_view_take(&snap));
+    ck_assert_uint_eq(snap.frame, ppu_get_context()->current_frame - 1);
+
+    // A write after the copy is not taken at the next VBlank unless the
+    // viewer asks again, and then it shows up
+    gb_arena.vram[0x1800] = 2;
+
+    for (int i=0; i<LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+        ppu_tick();
+    }
+
+    ck_assert(!vram_view_take(&later));
+
+    vram_view_request();
+
+    for (int i=0; i<LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+        ppu_tick();
+    }
+
+    ck_assert(vram_view_take(&later));
+    ck_assert_uint_eq(later.vram[0x1800], 2);
+
+    vram_view_render(&snap, out);
+
+    ck_assert_uint_eq(out[VRAM_VIEW_TILES_X + 9 + VRAM_VIEW_W], VIDEO_PIXEL(1, 0));
+    ck_assert_uint_eq(out[VRAM_VIEW_TILES_X + 1 + VRAM_VIEW_W], VIDEO_PIXEL(0, 0));
+
+    // LCDC.4 = 1: map entries index 0x8000 unsigned
+    ck_assert_uint_eq(out[VRAM_VIEW_MAP0_X + 1 + VRAM_VIEW_W], snap.lcd.bg_colors[1]);
+    ck_assert_uint_eq(out[VRAM_VIEW_MAP1_X + 1 + VRAM_VIEW_W], snap.lcd.bg_colors[0]);
+
+    // The visible area (SCX = SCY = 0 on 0x9800) is outlined
+    ck_assert_uint_eq(out[VRAM_VIEW_MAP0_X + 1], snap.lcd.bg_colors[1] ^ 3);
+    ck_assert_uint_eq(out[VRAM_VIEW_MAP1_X + 1], snap.lcd.bg_colors[0]);
+
+    // Sprite 0 is tile 2 flipped horizontally
+    int sprite = VRAM_VIEW_OAM_X + 2 + ((2 + 1) * VRAM_VIEW_W);
+    ck_assert_uint_eq(out[sprite], snap.lcd.sp1_colors[0]);
+    ck_assert_uint_eq(out[sprite + 7], snap.lcd.sp1_colors[1]);
+
+    // LCDC.4 = 0: map entries index 0x9000 signed
+    snap.lcd.lcdc &= ~0x10;
+    vram_view_render(&snap, out);
+
+    ck_assert_uint_eq(out[VRAM_VIEW_MAP1_X + 1 + VRAM_VIEW_W], snap.lcd.bg_colors[2]);
+
+    // With the LCD off there is no VBlank, but the copy is still taken
+    lcd_get_context()->lcdc &= ~0x80;
+    vram_view_request();
+
+    for (int i=0; i<LINES_PER_FRAME * TICKS_PER_LINE; i++) {
+        ppu_tick();
+    }
+
+    ck_assert(vram_view_take(&snap));
+    ck_assert_uint_eq(snap.vram[0x1800], 2);
+    ck_assert(!BIT(snap.lcd.lcdc, 7));
+
+    // The maps are cached per cell; a changed map entry and then changed
+    // tile data in a later snapshot both show up
+    // (column 0 is under the viewport outline, so look at column 2)
+    vram_view_render(&snap, out);
+    ck_assert_uint_eq(out[VRAM_VIEW_MAP0_X + 2 + VRAM_VIEW_W], snap.lcd.bg_colors[0]);
+
+    snap.vram[0x20 + 2] = 0xFF;
+    vram_view_render(&snap, out);
+    ck_assert_uint_eq(out[VRAM_VIEW_MAP0_X + 2 + VRAM_VIEW_W], snap.lcd.bg_colors[1]);
+} END_TEST
+
+/**
+ * The publish notification fires once per frame, after the frame counter
+ * already shows the new frame, and stops once it is unregistered.
+ */
+START_TEST(test_framebuf_notify) {
+    notify_count = 0;
+    framebuf_set_notify(count_notify);
+
+    framebuf_publish();
+    ck_assert_int_eq(notify_count, 1);
+    ck_assert_uint_eq(notify_frame, framebuf_frame_count());
+
+    framebuf_publish();
+    ck_assert_int_eq(notify_count, 2);
+
+    framebuf_set_notify(NULL);
+    framebuf_publish();
+    ck_assert_int_eq(notify_count, 2);
+} END_TEST
+
+/**
+ * Line hashes computed at publish mark only the lines that changed since
+ * the frame the reader last looked at, even when frames were skipped.
+ */
+START_TEST(test_framebuf_dirty_lines) {
+    static u64 seen[FRAMEBUF_LINES];
+    framebuf_dirty dirty;
+    u8 *back = framebuf_back();
+
+    memset(back, 1, FRAMEBUF_SIZE);
+    back = framebuf_publish();
+    framebuf_acquire(NULL);
+    ck_assert_int_eq(framebuf_dirty_lines(seen, &dirty), FRAMEBUF_LINES);
+
+    memset(back, 1, FRAMEBUF_SIZE);
+    back = framebuf_publish();
+    framebuf_acquire(NULL);
+    ck_assert_int_eq(framebuf_dirty_lines(seen, &dirty), 0);
+
+    // Two frames published before the read: lines changed in either show up
+    memset(back, 1, FRAMEBUF_SIZE);
+    back[77 * 160 + 3] = 2;
+    back = framebuf_publish();
+    memset(back, 1, FRAMEBUF_SIZE);
+    back[77 * 160 + 3] = 2;
+    back[143 * 160 + 159] = 3;
+    framebuf_publish();
+    framebuf_acquire(NULL);
+
+    ck_assert_int_eq(framebuf_dirty_lines(seen, &dirty), 2);
+    ck_assert(FRAMEBUF_LINE_DIRTY(&dirty, 77));
+    ck_assert(FRAMEBUF_LINE_DIRTY(&dirty, 143));
+    ck_assert(!FRAMEBUF_LINE_DIRTY(&dirty, 76));
+} END_TEST
+
+/**
+ * Every scaler kernel matches its scalar reference, including widths that
+ * leave a tail after the 16-pixel SIMD blocks. The SIMD rows run only on
+ * CPUs with SSSE3; elsewhere only the scalar kernels are compared.
+ */
+START_TEST(test_scaler_matches_reference) {
+    static u8 src[160 * 144];
+    static u8 out[160 * 144 * 16];
+    static u8 ref[160 * 144 * 16];
+    const int sizes[][2] = {{160, 144}, {37, 23}};
+    u32 seed = 99;
+
+    if (!pixel_isa_supported(PIXEL_ISA_SSSE3)) {
+        printf("test_scaler_matches_reference: no SSSE3, skipping the SIMD kernels\n");
+    }
+
+    // Long runs of the same pixel so the rules actually fire
+    for (int i=0; i<160 * 144; i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = (seed >> 16) % 7 < 5 && i ? src[i - 1] : VIDEO_PIXEL((seed >> 20) & 3, (seed >> 24) % 3);
+    }
+
+    for (int n=0; n<2; n++) {
+        int w = sizes[n][0];
+        int h = sizes[n][1];
+
+        for (int factor=2; factor<=4; factor++) {
+            memset(out, 0xEE, sizeof(out));
+            memset(ref, 0xEE, sizeof(ref));
+            scaler_nearest(src, w, h, out, w * factor, factor);
+            scaler_nearest_ref(src, w, h, ref, w * factor, factor);
+            ck_assert_mem_eq(out, ref, sizeof(out));
+        }
+
+        scaler_scale2x(src, w, h, out, w * 2);
+        scaler_scale2x_ref(src, w, h, ref, w * 2);
+        ck_assert_mem_eq(out, ref, w * h * 4);
+
+        scaler_scale3x(src, w, h, out, w * 3);
+        scaler_scale3x_ref(src, w, h, ref, w * 3);
+        ck_assert_mem_eq(out, ref, w * h * 9);
+
+        scaler_xbr(src, w, h, out, w * 2);
+        scaler_xbr_ref(src, w, h, ref, w * 2);
+        ck_assert_mem_eq(out, ref, w * h * 4);
+    }
+
+    // Scale2x fills only the inner corners of a diagonal step
+    u8 diag[4] = {1, 0, 0, 0};
+    scaler_scale2x_ref(diag, 2, 2, out, 4);
+    ck_assert_uint_eq(out[(1 * 4) + 2], 0);
+    ck_assert_uint_eq(out[(2 * 4) + 1], 0);
+    ck_assert_uint_eq(out[0], 1);
+} END_TEST
+
+/**
+ * The governor steps down one level at a time under sustained overload,
+ * holds its level in the hysteresis band, and steps back up only after a
+ * longer stretch of headroom, restoring the configured renderer and audio
+ * quality. It never raises the audio quality above the configured one.
+ */
+START_TEST(test_governor_hysteresis) {
+    const double budget = 16.74;
+
+    ppu_set_renderer(PPU_RENDER_FIFO);
+    apu_set_quality(APU_QUALITY_LOW);
+    governor_enable(true);
+
+    for (int i=0; i<GOVERNOR_DEGRADE_FRAMES; i++) {
+        governor_frame(budget * 1.5, budget);
+    }
+
+    ck_assert_int_eq(governor_get_level(), GOVERNOR_SCANLINE);
+    ck_assert_int_eq(ppu_get_context()->renderer, PPU_RENDER_SCANLINE);
+    ck_assert_int_eq(apu_get_quality(), APU_QUALITY_LOW);
+
+    for (int i=0; i<2 * GOVERNOR_DEGRADE_FRAMES; i++) {
+        governor_frame(budget * 1.5, budget);
+    }
+
+    ck_assert_int_eq(governor_get_level(), GOVERNOR_AUDIO);
+    ck_assert_uint_eq(ppu_get_context()->skip_interval, 2);
+
+    // Between the two thresholds nothing changes, however long it lasts
+    for (int i=0; i<10 * GOVERNOR_RESTORE_FRAMES; i++) {
+        governor_frame(budget * 0.75, budget);
+    }
+
+    ck_assert_int_eq(governor_get_level(), GOVERNOR_AUDIO);
+
+    for (int i=0; i<GOVERNOR_RESTORE_FRAMES + 30; i++) {
+        governor_frame(budget * 0.2, budget);
+    }
+
+    ck_assert_int_eq(governor_get_level(), GOVERNOR_SKIP);
+
+    for (int i=0; i<2 * GOVERNOR_RESTORE_FRAMES; i++) {
+        governor_frame(budget * 0.2, budget);
+    }
+
+    ck_assert_int_eq(governor_get_level(), GOVERNOR_FULL);
+    ck_assert_int_eq(ppu_get_context()->renderer, PPU_RENDER_FIFO);
+    ck_assert_uint_eq(ppu_get_context()->skip_interval, 1);
+    ck_assert_int_eq(apu_get_quality(), APU_QUALITY_LOW);
+
+    // A configured high quality is lowered at the audio level and restored
+    governor_enable(false);
+    apu_set_quality(APU_QUALITY_HIGH);
+    governor_enable(true);
+
+    for (int i=0; i<3 * GOVERNOR_DEGRADE_FRAMES; i++) {
+        governor_frame(budget * 1.5, budget);
+    }
+
+    ck_assert_int_eq(governor_get_level(), GOVERNOR_AUDIO);
+    ck_assert_int_eq(apu_get_quality(), APU_QUALITY_LOW);
+
+    for (int i=0; i<3 * GOVERNOR_RESTORE_FRAMES + 90; i++) {
+        governor_frame(budget * 0.2, budget);
+    }
+
+    ck_assert_int_eq(governor_get_level(), GOVERNOR_FULL);
+    ck_assert_int_eq(apu_get_quality(), APU_QUALITY_HIGH);
+
+    governor_enable(false);
+    apu_set_quality(APU_QUALITY_LOW);
+} END_TEST
+
+static double elapsed_ms(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) * 1e3) + ((now.tv_nsec - start->tv_nsec) / 1e6);
+}
+
+/**
+ * Pacing follows the real DMG frame period (70224 / 4194304 s) instead of
+ * a rounded millisecond target, and the stats count every paced frame.
+ * Only lower bounds are checked on timing; a loaded machine can always run late.
+ */
+START_TEST(test_pacer_frame_period) {
+    struct timespec start;
+    pacer_stats stats;
+    int frames = 12;
+
+    ck_assert(pacer_frame_ns() > 16742706.0 && pacer_frame_ns() < 16742707.0);
+
+    pacer_reset();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i=0; i<frames; i++) {
+        pacer_frame(&stats);
+    }
+
+    double ms = elapsed_ms(&start);
+    ck_assert_msg(ms >= (frames * pacer_frame_ns() / 1e6) - 0.5, "paced too fast: %.2f ms", ms);
+
+    // A stall longer than the lag limit restarts the schedule instead of
+    // running frames back to back to catch up
+    struct timespec stall = {0, 150 * 1000000L};
+    nanosleep(&stall, NULL);
+    pacer_frame(&stats);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pacer_frame(&stats);
+    ck_assert(elapsed_ms(&start) > 10);
+
+    // Busy time covers only the work done before the pacer was called
+    struct timespec work = {0, 5 * 1000000L};
+    nanosleep(&work, NULL);
+    pacer_frame(&stats);
+    ck_assert(pacer_busy_ms() >= 5);
+
+    // A report covers every frame since the last one, with ordered busy
+    // percentiles and a positive speed
+    struct timespec step = {0, 2 * 1000000L};
+    u32 calls = 0;
+    bool report = false;
+
+    pacer_reset();
+
+    while (!report && calls < 1000) {
+        nanosleep(&step, NULL);
+        report = pacer_frame(&stats);
+        calls++;
+    }
+
+    ck_assert(report);
+    ck_assert_uint_eq(stats.frames, calls);
+    ck_assert(stats.busy_min_ms >= 2);
+    ck_assert(stats.busy_min_ms <= stats.busy_avg_ms);
+    ck_assert(stats.busy_avg_ms <= stats.busy_p99_ms);
+    ck_assert(stats.speed > 0);
+} END_TEST
+
+static void setup_apu_channels() {
+    static const u8 wave[16] = {
+        0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF,
+        0xFE, 0xDC, 0xBA, 0x98, 0x76, 0x54, 0x32, 0x10
+    };
+
+    apu_init();
+    apu_write(0xFF26, 0x80);
+    apu_write(0xFF24, 0x77);
+    apu_write(0xFF25, 0xFF);
+
+    // CH1/CH2: square waves, no sweep, envelope or length
+    apu_write(0xFF11, 0x80);
+    apu_write(0xFF12, 0xF0);
+    apu_write(0xFF13, 0x00);
+    apu_write(0xFF14, 0x87);
+    apu_write(0xFF16, 0x40);
+    apu_write(0xFF17, 0xA0);
+    apu_write(0xFF18, 0x30);
+    apu_write(0xFF19, 0x85);
+
+    // CH3: wave channel at full volume
+    for (int i=0; i<16; i++) {
+        apu_write(0xFF30 + i, wave[i]);
+    }
+
+    apu_write(0xFF1A, 0x80);
+    apu_write(0xFF1C, 0x20);
+    apu_write(0xFF1D, 0x40);
+    apu_write(0xFF1E, 0x86);
+
+    // CH4: noise
+    apu_write(0xFF21, 0xF0);
+    apu_write(0xFF22, 0x21);
+    apu_write(0xFF23, 0x80);
+}
+
+/**
+ * Batched APU stepping leaves every channel in the same state as stepping
+ * one T-cycle at a time, whenever the batch is flushed.
+ */
+START_TEST(test_apu_batch_matches_per_tick) {
+    static u8 expected[64][4];
+    u8 out[4];
+
+    apu_set_batch(false);
+    setup_apu_channels();
+
+    for (int n=0; n<64; n++) {
+        for (int i=0; i<777; i++) {
+            apu_tick();
+        }
+
+        apu_get_channel_outputs(expected[n]);
+    }
+
+    apu_set_batch(true);
+    setup_apu_channels();
+
+    for (int n=0; n<64; n++) {
+        for (int i=0; i<777; i++) {
+            apu_tick();
+        }
+
+        apu_get_channel_outputs(out);
+        ck_assert_mem_eq(out, expected[n], 4);
+    }
+
+    apu_set_batch(false);
+} END_TEST
+
 Suite *stack_suite() {
     Suite *s = suite_create("emu");
     TCase *tc = tcase_create("core");
@@ -199,8 +1464,59 @@ Suite *stack_suite() {
     tcase_add_test(tc_apu, test_apu_register_roundtrip_property);
     tcase_add_test(tc_apu, test_apu_nr52_special_behavior);
     tcase_add_test(tc_apu, test_apu_disabled_ignores_writes);
+    tcase_add_test(tc_apu, test_apu_batch_matches_per_tick);
     suite_add_tcase(s, tc_apu);
 
+    TCase *tc_watch = tcase_create("watch");
+    tcase_add_test(tc_watch, test_watch_write_value_condition);
+    tcase_add_test(tc_watch, test_watch_exec_value_is_unhooked);
+    suite_add_tcase(s, tc_watch);
+
+    TCase *tc_cheat = tcase_create("cheat");
+    tcase_add_test(tc_cheat, test_cheat_code_decoding);
+    tcase_add_test(tc_cheat, test_cheat_apply);
+    suite_add_tcase(s, tc_cheat);
+
+    TCase *tc_patch = tcase_create("patch");
+    tcase_add_test(tc_patch, test_patch_ips);
+    tcase_add_test(tc_patch, test_patch_ups_crc);
+    suite_add_tcase(s, tc_patch);
+
+    TCase *tc_romdb = tcase_create("romdb");
+    tcase_add_test(tc_romdb, test_romdb_rejects_bad_count);
+    tcase_add_test(tc_romdb, test_romdb_retries_unreadable);
+    suite_add_tcase(s, tc_romdb);
+
+    TCase *tc_checksum = tcase_create("checksum");
+    tcase_add_test(tc_checksum, test_checksum_vectors);
+    suite_add_tcase(s, tc_checksum);
+
+    TCase *tc_snapshot = tcase_create("snapshot");
+    tcase_add_test(tc_snapshot, test_snapshot_restores_machine_state);
+    suite_add_tcase(s, tc_snapshot);
+
+    TCase *tc_ppu = tcase_create("ppu");
+    tcase_add_test(tc_ppu, test_scanline_matches_fifo);
+    tcase_add_test(tc_ppu, test_ppu_thread_matches_fifo);
+    tcase_add_test(tc_ppu, test_tile_cache_invalidation);
+    tcase_add_test(tc_ppu, test_pixel_kernels_match_scalar);
+    tcase_add_test(tc_ppu, test_sprite_index_incremental);
+    tcase_add_test(tc_ppu, test_bg_layer_updates);
+    tcase_add_test(tc_ppu, test_video_convert_formats);
+    tcase_add_test(tc_ppu, test_framebuf_no_tearing);
+    tcase_add_test(tc_ppu, test_framebuf_dirty_lines);
+    tcase_add_test(tc_ppu, test_framebuf_notify);
+    tcase_add_test(tc_ppu, test_scaler_matches_reference);
+    tcase_add_test(tc_ppu, test_skip_frame_timing);
+    tcase_add_test(tc_ppu, test_lcd_off_holds_state);
+    tcase_add_test(tc_ppu, test_vram_view_snapshot);
+    suite_add_tcase(s, tc_ppu);
+
+    TCase *tc_pacer = tcase_create("pacer");
+    tcase_add_test(tc_pacer, test_pacer_frame_period);
+    tcase_add_test(tc_pacer, test_governor_hysteresis);
+    suite_add_tcase(s, tc_pacer);
+
     return s;
 }
 